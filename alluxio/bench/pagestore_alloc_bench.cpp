@@ -0,0 +1,223 @@
+/*   SPDX-License-Identifier: Apache-2.0
+ *
+ *   Counts C++ heap allocations on the steady-state SpdkPageStore
+ *   WritePage/ReadPage/Flush path. Exits non-zero if any are observed.
+ *   With -a the same loop runs as PageTask coroutines, one per operation.
+ *
+ *   sudo ./buildDir/pagestore_alloc_bench -c bdev.json -b Malloc0
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk/thread.h"
+#include "spdk/bdev.h"
+#include "spdk/env.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk_pagestore_interface.h"
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static std::string g_bdev_name = "Malloc0";
+static uint64_t g_ops = 200000;
+static uint64_t g_warmup = 10000;
+static uint64_t g_pages = 64;
+static uint64_t g_flush_every = 16;
+static bool g_coroutines = false;
+
+class AllocBench {
+public:
+    std::unique_ptr<SpdkPageStore> store;
+    char* buf = nullptr;
+    uint64_t issued = 0;
+    uint64_t allocs_at_start = 0;
+    uint64_t req_allocs_at_start = 0;
+    int rc = 0;
+
+    ~AllocBench() {
+        if (buf) spdk_dma_free(buf);
+    }
+};
+
+static void alloc_bench_usage() {
+    printf(" -b <bdev>                 name of the bdev to use\n");
+    printf(" -n <ops>                  measured operations (default 200000)\n");
+    printf(" -w <ops>                  warm-up operations (default 10000)\n");
+    printf(" -f <ops>                  make every n-th operation a Flush (default 16, 0 = none)\n");
+    printf(" -a                        issue operations from coroutines\n");
+}
+
+static int alloc_bench_parse_arg(int ch, char *arg) {
+    switch (ch) {
+    case 'b':
+        g_bdev_name = arg;
+        break;
+    case 'n':
+        g_ops = strtoull(arg, nullptr, 10);
+        break;
+    case 'w':
+        g_warmup = strtoull(arg, nullptr, 10);
+        break;
+    case 'f':
+        g_flush_every = strtoull(arg, nullptr, 10);
+        break;
+    case 'a':
+        g_coroutines = true;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void finish(AllocBench* bench) {
+    uint64_t allocs = g_allocs.load() - bench->allocs_at_start;
+    uint64_t req_allocs = bench->store->GetRequestAllocations() - bench->req_allocs_at_start;
+    PageBufferPoolStats pool = bench->store->GetBufferPoolStats();
+
+    printf("ops: %" PRIu64 "\n", g_ops);
+    printf("heap allocations: %" PRIu64 " (%.4f per op)\n", allocs,
+           g_ops ? static_cast<double>(allocs) / g_ops : 0.0);
+    printf("request context heap allocations: %" PRIu64 "\n", req_allocs);
+    printf("buffer pool hits/misses/fallbacks: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n",
+           pool.hits, pool.misses, pool.fallbacks);
+    if (g_coroutines) {
+        CoroFramePoolStats frames = CoroFramePool::GetStats();
+        printf("coroutine frame hits/misses: %" PRIu64 "/%" PRIu64 "\n", frames.hits,
+               frames.misses);
+    }
+    bench->rc = allocs == 0 ? 0 : 1;
+
+    bench->store->Close([bench](bool) { spdk_app_stop(bench->rc); });
+}
+
+static void issue_next(AllocBench* bench);
+
+static bool is_flush(uint64_t n) {
+    return g_flush_every && n % g_flush_every == g_flush_every - 1;
+}
+
+static void op_done(void* arg, IoStatus status) {
+    auto bench = static_cast<AllocBench*>(arg);
+    if (!status) {
+        SPDK_ERRLOG("PageStore I/O failed\n");
+        bench->rc = -1;
+        bench->store->Close([](bool) { spdk_app_stop(-1); });
+        return;
+    }
+    issue_next(bench);
+}
+
+static void issue_next(AllocBench* bench) {
+    if (bench->issued == g_warmup) {
+        bench->allocs_at_start = g_allocs.load();
+        bench->req_allocs_at_start = bench->store->GetRequestAllocations();
+    }
+    if (bench->issued == g_warmup + g_ops) {
+        finish(bench);
+        return;
+    }
+    uint64_t n = bench->issued++;
+    uint64_t pageId = (n / 2) % g_pages;
+    if (is_flush(n)) {
+        bench->store->Flush(IoCallback(op_done, bench));
+    } else if (n % 2 == 0) {
+        bench->store->WritePage(pageId, bench->buf, IoCallback(op_done, bench));
+    } else {
+        bench->store->ReadPage(pageId, bench->buf, IoCallback(op_done, bench));
+    }
+}
+
+static PageTask<IoStatus> bench_op(AllocBench* bench, uint64_t n) {
+    uint64_t pageId = (n / 2) % g_pages;
+    if (is_flush(n)) co_return co_await bench->store->Sync();
+    if (n % 2 == 0) co_return co_await bench->store->Write(pageId, bench->buf);
+    co_return co_await bench->store->Read(pageId, bench->buf);
+}
+
+static PageTask<IoStatus> bench_loop(AllocBench* bench) {
+    for (uint64_t n = 0; n < g_warmup + g_ops; n++) {
+        if (n == g_warmup) {
+            bench->allocs_at_start = g_allocs.load();
+            bench->req_allocs_at_start = bench->store->GetRequestAllocations();
+        }
+        IoStatus status = co_await bench_op(bench, n);
+        if (!status) co_return status;
+    }
+    co_return IoStatus::kOk;
+}
+
+static void alloc_bench_run(AllocBench* bench);
+
+static void alloc_bench_start(void* arg) {
+    auto bench = static_cast<AllocBench*>(arg);
+
+    bench->store = std::make_unique<SpdkPageStore>();
+    bench->store->Init(g_bdev_name, [bench](bool ready) {
+        if (!ready) {
+            SPDK_ERRLOG("Failed to open PageStore on %s\n", g_bdev_name.c_str());
+            bench->store->Close([](bool) { spdk_app_stop(-1); });
+            return;
+        }
+        alloc_bench_run(bench);
+    });
+}
+
+static void alloc_bench_run(AllocBench* bench) {
+    bench->buf = static_cast<char*>(spdk_dma_zmalloc(kPageSize, kPageSize, nullptr));
+    if (!bench->buf) {
+        SPDK_ERRLOG("Failed to allocate buffer\n");
+        bench->store->Close([](bool) { spdk_app_stop(-1); });
+        return;
+    }
+    snprintf(bench->buf, kPageSize, "%s", "alloc bench page");
+    if (!g_coroutines) {
+        issue_next(bench);
+        return;
+    }
+    Spawn(bench_loop(bench), [bench](IoStatus status) {
+        if (status) {
+            finish(bench);
+        } else {
+            op_done(bench, status);
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    struct spdk_app_opts opts = {};
+    int rc = 0;
+
+    spdk_app_opts_init(&opts, sizeof(opts));
+    opts.name = "pagestore_alloc_bench";
+    opts.rpc_addr = nullptr;
+
+    if ((rc = spdk_app_parse_args(argc, argv, &opts, "ab:f:n:w:", nullptr, alloc_bench_parse_arg,
+                                  alloc_bench_usage)) != SPDK_APP_PARSE_ARGS_SUCCESS) {
+        exit(rc);
+    }
+
+    auto bench = std::make_unique<AllocBench>();
+    rc = spdk_app_start(&opts, alloc_bench_start, bench.get());
+    if (rc) {
+        SPDK_ERRLOG("ERROR starting application\n");
+    } else {
+        rc = bench->rc;
+    }
+
+    bench.reset();
+    spdk_app_fini();
+    return rc;
+}
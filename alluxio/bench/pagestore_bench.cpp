@@ -0,0 +1,638 @@
+/*   SPDX-License-Identifier: Apache-2.0
+ *
+ *   Closed-loop load generator for the PageStore implementations. One worker
+ *   thread per reactor keeps -q operations in flight against a shared store
+ *   for the warm-up and then the measured interval, and the results are
+ *   printed as a table (and with -j as JSON): IOPS, bandwidth and latency
+ *   percentiles per operation kind. Operations cover -o bytes of consecutive
+ *   pages; larger ones go through WritePages/ReadPages.
+ *
+ *   Runs against malloc or null bdevs as well as NVMe, so software overhead
+ *   can be measured without a device:
+ *
+ *   sudo ./buildDir/pagestore_bench -c bdev.json -m 0xf -b Null0 -q 32 -M 70 -P zipf -t 10
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk/thread.h"
+#include "spdk/bdev.h"
+#include "spdk/cpuset.h"
+#include "spdk/env.h"
+#include "spdk/event.h"
+#include "spdk/json.h"
+#include "spdk/log.h"
+#include "spdk/util.h"
+#include "spdk_pagestore_interface.h"
+#include "page_store_rpc.h"
+#include "striped_page_store.h"
+#include "zoned_page_store.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class StoreType { kSpdk, kStriped, kZoned };
+enum class Pattern { kSequential, kRandom, kZipf };
+
+static std::string g_bdev_name = "Malloc0";
+static StoreType g_store_type = StoreType::kSpdk;
+static bool g_store_type_set = false;
+static uint32_t g_queue_depth = 32;
+static uint32_t g_read_percent = 70;
+static Pattern g_pattern = Pattern::kRandom;
+static double g_zipf_theta = 0.99;
+static uint64_t g_io_size = kPageSize;
+static uint64_t g_io_pages = 1;
+static double g_time_s = 10;
+static double g_warmup_s = 2;
+static uint64_t g_max_pages = 0;
+static bool g_prefill = false;
+static bool g_verify = false;
+static std::string g_json_path;
+static std::string g_record_path;
+
+static const char* kStoreNames[] = {"spdk", "striped", "zoned"};
+static const char* kPatternNames[] = {"seq", "rand", "zipf"};
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases": rank 0 is the hottest. Built once on
+// the main thread, then only read.
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        zetan_ = Zeta(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) /
+               (1.0 - Zeta(2, theta) / zetan_);
+    }
+
+    // u is uniform in [0, 1).
+    uint64_t Next(double u) const {
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta_)) return 1;
+        auto rank = static_cast<uint64_t>(static_cast<double>(n_) *
+                                          std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return std::min(rank, n_ - 1);
+    }
+
+private:
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+class Bench;
+class Worker;
+
+// One operation kept in flight by a worker, with its own buffer.
+struct BenchSlot {
+    Worker* worker = nullptr;
+    char* buf = nullptr;
+    std::vector<PageRead> reads;
+    std::vector<PageWrite> writes;
+    uint64_t start = 0;
+    bool read = false;
+};
+
+class Worker {
+public:
+    Bench* bench = nullptr;
+    struct spdk_thread* thread = nullptr;
+    uint32_t core = 0;
+    std::vector<BenchSlot> slots;
+    uint64_t rng = 0;
+    uint64_t seq_next = 0;   // next I/O unit of the sequential pattern
+    uint64_t fill_next = 0;  // prefill covers units [fill_next, fill_end)
+    uint64_t fill_end = 0;
+    uint64_t fill_errors = 0;
+    bool filling = false;
+    uint64_t measure_start = 0; // ticks
+    uint64_t end = 0;
+    uint32_t in_flight = 0;
+    PageOpStats stats[2]; // [0] writes, [1] reads; ops counts I/Os
+
+    ~Worker() {
+        for (BenchSlot& slot : slots) {
+            if (slot.buf) spdk_dma_free(slot.buf);
+        }
+    }
+
+    // xorshift64*
+    uint64_t Rand() {
+        rng ^= rng >> 12;
+        rng ^= rng << 25;
+        rng ^= rng >> 27;
+        return rng * 0x2545F4914F6CDD1DULL;
+    }
+    double RandUnit() { return static_cast<double>(Rand() >> 11) * 0x1.0p-53; }
+};
+
+class Bench {
+public:
+    std::unique_ptr<PageStore> store;
+    uint64_t units = 0; // working set in I/O units of g_io_pages pages
+    std::unique_ptr<ZipfGenerator> zipf;
+    std::vector<std::unique_ptr<Worker>> workers;
+    struct spdk_thread* main_thread = nullptr;
+    size_t pending = 0; // workers still in the current phase
+    double ns_per_tick = 0;
+    int rc = 0;
+};
+
+static void bench_usage() {
+    printf(" -b <bdev>                 bdev to use; a comma-separated list implies -S striped\n");
+    printf(" -S <store>                spdk (default), striped or zoned\n");
+    printf(" -q <depth>                operations in flight per reactor (default 32)\n");
+    printf(" -M <percent>              share of reads (default 70)\n");
+    printf(" -P <pattern>              pageId distribution: seq, rand (default) or zipf\n");
+    printf(" -Z <theta>                zipf skew, 0 < theta < 1 (default 0.99)\n");
+    printf(" -o <bytes>                I/O size, a multiple of the page size (default %u)\n",
+           static_cast<unsigned>(kPageSize));
+    printf(" -t <sec>                  measured run time (default 10)\n");
+    printf(" -w <sec>                  warm-up time (default 2)\n");
+    printf(" -N <pages>                limit the working set to the first N pages\n");
+    printf(" -F                        write the working set once before the warm-up\n");
+    printf(" -V                        verify read CRCs (implies -F)\n");
+    printf(" -j <file>                 also write the results as JSON to file\n");
+    printf(" -R <file>                 capture the store's calls for pagestore_replay (-S spdk)\n");
+}
+
+static int bench_parse_arg(int ch, char *arg) {
+    switch (ch) {
+    case 'b':
+        g_bdev_name = arg;
+        break;
+    case 'S':
+        for (size_t i = 0; i < SPDK_COUNTOF(kStoreNames); i++) {
+            if (strcmp(arg, kStoreNames[i]) == 0) {
+                g_store_type = static_cast<StoreType>(i);
+                g_store_type_set = true;
+                return 0;
+            }
+        }
+        return -EINVAL;
+    case 'q':
+        g_queue_depth = static_cast<uint32_t>(strtoul(arg, nullptr, 10));
+        if (g_queue_depth == 0) return -EINVAL;
+        break;
+    case 'M':
+        g_read_percent = static_cast<uint32_t>(strtoul(arg, nullptr, 10));
+        if (g_read_percent > 100) return -EINVAL;
+        break;
+    case 'P':
+        for (size_t i = 0; i < SPDK_COUNTOF(kPatternNames); i++) {
+            if (strcmp(arg, kPatternNames[i]) == 0) {
+                g_pattern = static_cast<Pattern>(i);
+                return 0;
+            }
+        }
+        return -EINVAL;
+    case 'Z':
+        g_zipf_theta = strtod(arg, nullptr);
+        if (!(g_zipf_theta > 0 && g_zipf_theta < 1)) return -EINVAL;
+        break;
+    case 'o':
+        g_io_size = strtoull(arg, nullptr, 10);
+        if (g_io_size == 0 || g_io_size % kPageSize != 0) return -EINVAL;
+        g_io_pages = g_io_size / kPageSize;
+        break;
+    case 't':
+        g_time_s = strtod(arg, nullptr);
+        if (!(g_time_s > 0)) return -EINVAL;
+        break;
+    case 'w':
+        g_warmup_s = strtod(arg, nullptr);
+        if (!(g_warmup_s >= 0)) return -EINVAL;
+        break;
+    case 'N':
+        g_max_pages = strtoull(arg, nullptr, 10);
+        break;
+    case 'F':
+        g_prefill = true;
+        break;
+    case 'V':
+        g_verify = true;
+        g_prefill = true;
+        break;
+    case 'j':
+        g_json_path = arg;
+        break;
+    case 'R':
+        g_record_path = arg;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static uint64_t store_pages(Bench* bench) {
+    switch (g_store_type) {
+    case StoreType::kSpdk:
+        return static_cast<SpdkPageStore*>(bench->store.get())->NumPages();
+    case StoreType::kStriped:
+        return static_cast<StripedPageStore*>(bench->store.get())->NumPages();
+    case StoreType::kZoned:
+        return static_cast<ZonedPageStore*>(bench->store.get())->NumPages();
+    }
+    return 0;
+}
+
+static void close_store(Bench* bench, IoCallback cb) {
+    switch (g_store_type) {
+    case StoreType::kSpdk:
+        static_cast<SpdkPageStore*>(bench->store.get())->Close(std::move(cb));
+        break;
+    case StoreType::kStriped:
+        static_cast<StripedPageStore*>(bench->store.get())->Close(std::move(cb));
+        break;
+    case StoreType::kZoned:
+        static_cast<ZonedPageStore*>(bench->store.get())->Close(std::move(cb));
+        break;
+    }
+}
+
+static void worker_exit(void*) {
+    spdk_thread_exit(spdk_get_thread());
+}
+
+static void bench_stop(Bench* bench) {
+    close_store(bench, [bench](bool) {
+        for (auto& w : bench->workers) spdk_thread_send_msg(w->thread, worker_exit, nullptr);
+        spdk_app_stop(bench->rc);
+    });
+}
+
+static void slot_next(BenchSlot* slot);
+
+static void slot_submit(BenchSlot* slot, uint64_t unit, bool read) {
+    PageStore* store = slot->worker->bench->store.get();
+    uint64_t first = unit * g_io_pages;
+    IoCallback cb(
+        [](void* arg, IoStatus status) {
+            auto slot = static_cast<BenchSlot*>(arg);
+            Worker* w = slot->worker;
+            uint64_t now = spdk_get_ticks();
+            if (w->filling) {
+                if (!status) w->fill_errors++;
+            } else if (slot->start >= w->measure_start && now <= w->end) {
+                PageOpStats& s = w->stats[slot->read];
+                auto ns = static_cast<uint64_t>((now - slot->start) * w->bench->ns_per_tick);
+                s.ops++;
+                s.bytes += g_io_size;
+                if (!status) s.errors++;
+                s.latency.buckets[PageLatencyStats::Bucket(ns)]++;
+                s.latency.count++;
+                s.latency.sum_ns += ns;
+                s.latency.max_ns = std::max(s.latency.max_ns, ns);
+            }
+            if (status) {
+                slot_next(slot);
+                return;
+            }
+            // Failures may complete inline; go through the message queue so a
+            // failing store cannot recurse.
+            spdk_thread_send_msg(spdk_get_thread(),
+                                 [](void* arg) { slot_next(static_cast<BenchSlot*>(arg)); }, slot);
+        },
+        slot);
+
+    slot->read = read;
+    slot->start = spdk_get_ticks();
+    if (g_io_pages == 1) {
+        if (read) {
+            store->ReadPage(first, slot->buf, std::move(cb));
+        } else {
+            store->WritePage(first, slot->buf, std::move(cb));
+        }
+        return;
+    }
+    for (uint64_t i = 0; i < g_io_pages; i++) {
+        slot->reads[i] = {first + i, slot->buf + i * kPageSize};
+        slot->writes[i] = {first + i, slot->buf + i * kPageSize};
+    }
+    if (read) {
+        store->ReadPages(slot->reads, std::move(cb));
+    } else {
+        store->WritePages(slot->writes, std::move(cb));
+    }
+}
+
+static void worker_phase_done(void* arg);
+
+static void slot_next(BenchSlot* slot) {
+    Worker* w = slot->worker;
+    Bench* bench = w->bench;
+    if (w->filling) {
+        if (w->fill_next < w->fill_end) {
+            slot_submit(slot, w->fill_next++, false);
+            return;
+        }
+    } else if (spdk_get_ticks() < w->end) {
+        uint64_t unit = 0;
+        switch (g_pattern) {
+        case Pattern::kSequential:
+            unit = w->seq_next;
+            w->seq_next = (w->seq_next + 1) % bench->units;
+            break;
+        case Pattern::kRandom:
+            unit = w->Rand() % bench->units;
+            break;
+        case Pattern::kZipf:
+            if (bench->zipf) unit = bench->zipf->Next(w->RandUnit());
+            break;
+        }
+        slot_submit(slot, unit, w->Rand() % 100 < g_read_percent);
+        return;
+    }
+    if (--w->in_flight == 0) spdk_thread_send_msg(bench->main_thread, worker_phase_done, w);
+}
+
+// Runs on the worker's thread; with filling set, writes units
+// [fill_next, fill_end) once, else runs the warm-up and measured interval.
+static void worker_start(void* arg) {
+    auto w = static_cast<Worker*>(arg);
+    if (w->filling && w->fill_next == w->fill_end) {
+        spdk_thread_send_msg(w->bench->main_thread, worker_phase_done, w);
+        return;
+    }
+    if (!w->filling) {
+        uint64_t hz = spdk_get_ticks_hz();
+        w->measure_start = spdk_get_ticks() + static_cast<uint64_t>(g_warmup_s * hz);
+        w->end = w->measure_start + static_cast<uint64_t>(g_time_s * hz);
+    }
+    w->in_flight = static_cast<uint32_t>(w->slots.size());
+    for (BenchSlot& slot : w->slots) slot_next(&slot);
+}
+
+static void start_phase(Bench* bench, bool filling) {
+    bench->pending = bench->workers.size();
+    for (auto& w : bench->workers) {
+        w->filling = filling;
+        spdk_thread_send_msg(w->thread, worker_start, w.get());
+    }
+}
+
+static double percentile_us(const PageLatencyStats& l, double q) {
+    return l.Percentile(q) / 1e3;
+}
+
+static void print_row(const char* name, const PageOpStats& s) {
+    const PageLatencyStats& l = s.latency;
+    printf("%-6s %12.1f %10.2f %8" PRIu64 " %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+           s.ops / g_time_s, s.bytes / g_time_s / (1024.0 * 1024.0), s.errors, l.MeanNs() / 1e3,
+           percentile_us(l, 0.5), percentile_us(l, 0.9), percentile_us(l, 0.99),
+           percentile_us(l, 0.999), l.max_ns / 1e3);
+}
+
+static void write_json_op(struct spdk_json_write_ctx* w, const char* name, const PageOpStats& s) {
+    spdk_json_write_named_object_begin(w, name);
+    spdk_json_write_named_uint64(w, "ios", s.ops);
+    spdk_json_write_named_uint64(w, "bytes", s.bytes);
+    spdk_json_write_named_uint64(w, "errors", s.errors);
+    spdk_json_write_named_double(w, "iops", s.ops / g_time_s);
+    spdk_json_write_named_double(w, "mib_per_s", s.bytes / g_time_s / (1024.0 * 1024.0));
+    WritePageLatencyStats(w, s.latency);
+    spdk_json_write_object_end(w);
+}
+
+static int json_write_file(void* ctx, const void* data, size_t size) {
+    return fwrite(data, 1, size, static_cast<FILE*>(ctx)) == size ? 0 : -1;
+}
+
+static void write_json(Bench* bench, const PageOpStats stats[2], const PageOpStats& total) {
+    FILE* f = fopen(g_json_path.c_str(), "w");
+    if (!f) {
+        SPDK_ERRLOG("Cannot open %s: %s\n", g_json_path.c_str(), strerror(errno));
+        bench->rc = -1;
+        return;
+    }
+    struct spdk_json_write_ctx* w = spdk_json_write_begin(json_write_file, f,
+                                                          SPDK_JSON_WRITE_FLAG_FORMATTED);
+    spdk_json_write_object_begin(w);
+
+    spdk_json_write_named_object_begin(w, "config");
+    spdk_json_write_named_string(w, "store", kStoreNames[static_cast<size_t>(g_store_type)]);
+    spdk_json_write_named_string(w, "bdev", g_bdev_name.c_str());
+    spdk_json_write_named_uint64(w, "workers", bench->workers.size());
+    spdk_json_write_named_uint32(w, "queue_depth", g_queue_depth);
+    spdk_json_write_named_uint64(w, "io_size", g_io_size);
+    spdk_json_write_named_uint32(w, "read_percent", g_read_percent);
+    spdk_json_write_named_string(w, "pattern", kPatternNames[static_cast<size_t>(g_pattern)]);
+    if (g_pattern == Pattern::kZipf) spdk_json_write_named_double(w, "zipf_theta", g_zipf_theta);
+    spdk_json_write_named_uint64(w, "pages", bench->units * g_io_pages);
+    spdk_json_write_named_double(w, "time_s", g_time_s);
+    spdk_json_write_named_double(w, "warmup_s", g_warmup_s);
+    spdk_json_write_named_bool(w, "verify", g_verify);
+    spdk_json_write_object_end(w);
+
+    spdk_json_write_named_object_begin(w, "results");
+    write_json_op(w, "read", stats[1]);
+    write_json_op(w, "write", stats[0]);
+    write_json_op(w, "total", total);
+    spdk_json_write_object_end(w);
+
+    spdk_json_write_named_array_begin(w, "workers");
+    for (auto& worker : bench->workers) {
+        spdk_json_write_object_begin(w);
+        spdk_json_write_named_uint32(w, "core", worker->core);
+        spdk_json_write_named_double(w, "iops",
+                                     (worker->stats[0].ops + worker->stats[1].ops) / g_time_s);
+        spdk_json_write_object_end(w);
+    }
+    spdk_json_write_array_end(w);
+
+    if (g_store_type == StoreType::kSpdk) {
+        spdk_json_write_name(w, "store");
+        WritePageStoreStats(w, g_bdev_name, *static_cast<SpdkPageStore*>(bench->store.get()));
+    }
+
+    spdk_json_write_object_end(w);
+    spdk_json_write_end(w);
+    fputc('\n', f);
+    fclose(f);
+}
+
+static void report(Bench* bench) {
+    PageOpStats stats[2];
+    uint64_t fill_errors = 0;
+    for (auto& w : bench->workers) {
+        stats[0] += w->stats[0];
+        stats[1] += w->stats[1];
+        fill_errors += w->fill_errors;
+    }
+    PageOpStats total = stats[0];
+    total += stats[1];
+
+    printf("%s store on %s: %zu workers x qd %u, %" PRIu64 "-byte I/O, %u%% reads, %s",
+           kStoreNames[static_cast<size_t>(g_store_type)], g_bdev_name.c_str(),
+           bench->workers.size(), g_queue_depth, g_io_size, g_read_percent,
+           kPatternNames[static_cast<size_t>(g_pattern)]);
+    if (g_pattern == Pattern::kZipf) printf(" (theta %.2f)", g_zipf_theta);
+    printf(" over %" PRIu64 " pages, %g s after %g s warm-up\n", bench->units * g_io_pages,
+           g_time_s, g_warmup_s);
+    printf("%-6s %12s %10s %8s %9s %9s %9s %9s %9s %9s\n", "op", "IOPS", "MiB/s", "errors",
+           "mean(us)", "p50", "p90", "p99", "p99.9", "max");
+    print_row("read", stats[1]);
+    print_row("write", stats[0]);
+    print_row("total", total);
+    if (fill_errors) printf("prefill errors: %" PRIu64 "\n", fill_errors);
+
+    if (total.errors || fill_errors) bench->rc = 1;
+    if (!g_json_path.empty()) write_json(bench, stats, total);
+}
+
+// Main thread: a worker has retired all of its slots.
+static void worker_phase_done(void* arg) {
+    auto w = static_cast<Worker*>(arg);
+    Bench* bench = w->bench;
+    if (--bench->pending > 0) return;
+    if (w->filling) {
+        start_phase(bench, false);
+        return;
+    }
+    report(bench);
+    bench_stop(bench);
+}
+
+static bool bench_setup(Bench* bench) {
+    uint64_t pages = store_pages(bench);
+    if (g_max_pages) pages = std::min(pages, g_max_pages);
+    bench->units = pages / g_io_pages;
+    if (bench->units == 0) {
+        SPDK_ERRLOG("I/O size exceeds the %" PRIu64 "-page working set\n", pages);
+        return false;
+    }
+    if (g_pattern == Pattern::kZipf && bench->units > 1) {
+        bench->zipf = std::make_unique<ZipfGenerator>(bench->units, g_zipf_theta);
+    }
+    bench->ns_per_tick = 1e9 / static_cast<double>(spdk_get_ticks_hz());
+
+    uint32_t core;
+    size_t n = spdk_env_get_core_count();
+    SPDK_ENV_FOREACH_CORE(core) {
+        auto w = std::make_unique<Worker>();
+        size_t i = bench->workers.size();
+        w->bench = bench;
+        w->core = core;
+        w->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        w->seq_next = bench->units * i / n;
+        w->fill_next = bench->units * i / n;
+        w->fill_end = bench->units * (i + 1) / n;
+        w->slots.resize(g_queue_depth);
+        for (BenchSlot& slot : w->slots) {
+            slot.worker = w.get();
+            slot.buf = static_cast<char*>(spdk_dma_zmalloc(g_io_size, kPageSize, nullptr));
+            if (!slot.buf) {
+                SPDK_ERRLOG("Failed to allocate I/O buffers\n");
+                return false;
+            }
+            memset(slot.buf, 0x5a, g_io_size);
+            slot.reads.resize(g_io_pages);
+            slot.writes.resize(g_io_pages);
+        }
+
+        struct spdk_cpuset mask;
+        spdk_cpuset_zero(&mask);
+        spdk_cpuset_set_cpu(&mask, core, true);
+        std::string name = "pagestore_bench_" + std::to_string(core);
+        w->thread = spdk_thread_create(name.c_str(), &mask);
+        if (!w->thread) {
+            SPDK_ERRLOG("Failed to create a thread on core %u\n", core);
+            return false;
+        }
+        bench->workers.push_back(std::move(w));
+    }
+    return true;
+}
+
+static void bench_start(void* arg) {
+    auto bench = static_cast<Bench*>(arg);
+    bench->main_thread = spdk_get_thread();
+
+    auto ready = [bench](bool ok) {
+        if (!ok || !bench_setup(bench)) {
+            if (!ok) SPDK_ERRLOG("Failed to open PageStore on %s\n", g_bdev_name.c_str());
+            bench->rc = -1;
+            bench_stop(bench);
+            return;
+        }
+        start_phase(bench, g_prefill);
+    };
+
+    SpdkPageStoreOptions opts;
+    opts.read_verify = g_verify ? SpdkPageStoreOptions::ReadVerify::kAlways
+                                : SpdkPageStoreOptions::ReadVerify::kOff;
+    switch (g_store_type) {
+    case StoreType::kSpdk: {
+        opts.record_path = g_record_path;
+        auto store = std::make_unique<SpdkPageStore>(opts);
+        auto raw = store.get();
+        bench->store = std::move(store); // done may run inline
+        raw->Init(g_bdev_name, ready);
+        break;
+    }
+    case StoreType::kStriped: {
+        StripedPageStoreOptions striped;
+        striped.device = opts;
+        std::vector<std::string> names;
+        size_t start = 0;
+        while (start <= g_bdev_name.size()) {
+            size_t end = std::min(g_bdev_name.find(',', start), g_bdev_name.size());
+            if (end > start) names.push_back(g_bdev_name.substr(start, end - start));
+            start = end + 1;
+        }
+        auto store = std::make_unique<StripedPageStore>(striped);
+        auto raw = store.get();
+        bench->store = std::move(store); // done may run inline
+        raw->Init(names, ready);
+        break;
+    }
+    case StoreType::kZoned: {
+        auto store = std::make_unique<ZonedPageStore>();
+        auto raw = store.get();
+        bench->store = std::move(store); // done may run inline
+        raw->Init(g_bdev_name, ready);
+        break;
+    }
+    }
+}
+
+int main(int argc, char **argv) {
+    struct spdk_app_opts opts = {};
+    int rc = 0;
+
+    spdk_app_opts_init(&opts, sizeof(opts));
+    opts.name = "pagestore_bench";
+    opts.rpc_addr = nullptr;
+
+    if ((rc = spdk_app_parse_args(argc, argv, &opts, "b:FM:N:o:P:q:R:S:t:Vw:Z:j:", nullptr,
+                                  bench_parse_arg, bench_usage)) != SPDK_APP_PARSE_ARGS_SUCCESS) {
+        exit(rc);
+    }
+    if (!g_store_type_set && g_bdev_name.find(',') != std::string::npos) {
+        g_store_type = StoreType::kStriped;
+    }
+
+    auto bench = std::make_unique<Bench>();
+    rc = spdk_app_start(&opts, bench_start, bench.get());
+    if (rc) {
+        SPDK_ERRLOG("ERROR starting application\n");
+    } else {
+        rc = bench->rc;
+    }
+
+    bench.reset();
+    spdk_app_fini();
+    return rc;
+}
@@ -0,0 +1,630 @@
+/*   SPDX-License-Identifier: Apache-2.0
+ *
+ *   CPU cost of single PageStore operations on one thread. Each case submits
+ *   batches of -q operations and splits the work into the submit path (the
+ *   store calls themselves) and the complete path (from the end of the batch
+ *   submission to the last callback of the batch). Both are reported per
+ *   operation: cycles and instructions from perf_event_open (user space
+ *   only), wall-clock nanoseconds and C++ heap allocations.
+ *
+ *   The bdev_write/bdev_read cases issue the same I/O straight to the bdev,
+ *   so against a null bdev the difference is what the store adds. With -k
+ *   the results are checked against a baseline file, and more instructions
+ *   (beyond -x percent) or allocations than recorded there make the run fail,
+ *   as does an entry with no instruction count while perf counters work;
+ *   -u writes the current numbers as a new baseline.
+ *
+ *   sudo ./buildDir/pagestore_cost_bench -c bdev.json -m 0x1 -b Null0 \
+ *       -k alluxio/bench/pagestore_cost_baseline.txt
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk/thread.h"
+#include "spdk/bdev.h"
+#include "spdk/env.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk/util.h"
+#include "spdk_pagestore_interface.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static std::string g_bdev_name = "Null0";
+static uint32_t g_batch = 32;
+static uint64_t g_batches = 2000;
+static uint64_t g_warmup_batches = 200;
+static bool g_verify = false;
+static std::string g_baseline_path;
+static std::string g_update_path;
+static double g_tolerance_percent = 10;
+
+// Consecutive operations touch pages this far apart, which keeps them out of
+// read-ahead and spreads them over the store.
+static constexpr uint64_t kPageStride = 7919;
+static constexpr uint64_t kMaxKeys = 65536;
+
+// Cycles and instructions retired in user space by the calling thread.
+class PerfCounters {
+public:
+    ~PerfCounters() {
+        if (member_ >= 0) close(member_);
+        if (leader_ >= 0) close(leader_);
+    }
+
+    bool Open() {
+        leader_ = OpenCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (leader_ < 0) return false;
+        member_ = OpenCounter(PERF_COUNT_HW_INSTRUCTIONS, leader_);
+        if (member_ < 0) {
+            close(leader_);
+            leader_ = -1;
+            return false;
+        }
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+    bool Enabled() const { return leader_ >= 0; }
+
+    void Read(uint64_t* cycles, uint64_t* instructions) const {
+        struct {
+            uint64_t nr;
+            uint64_t values[2];
+        } group = {};
+        if (leader_ < 0 || read(leader_, &group, sizeof(group)) != sizeof(group)) {
+            *cycles = *instructions = 0;
+            return;
+        }
+        *cycles = group.values[0];
+        *instructions = group.values[1];
+    }
+
+private:
+    static int OpenCounter(uint64_t config, int group) {
+        struct perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    int leader_ = -1;
+    int member_ = -1;
+};
+
+struct CostSnapshot {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t ticks = 0;
+    uint64_t allocs = 0;
+};
+
+// Totals over the measured batches of one path.
+struct CostTotals {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t ticks = 0;
+    uint64_t allocs = 0;
+
+    void Add(const CostSnapshot& from, const CostSnapshot& to, const CostSnapshot& overhead) {
+        // Taking a snapshot retires some user instructions of its own.
+        auto net = [](uint64_t a, uint64_t b, uint64_t o) { return b - a > o ? b - a - o : 0; };
+        cycles += net(from.cycles, to.cycles, overhead.cycles);
+        instructions += net(from.instructions, to.instructions, overhead.instructions);
+        ticks += to.ticks - from.ticks;
+        allocs += to.allocs - from.allocs;
+    }
+};
+
+class CostBench;
+
+struct CostCase {
+    const char* name;
+    const char* reference; // bdev case the store overhead is measured against
+    void (*submit)(CostBench* bench, uint64_t n, char* buf);
+};
+
+struct CostResult {
+    std::string name;
+    std::string reference;
+    uint64_t ops = 0;
+    CostTotals submit;
+    CostTotals complete;
+};
+
+class CostBench {
+public:
+    std::unique_ptr<SpdkPageStore> store;
+    struct spdk_bdev_desc* desc = nullptr;
+    struct spdk_io_channel* bdev_ch = nullptr;
+    struct spdk_thread* thread = nullptr;
+    char* buf = nullptr; // one page per operation of a batch
+    PerfCounters perf;
+    CostSnapshot read_overhead;
+    double ns_per_tick = 0;
+
+    const CostCase* cases = nullptr;
+    size_t num_cases = 0;
+    size_t case_index = 0;
+    uint64_t pages = 0;
+    uint64_t keys = 0;
+    uint64_t batch = 0;     // batches issued in the current case
+    uint64_t next_op = 0;
+    uint32_t outstanding = 0;
+    bool submitting = false;
+    uint64_t errors = 0;
+    CostSnapshot submitted; // end of the current batch's submit path
+    CostResult current;
+    std::vector<CostResult> results;
+    int rc = 0;
+
+    ~CostBench() {
+        if (buf) spdk_dma_free(buf);
+    }
+
+    CostSnapshot Take() const {
+        CostSnapshot s;
+        perf.Read(&s.cycles, &s.instructions);
+        s.ticks = spdk_get_ticks();
+        s.allocs = g_allocs.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+static void cost_bench_usage() {
+    printf(" -b <bdev>                 name of the bdev to use (default Null0)\n");
+    printf(" -q <ops>                  operations per batch (default 32)\n");
+    printf(" -N <batches>              measured batches per case (default 2000)\n");
+    printf(" -w <batches>              warm-up batches per case (default 200)\n");
+    printf(" -V                        verify read CRCs (needs a bdev that keeps data)\n");
+    printf(" -k <file>                 fail if the results regress against this baseline\n");
+    printf(" -u <file>                 write the results as a new baseline\n");
+    printf(" -x <percent>              instruction increase tolerated by -k (default 10)\n");
+}
+
+static int cost_bench_parse_arg(int ch, char *arg) {
+    switch (ch) {
+    case 'b':
+        g_bdev_name = arg;
+        break;
+    case 'q':
+        g_batch = static_cast<uint32_t>(strtoul(arg, nullptr, 10));
+        if (g_batch == 0) return -EINVAL;
+        break;
+    case 'N':
+        g_batches = strtoull(arg, nullptr, 10);
+        if (g_batches == 0) return -EINVAL;
+        break;
+    case 'w':
+        g_warmup_batches = strtoull(arg, nullptr, 10);
+        break;
+    case 'V':
+        g_verify = true;
+        break;
+    case 'k':
+        g_baseline_path = arg;
+        break;
+    case 'u':
+        g_update_path = arg;
+        break;
+    case 'x':
+        g_tolerance_percent = strtod(arg, nullptr);
+        if (!(g_tolerance_percent >= 0)) return -EINVAL;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void op_done(void* arg, IoStatus status);
+
+static void bdev_op_done(struct spdk_bdev_io* bdev_io, bool success, void* arg) {
+    spdk_bdev_free_io(bdev_io);
+    op_done(arg, success);
+}
+
+static uint64_t page_of(CostBench* bench, uint64_t n) {
+    return n * kPageStride % bench->pages;
+}
+
+static void submit_bdev_write(CostBench* bench, uint64_t n, char* buf) {
+    if (spdk_bdev_write(bench->desc, bench->bdev_ch, buf, page_of(bench, n) * kPageSize,
+                        kPageSize, bdev_op_done, bench) != 0) {
+        op_done(bench, false);
+    }
+}
+
+static void submit_bdev_read(CostBench* bench, uint64_t n, char* buf) {
+    if (spdk_bdev_read(bench->desc, bench->bdev_ch, buf, page_of(bench, n) * kPageSize,
+                       kPageSize, bdev_op_done, bench) != 0) {
+        op_done(bench, false);
+    }
+}
+
+static void submit_write(CostBench* bench, uint64_t n, char* buf) {
+    bench->store->WritePage(page_of(bench, n), buf, IoCallback(op_done, bench));
+}
+
+static void submit_read(CostBench* bench, uint64_t n, char* buf) {
+    bench->store->ReadPage(page_of(bench, n), buf, IoCallback(op_done, bench));
+}
+
+static void submit_put(CostBench* bench, uint64_t n, char* buf) {
+    bench->store->PutPage(PageKey{1, n % bench->keys}, buf, IoCallback(op_done, bench));
+}
+
+static void submit_get(CostBench* bench, uint64_t n, char* buf) {
+    bench->store->GetPage(PageKey{1, n % bench->keys}, buf, IoCallback(op_done, bench));
+}
+
+static const CostCase kBdevCases[] = {
+    {"bdev_write", "", submit_bdev_write},
+    {"bdev_read", "", submit_bdev_read},
+};
+
+// put runs before get so that every key get asks for is stored.
+static const CostCase kStoreCases[] = {
+    {"write", "bdev_write", submit_write},
+    {"read", "bdev_read", submit_read},
+    {"put", "bdev_write", submit_put},
+    {"get", "bdev_read", submit_get},
+};
+
+static void run_batch(void* arg);
+static void open_store(CostBench* bench);
+static void finish(CostBench* bench);
+
+// After the last case of a group, outside of any completion.
+static void cases_done(void* arg) {
+    auto bench = static_cast<CostBench*>(arg);
+    if (bench->cases == kBdevCases) {
+        spdk_put_io_channel(bench->bdev_ch);
+        spdk_bdev_close(bench->desc);
+        bench->bdev_ch = nullptr;
+        bench->desc = nullptr;
+        open_store(bench);
+        return;
+    }
+    finish(bench);
+}
+
+static void run_cases(CostBench* bench, const CostCase* cases, size_t n) {
+    bench->cases = cases;
+    bench->num_cases = n;
+    bench->case_index = 0;
+    bench->batch = 0;
+    bench->next_op = 0;
+    run_batch(bench);
+}
+
+static void batch_done(CostBench* bench, const CostSnapshot& end) {
+    if (bench->batch > g_warmup_batches) {
+        bench->current.ops += g_batch;
+        bench->current.complete.Add(bench->submitted, end, bench->read_overhead);
+    }
+    if (bench->batch < g_warmup_batches + g_batches) {
+        // Not from inside the completion, so that the next submit path starts
+        // from the top of the thread's message loop.
+        spdk_thread_send_msg(bench->thread, run_batch, bench);
+        return;
+    }
+
+    const CostCase& c = bench->cases[bench->case_index];
+    bench->current.name = c.name;
+    bench->current.reference = c.reference;
+    bench->results.push_back(std::move(bench->current));
+    bench->current = CostResult();
+    bench->batch = 0;
+    bench->next_op = 0;
+    if (++bench->case_index < bench->num_cases) {
+        spdk_thread_send_msg(bench->thread, run_batch, bench);
+        return;
+    }
+    spdk_thread_send_msg(bench->thread, cases_done, bench);
+}
+
+static void op_done(void* arg, IoStatus status) {
+    auto bench = static_cast<CostBench*>(arg);
+    if (!status) bench->errors++;
+    if (--bench->outstanding > 0 || bench->submitting) return;
+    batch_done(bench, bench->Take());
+}
+
+static void run_batch(void* arg) {
+    auto bench = static_cast<CostBench*>(arg);
+    const CostCase& c = bench->cases[bench->case_index];
+    bench->batch++;
+    bench->outstanding = g_batch;
+    bench->submitting = true;
+
+    CostSnapshot start = bench->Take();
+    for (uint32_t i = 0; i < g_batch; i++) {
+        c.submit(bench, bench->next_op++, bench->buf + i * kPageSize);
+    }
+    bench->submitted = bench->Take();
+
+    bench->submitting = false;
+    if (bench->batch > g_warmup_batches) {
+        bench->current.submit.Add(start, bench->submitted, bench->read_overhead);
+    }
+    // Everything completed inline: the complete path was part of submit.
+    if (bench->outstanding == 0) batch_done(bench, bench->submitted);
+}
+
+static double per_op(uint64_t total, uint64_t ops) {
+    return ops ? static_cast<double>(total) / static_cast<double>(ops) : 0.0;
+}
+
+static const CostResult* find_result(CostBench* bench, const std::string& name) {
+    for (const CostResult& r : bench->results) {
+        if (r.name == name) return &r;
+    }
+    return nullptr;
+}
+
+static const CostTotals& path_of(const CostResult& r, const std::string& path) {
+    return path == "submit" ? r.submit : r.complete;
+}
+
+static void print_results(CostBench* bench) {
+    printf("%s, %u operations per batch, %" PRIu64 " batches per case%s\n", g_bdev_name.c_str(),
+           g_batch, g_batches, bench->perf.Enabled() ? "" : " (no perf counters)");
+    printf("%-10s %-8s %10s %10s %10s %10s %10s\n", "case", "path", "cycles", "instr",
+           "ns", "allocs", "+instr");
+    for (const CostResult& r : bench->results) {
+        const CostResult* ref = r.reference.empty() ? nullptr : find_result(bench, r.reference);
+        for (const char* path : {"submit", "complete"}) {
+            const CostTotals& t = path_of(r, path);
+            double instr = per_op(t.instructions, r.ops);
+            printf("%-10s %-8s %10.1f %10.1f %10.1f %10.3f", r.name.c_str(), path,
+                   per_op(t.cycles, r.ops), instr, per_op(t.ticks, r.ops) * bench->ns_per_tick,
+                   per_op(t.allocs, r.ops));
+            if (ref) {
+                const CostTotals& rt = path_of(*ref, path);
+                printf(" %10.1f", instr - per_op(rt.instructions, ref->ops));
+            }
+            printf("\n");
+        }
+    }
+    if (bench->errors) printf("failed operations: %" PRIu64 "\n", bench->errors);
+}
+
+// Keeps the leading comment block of an existing file. Without perf counters the
+// instruction column is written as "-".
+static bool write_baseline(CostBench* bench) {
+    std::string header;
+    {
+        std::ifstream in(g_update_path);
+        std::string line;
+        while (std::getline(in, line) && !line.empty() && line[0] == '#') {
+            header += line + '\n';
+        }
+    }
+    if (header.empty()) header = "# case path instructions/op allocations/op\n";
+    std::ofstream out(g_update_path, std::ios::trunc);
+    if (!out) {
+        SPDK_ERRLOG("Cannot write %s\n", g_update_path.c_str());
+        return false;
+    }
+    out << header;
+    for (const CostResult& r : bench->results) {
+        if (r.reference.empty()) continue;
+        for (const char* path : {"submit", "complete"}) {
+            const CostTotals& t = path_of(r, path);
+            out << r.name << ' ' << path << ' ';
+            if (bench->perf.Enabled()) {
+                out << per_op(t.instructions, r.ops);
+            } else {
+                out << '-';
+            }
+            out << ' ' << per_op(t.allocs, r.ops) << '\n';
+        }
+    }
+    return true;
+}
+
+// Returns false if any store case regressed against the baseline.
+static bool check_baseline(CostBench* bench) {
+    std::ifstream in(g_baseline_path);
+    if (!in) {
+        SPDK_ERRLOG("Cannot read %s\n", g_baseline_path.c_str());
+        return false;
+    }
+    bool ok = true;
+    size_t checked = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string name, path, instr_field;
+        double instructions = 0, allocs = 0;
+        // "-" in the instruction column means no reference number yet, which only
+        // passes when there are no perf counters to compare against either.
+        bool have_instructions = false;
+        if (fields >> name >> path >> instr_field >> allocs) {
+            if (instr_field != "-") {
+                std::istringstream number(instr_field);
+                have_instructions = static_cast<bool>(number >> instructions);
+                if (!have_instructions) fields.setstate(std::ios::failbit);
+            }
+        }
+        if (!fields) {
+            SPDK_ERRLOG("Malformed baseline line: %s\n", line.c_str());
+            ok = false;
+            continue;
+        }
+        const CostResult* r = find_result(bench, name);
+        if (!r || (path != "submit" && path != "complete")) {
+            printf("baseline %s %s: not measured\n", name.c_str(), path.c_str());
+            continue;
+        }
+        const CostTotals& t = path_of(*r, path);
+        checked++;
+        double measured_allocs = per_op(t.allocs, r->ops);
+        if (measured_allocs > allocs + 0.001) {
+            printf("REGRESSION %s %s: %.3f allocations/op, baseline %.3f\n", name.c_str(),
+                   path.c_str(), measured_allocs, allocs);
+            ok = false;
+        }
+        if (!bench->perf.Enabled()) continue;
+        if (!have_instructions) {
+            printf("NO BASELINE %s %s: no instructions/op recorded, regenerate with -u\n",
+                   name.c_str(), path.c_str());
+            ok = false;
+            continue;
+        }
+        double measured = per_op(t.instructions, r->ops);
+        if (measured > instructions * (1 + g_tolerance_percent / 100)) {
+            printf("REGRESSION %s %s: %.1f instructions/op, baseline %.1f (+%.1f%%)\n",
+                   name.c_str(), path.c_str(), measured, instructions,
+                   instructions ? (measured / instructions - 1) * 100 : INFINITY);
+            ok = false;
+        }
+    }
+    if (!bench->perf.Enabled()) {
+        printf("perf counters unavailable: only allocations were checked\n");
+    }
+    printf("baseline %s: %zu entries checked, %s\n", g_baseline_path.c_str(), checked,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void finish(CostBench* bench) {
+    print_results(bench);
+    if (bench->errors) bench->rc = 1;
+    if (!g_update_path.empty() && !write_baseline(bench)) bench->rc = 1;
+    if (!g_baseline_path.empty() && !check_baseline(bench)) bench->rc = 1;
+    bench->store->Close([bench](bool) { spdk_app_stop(bench->rc); });
+}
+
+static void open_store(CostBench* bench) {
+    SpdkPageStoreOptions opts;
+    opts.read_verify = g_verify ? SpdkPageStoreOptions::ReadVerify::kAlways
+                                : SpdkPageStoreOptions::ReadVerify::kOff;
+    bench->store = std::make_unique<SpdkPageStore>(opts);
+    bench->store->Init(g_bdev_name, [bench](bool ready) {
+        if (!ready) {
+            SPDK_ERRLOG("Failed to open PageStore on %s\n", g_bdev_name.c_str());
+            bench->store->Close([](bool) { spdk_app_stop(-1); });
+            return;
+        }
+        // Raw pageIds are slots too: keep them to the lower half so that the
+        // keyed cases find free slots instead of measuring eviction.
+        bench->pages = bench->store->NumPages() / 2;
+        bench->keys = std::min(bench->pages / 2, kMaxKeys);
+        if (bench->keys == 0) {
+            SPDK_ERRLOG("PageStore on %s is too small\n", g_bdev_name.c_str());
+            bench->store->Close([](bool) { spdk_app_stop(-1); });
+            return;
+        }
+        run_cases(bench, kStoreCases, SPDK_COUNTOF(kStoreCases));
+    });
+}
+
+static void bdev_event_cb(enum spdk_bdev_event_type, struct spdk_bdev*, void*) {}
+
+static void cost_bench_start(void* arg) {
+    auto bench = static_cast<CostBench*>(arg);
+    bench->thread = spdk_get_thread();
+    bench->ns_per_tick = 1e9 / static_cast<double>(spdk_get_ticks_hz());
+
+    if (!bench->perf.Open()) {
+        SPDK_WARNLOG("perf_event_open failed (%s); reporting time and allocations only\n",
+                     strerror(errno));
+    }
+    // Cost of taking a snapshot, subtracted from every measured interval.
+    bench->read_overhead.cycles = bench->read_overhead.instructions = UINT64_MAX;
+    for (int i = 0; i < 16; i++) {
+        CostSnapshot a = bench->Take();
+        CostSnapshot b = bench->Take();
+        bench->read_overhead.cycles = std::min(bench->read_overhead.cycles, b.cycles - a.cycles);
+        bench->read_overhead.instructions =
+            std::min(bench->read_overhead.instructions, b.instructions - a.instructions);
+    }
+
+    bench->buf = static_cast<char*>(spdk_dma_zmalloc(g_batch * kPageSize, kPageSize, nullptr));
+    if (!bench->buf) {
+        SPDK_ERRLOG("Failed to allocate buffers\n");
+        spdk_app_stop(-1);
+        return;
+    }
+    memset(bench->buf, 0x5a, g_batch * kPageSize);
+
+    if (spdk_bdev_open_ext(g_bdev_name.c_str(), true, bdev_event_cb, nullptr, &bench->desc) != 0) {
+        SPDK_ERRLOG("Could not open bdev %s\n", g_bdev_name.c_str());
+        spdk_app_stop(-1);
+        return;
+    }
+    bench->bdev_ch = spdk_bdev_get_io_channel(bench->desc);
+    if (!bench->bdev_ch) {
+        SPDK_ERRLOG("Could not get an I/O channel for %s\n", g_bdev_name.c_str());
+        spdk_bdev_close(bench->desc);
+        spdk_app_stop(-1);
+        return;
+    }
+    struct spdk_bdev* bdev = spdk_bdev_desc_get_bdev(bench->desc);
+    bench->pages = std::min<uint64_t>(
+        spdk_bdev_get_num_blocks(bdev) * spdk_bdev_get_block_size(bdev) / kPageSize,
+        kMaxKeys);
+    if (bench->pages == 0) {
+        SPDK_ERRLOG("bdev %s is smaller than a page\n", g_bdev_name.c_str());
+        spdk_put_io_channel(bench->bdev_ch);
+        spdk_bdev_close(bench->desc);
+        spdk_app_stop(-1);
+        return;
+    }
+    run_cases(bench, kBdevCases, SPDK_COUNTOF(kBdevCases));
+}
+
+int main(int argc, char **argv) {
+    struct spdk_app_opts opts = {};
+    int rc = 0;
+
+    spdk_app_opts_init(&opts, sizeof(opts));
+    opts.name = "pagestore_cost_bench";
+    opts.rpc_addr = nullptr;
+
+    if ((rc = spdk_app_parse_args(argc, argv, &opts, "b:k:N:q:u:Vw:x:", nullptr,
+                                  cost_bench_parse_arg, cost_bench_usage)) !=
+        SPDK_APP_PARSE_ARGS_SUCCESS) {
+        exit(rc);
+    }
+
+    auto bench = std::make_unique<CostBench>();
+    rc = spdk_app_start(&opts, cost_bench_start, bench.get());
+    if (rc) {
+        SPDK_ERRLOG("ERROR starting application\n");
+    } else {
+        rc = bench->rc;
+    }
+
+    bench.reset();
+    spdk_app_fini();
+    return rc;
+}
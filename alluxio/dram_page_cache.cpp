@@ -0,0 +1,278 @@
+// dram_page_cache.cpp
+#include "dram_page_cache.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr uint64_t kSketchSeeds[4] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+};
+
+} // namespace
+
+FrequencySketch::FrequencySketch(size_t capacity)
+    : table_(std::bit_ceil(std::max<size_t>(capacity, 16))),
+      sample_size_(10 * std::max<size_t>(capacity, 16)) {}
+
+size_t FrequencySketch::Index(uint64_t hash, int i, size_t mask) {
+    uint64_t h = (hash + kSketchSeeds[i]) * kSketchSeeds[i];
+    h += h >> 32;
+    return h & mask;
+}
+
+int FrequencySketch::Shift(uint64_t hash, int i) {
+    // Counter (hash-chosen quarter) * 4 + i of the word, so the four
+    // counters of one key never share a nibble.
+    return static_cast<int>((((hash >> (8 * i)) & 3) * 4 + i) * 4);
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+    size_t mask = table_.size() - 1;
+    bool added = false;
+    for (int i = 0; i < 4; i++) {
+        uint64_t& word = table_[Index(hash, i, mask)];
+        int shift = Shift(hash, i);
+        if (((word >> shift) & 0xf) < 15) {
+            word += uint64_t{1} << shift;
+            added = true;
+        }
+    }
+    if (added && ++additions_ >= sample_size_) Age();
+}
+
+uint32_t FrequencySketch::Frequency(uint64_t hash) const {
+    size_t mask = table_.size() - 1;
+    uint32_t freq = 15;
+    for (int i = 0; i < 4; i++) {
+        uint64_t word = table_[Index(hash, i, mask)];
+        freq = std::min(freq, static_cast<uint32_t>((word >> Shift(hash, i)) & 0xf));
+    }
+    return freq;
+}
+
+void FrequencySketch::Age() {
+    for (uint64_t& word : table_) word = (word >> 1) & 0x7777777777777777ULL;
+    additions_ /= 2;
+}
+
+DramPageCache::DramPageCache(PageStore* backing, const DramPageCacheOptions& opts)
+    : backing_(backing), opts_(opts) {
+    size_t shards = std::bit_ceil(std::max<size_t>(1, opts_.shards));
+    size_t perShard = std::max<size_t>(1, (opts_.capacity_pages + shards - 1) / shards);
+    shard_mask_ = shards - 1;
+    for (size_t i = 0; i < shards; i++) {
+        auto shard = std::make_unique<Shard>(perShard);
+        shard->frame_count = perShard;
+        shards_.push_back(std::move(shard));
+    }
+}
+
+DramPageCache::~DramPageCache() {
+    for (auto& shard : shards_) {
+        while (shard->free_ctx) {
+            IoCtx* ctx = shard->free_ctx;
+            shard->free_ctx = ctx->next_free;
+            delete ctx;
+        }
+    }
+    if (slab_) spdk_free(slab_);
+}
+
+bool DramPageCache::AllocateFrames() {
+    if (slab_) return true;
+    size_t perShard = shards_[0]->frame_count;
+    slab_ = static_cast<char*>(spdk_malloc(perShard * shards_.size() * kPageSize, kPageSize,
+                                           nullptr, SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA));
+    if (!slab_) {
+        std::cerr << "SPDK: Failed to allocate " << perShard * shards_.size()
+                  << " DRAM cache frames" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < shards_.size(); i++) {
+        Shard& s = *shards_[i];
+        s.frames = slab_ + i * perShard * kPageSize;
+        s.index.Reserve(perShard);
+        s.frame_page.assign(perShard, 0);
+        s.referenced.assign(perShard, false);
+        s.free_frames.resize(perShard);
+        for (size_t f = 0; f < perShard; f++) {
+            s.free_frames[f] = static_cast<uint32_t>(perShard - 1 - f);
+        }
+    }
+    return true;
+}
+
+bool DramPageCache::Init(const std::string& bdevName) {
+    return AllocateFrames() && backing_->Init(bdevName);
+}
+
+DramPageCache::IoCtx* DramPageCache::AllocCtx(Shard& s) {
+    IoCtx* ctx = s.free_ctx;
+    if (ctx) {
+        s.free_ctx = ctx->next_free;
+    } else {
+        ctx = new IoCtx();
+    }
+    ctx->cache = this;
+    ctx->shard = &s;
+    ctx->next_free = nullptr;
+    return ctx;
+}
+
+void DramPageCache::FreeCtx(Shard& s, IoCtx* ctx) {
+    ctx->cb.Reset();
+    ctx->next_free = s.free_ctx;
+    s.free_ctx = ctx;
+}
+
+void DramPageCache::InvalidateLocked(Shard& s, uint64_t pageId) {
+    s.epoch++;
+    uint64_t frame = s.index.Find(PageKey{pageId, 0});
+    if (frame == PageIndex::kNotFound) return;
+    s.index.Erase(PageKey{pageId, 0});
+    s.free_frames.push_back(static_cast<uint32_t>(frame));
+}
+
+uint32_t DramPageCache::ClockVictimLocked(Shard& s) {
+    // Every frame is in use when this runs; give referenced frames a second
+    // chance. The hand stays on the candidate so a rejected admission faces
+    // the same victim next time.
+    for (;;) {
+        if (!s.referenced[s.hand]) return static_cast<uint32_t>(s.hand);
+        s.referenced[s.hand] = false;
+        s.hand = (s.hand + 1) % s.frame_count;
+    }
+}
+
+void DramPageCache::AdmitLocked(Shard& s, uint64_t pageId, uint64_t hash, const void* data) {
+    if (!s.frames || s.index.Find(PageKey{pageId, 0}) != PageIndex::kNotFound) return;
+    uint32_t frame;
+    if (!s.free_frames.empty()) {
+        frame = s.free_frames.back();
+        s.free_frames.pop_back();
+    } else {
+        frame = ClockVictimLocked(s);
+        uint64_t victim = s.frame_page[frame];
+        // TinyLFU: only replace a page that has been seen less often.
+        if (s.sketch.Frequency(hash) <= s.sketch.Frequency(HashOf(victim))) {
+            s.stats.rejects++;
+            return;
+        }
+        s.index.Erase(PageKey{victim, 0});
+        s.hand = (s.hand + 1) % s.frame_count;
+        s.stats.evictions++;
+    }
+    memcpy(s.frames + frame * kPageSize, data, kPageSize);
+    s.frame_page[frame] = pageId;
+    s.referenced[frame] = false;
+    s.index.Insert(PageKey{pageId, 0}, frame);
+    s.stats.admits++;
+}
+
+void DramPageCache::ReadPage(uint64_t pageId, void* buffer, IoCallback cb) {
+    uint64_t hash = HashOf(pageId);
+    Shard& s = ShardOf(hash);
+    IoCtx* ctx = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.sketch.Increment(hash);
+        uint64_t frame = s.index.Find(PageKey{pageId, 0});
+        if (frame != PageIndex::kNotFound) {
+            s.referenced[frame] = true;
+            memcpy(buffer, s.frames + frame * kPageSize, kPageSize);
+            s.stats.hits++;
+        } else {
+            s.stats.misses++;
+            ctx = AllocCtx(s);
+            ctx->pageId = pageId;
+            ctx->buf = buffer;
+            ctx->epoch = s.epoch;
+        }
+    }
+    if (!ctx) {
+        cb(IoStatus::kOk);
+        return;
+    }
+    ctx->cb = std::move(cb);
+    backing_->ReadPage(pageId, buffer, IoCallback(OnReadDone, ctx));
+}
+
+void DramPageCache::OnReadDone(void* arg, IoStatus status) {
+    auto* ctx = static_cast<IoCtx*>(arg);
+    Shard& s = *ctx->shard;
+    IoCallback cb = std::move(ctx->cb);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        // A write that started after this read may already have changed the
+        // page; only cache data no write could have raced with.
+        if (status && ctx->epoch == s.epoch) {
+            AdmitLocked(s, ctx->pageId, HashOf(ctx->pageId), ctx->buf);
+        }
+        FreeCtx(s, ctx);
+    }
+    cb(status);
+}
+
+void DramPageCache::WritePage(uint64_t pageId, const void* data, IoCallback cb) {
+    Shard& s = ShardOf(HashOf(pageId));
+    IoCtx* ctx;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        InvalidateLocked(s, pageId);
+        ctx = AllocCtx(s);
+        ctx->pageId = pageId;
+    }
+    ctx->cb = std::move(cb);
+    backing_->WritePage(pageId, data, IoCallback(OnWriteDone, ctx));
+}
+
+void DramPageCache::OnWriteDone(void* arg, IoStatus status) {
+    auto* ctx = static_cast<IoCtx*>(arg);
+    Shard& s = *ctx->shard;
+    IoCallback cb = std::move(ctx->cb);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        // A read that overlapped the write may have cached either version.
+        InvalidateLocked(s, ctx->pageId);
+        FreeCtx(s, ctx);
+    }
+    cb(status);
+}
+
+void DramPageCache::WritePages(std::span<const PageWrite> pages, IoCallback cb) {
+    std::vector<uint64_t> ids;
+    ids.reserve(pages.size());
+    for (const PageWrite& page : pages) {
+        Shard& s = ShardOf(HashOf(page.pageId));
+        std::lock_guard<std::mutex> lock(s.mutex);
+        InvalidateLocked(s, page.pageId);
+        ids.push_back(page.pageId);
+    }
+    backing_->WritePages(pages, [this, ids = std::move(ids), cb = std::move(cb)](IoStatus status) {
+        for (uint64_t pageId : ids) {
+            Shard& s = ShardOf(HashOf(pageId));
+            std::lock_guard<std::mutex> lock(s.mutex);
+            InvalidateLocked(s, pageId);
+        }
+        cb(status);
+    });
+}
+
+void DramPageCache::Flush(IoCallback cb) {
+    backing_->Flush(std::move(cb));
+}
+
+DramPageCacheStats DramPageCache::GetStats() const {
+    DramPageCacheStats total;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.hits += shard->stats.hits;
+        total.misses += shard->stats.misses;
+        total.admits += shard->stats.admits;
+        total.rejects += shard->stats.rejects;
+        total.evictions += shard->stats.evictions;
+    }
+    return total;
+}
@@ -0,0 +1,120 @@
+// dram_page_cache.h
+// Optional in-memory read tier in front of any PageStore (normally an
+// SpdkPageStore). Hits are copied out of hugepage-backed frames without any
+// bdev I/O; misses go to the backing store and are admitted through a TinyLFU
+// frequency sketch, so one-off scans cannot displace the hot set.
+
+#pragma once
+
+#include "spdk_pagestore_interface.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Count-min sketch of 4-bit counters, 16 per 64-bit word, with four counters
+// per key. Every sample_size increments all counters are halved, so
+// popularity ages out.
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t capacity);
+
+    void Increment(uint64_t hash);
+    uint32_t Frequency(uint64_t hash) const;
+
+private:
+    static size_t Index(uint64_t hash, int i, size_t mask);
+    static int Shift(uint64_t hash, int i);
+    void Age();
+
+    std::vector<uint64_t> table_;
+    uint64_t sample_size_;
+    uint64_t additions_ = 0;
+};
+
+struct DramPageCacheOptions {
+    // Pages held in DRAM, split evenly across the shards.
+    size_t capacity_pages = 16384;
+    // Independently locked partitions; rounded up to a power of two.
+    size_t shards = 16;
+};
+
+struct DramPageCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t admits = 0;    // misses copied into the cache
+    uint64_t rejects = 0;   // misses TinyLFU judged colder than the victim
+    uint64_t evictions = 0;
+};
+
+class DramPageCache : public PageStore {
+public:
+    // backing must outlive the cache.
+    DramPageCache(PageStore* backing, const DramPageCacheOptions& opts = {});
+    ~DramPageCache() override;
+
+    // Allocates the frames, then initializes the backing store.
+    bool Init(const std::string& bdevName) override;
+    // Allocates the frames only, for a backing store initialized separately
+    // (e.g. through SpdkPageStore's asynchronous Init).
+    bool AllocateFrames();
+
+    // Writes go through to the backing store; the cached copy is dropped
+    // both before the write is issued and after it completes.
+    void WritePage(uint64_t pageId, const void* data, IoCallback cb) override;
+    void ReadPage(uint64_t pageId, void* buffer, IoCallback cb) override;
+    void Flush(IoCallback cb) override;
+    // Keeps the backing store's coalescing; reads use the per-page default so
+    // every page can hit.
+    void WritePages(std::span<const PageWrite> pages, IoCallback cb) override;
+
+    DramPageCacheStats GetStats() const;
+
+private:
+    struct Shard;
+
+    // Context of one miss or write in flight, recycled per shard.
+    struct IoCtx {
+        DramPageCache* cache;
+        Shard* shard;
+        uint64_t pageId;
+        void* buf;
+        uint64_t epoch;
+        IoCallback cb;
+        IoCtx* next_free;
+    };
+
+    struct Shard {
+        explicit Shard(size_t frames) : sketch(frames) {}
+
+        std::mutex mutex;
+        char* frames = nullptr;
+        size_t frame_count = 0;
+        PageIndex index;                   // {pageId, 0} -> frame
+        std::vector<uint64_t> frame_page;  // frame -> pageId
+        std::vector<bool> referenced;      // CLOCK bits
+        std::vector<uint32_t> free_frames;
+        size_t hand = 0;
+        // Bumped by every write so a miss that raced with one is not cached.
+        uint64_t epoch = 0;
+        FrequencySketch sketch;
+        IoCtx* free_ctx = nullptr;
+        DramPageCacheStats stats;
+    };
+
+    static uint64_t HashOf(uint64_t pageId) { return PageIndex::Hash(PageKey{pageId, 0}); }
+    Shard& ShardOf(uint64_t hash) { return *shards_[(hash >> 32) & shard_mask_]; }
+    IoCtx* AllocCtx(Shard& s);
+    static void FreeCtx(Shard& s, IoCtx* ctx);
+    static void InvalidateLocked(Shard& s, uint64_t pageId);
+    static uint32_t ClockVictimLocked(Shard& s);
+    static void AdmitLocked(Shard& s, uint64_t pageId, uint64_t hash, const void* data);
+
+    static void OnReadDone(void* arg, IoStatus status);
+    static void OnWriteDone(void* arg, IoStatus status);
+
+    PageStore* backing_;
+    DramPageCacheOptions opts_;
+    char* slab_ = nullptr;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_mask_ = 0;
+};
@@ -0,0 +1,165 @@
+// io_callback.h
+// Allocation-free completion callbacks for the PageStore hot path.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Sig>
+class InplaceCallback;
+
+// Move-only replacement for std::function. Callables of up to kInlineSize
+// bytes (every lambda on the store's own paths) live in the object itself, and
+// a raw function-pointer-plus-context pair never allocates. Larger callables
+// still work but fall back to the heap.
+template <typename R, typename... Args>
+class InplaceCallback<R(Args...)> {
+public:
+    static constexpr size_t kInlineSize = 48;
+    using RawFn = R (*)(void* ctx, Args... args);
+
+    InplaceCallback() = default;
+    InplaceCallback(std::nullptr_t) {}
+
+    InplaceCallback(RawFn fn, void* ctx) {
+        Emplace([fn, ctx](Args... args) -> R { return fn(ctx, std::forward<Args>(args)...); });
+    }
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceCallback> &&
+                                          std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+    InplaceCallback(F&& f) {
+        Emplace(std::forward<F>(f));
+    }
+
+    InplaceCallback(InplaceCallback&& o) noexcept { MoveFrom(o); }
+    InplaceCallback& operator=(InplaceCallback&& o) noexcept {
+        if (this != &o) {
+            Reset();
+            MoveFrom(o);
+        }
+        return *this;
+    }
+    InplaceCallback(const InplaceCallback&) = delete;
+    InplaceCallback& operator=(const InplaceCallback&) = delete;
+
+    ~InplaceCallback() { Reset(); }
+
+    R operator()(Args... args) const {
+        return ops_->invoke(&storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void Reset() {
+        if (ops_) ops_->destroy(&storage_);
+        ops_ = nullptr;
+    }
+
+    // True if a callable of type F is stored without a heap allocation.
+    template <typename F>
+    static constexpr bool kFitsInline = sizeof(F) <= kInlineSize &&
+                                        alignof(F) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+private:
+    struct Ops {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static constexpr Ops kInlineOps = {
+        [](void* s, Args&&... args) -> R {
+            return (*static_cast<F*>(s))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) {
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        },
+        [](void* s) { static_cast<F*>(s)->~F(); },
+    };
+
+    template <typename F>
+    static constexpr Ops kHeapOps = {
+        [](void* s, Args&&... args) -> R {
+            return (**static_cast<F**>(s))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+        [](void* s) { delete *static_cast<F**>(s); },
+    };
+
+    template <typename F>
+    void Emplace(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (kFitsInline<Fn>) {
+            new (&storage_) Fn(std::forward<F>(f));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+
+    void MoveFrom(InplaceCallback& o) {
+        if (!o.ops_) return;
+        o.ops_->move(&storage_, &o.storage_);
+        ops_ = o.ops_;
+        o.ops_ = nullptr;
+    }
+
+    alignas(std::max_align_t) mutable unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+// Outcome of a PageStore operation. Converts to and from bool, so callbacks
+// that only care about success can keep taking a bool; compare code() to tell
+// failures apart.
+class IoStatus {
+public:
+    enum Code : uint8_t {
+        kOk,
+        kIoError,          // submission or device error
+        kChecksumMismatch, // data read back does not match its stored CRC32C
+        kNotFound,         // no page is stored under the key
+        kNoSpace,          // no free slot for a new page
+    };
+
+    constexpr IoStatus() = default;
+    constexpr IoStatus(Code code) : code_(code) {}
+    constexpr IoStatus(bool ok) : code_(ok ? kOk : kIoError) {}
+
+    constexpr Code code() const { return code_; }
+    constexpr operator bool() const { return code_ == kOk; }
+
+private:
+    Code code_ = kOk;
+};
+
+// Completion of a PageStore operation.
+using IoCallback = InplaceCallback<void(IoStatus)>;
+
+// Joins n completions into one callback, which reports kOk only if all of
+// them succeeded (else the first failure seen). Done may be called from any
+// thread; cb runs on whichever call is last.
+struct IoJoin {
+    IoJoin(size_t n, IoCallback done) : pending(n), cb(std::move(done)) {}
+
+    void Done(IoStatus status) {
+        uint8_t ok = IoStatus::kOk;
+        if (!status) code.compare_exchange_strong(ok, status.code(), std::memory_order_relaxed);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cb(static_cast<IoStatus::Code>(code.load(std::memory_order_relaxed)));
+        }
+    }
+
+    std::atomic<size_t> pending;
+    std::atomic<uint8_t> code{IoStatus::kOk};
+    IoCallback cb;
+};
@@ -0,0 +1,87 @@
+// page_buffer_pool.cpp
+#include "page_buffer_pool.h"
+
+#include <iostream>
+
+PageBufferPool::PageBufferPool(size_t bufSize, size_t count, bool fallback)
+    : buf_size_(bufSize), count_(count), fallback_(fallback) {}
+
+PageBufferPool::~PageBufferPool() {
+    if (slab_) spdk_free(slab_);
+}
+
+bool PageBufferPool::Init() {
+    owner_ = spdk_get_thread();
+    if (count_ == 0) return true;
+
+    int socket = SPDK_ENV_SOCKET_ID_ANY;
+    uint32_t core = spdk_env_get_current_core();
+    if (core != SPDK_ENV_LCORE_ID_ANY) socket = spdk_env_get_socket_id(core);
+
+    slab_ = static_cast<char*>(spdk_malloc(buf_size_ * count_, buf_size_, nullptr,
+                                           socket, SPDK_MALLOC_DMA));
+    if (!slab_) {
+        std::cerr << "SPDK: Failed to allocate page buffer slab of " << count_
+                  << " buffers" << std::endl;
+        return false;
+    }
+    for (size_t i = count_; i-- > 0;) {
+        auto* node = reinterpret_cast<FreeNode*>(slab_ + i * buf_size_);
+        node->next = local_free_;
+        local_free_ = node;
+    }
+    return true;
+}
+
+void* PageBufferPool::Get() {
+    if (!local_free_) {
+        local_free_ = remote_free_.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (local_free_) {
+        FreeNode* node = local_free_;
+        local_free_ = node->next;
+        Bump(hits_);
+        return node;
+    }
+
+    Bump(misses_);
+    if (!fallback_) return nullptr;
+    void* buf = spdk_malloc(buf_size_, buf_size_, nullptr,
+                            SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA);
+    if (buf) Bump(fallbacks_);
+    return buf;
+}
+
+void PageBufferPool::Put(void* buf) {
+    if (!Owns(buf)) {
+        spdk_free(buf);
+        return;
+    }
+    auto* node = static_cast<FreeNode*>(buf);
+    if (spdk_get_thread() == owner_) {
+        node->next = local_free_;
+        local_free_ = node;
+        Bump(local_returns_);
+        return;
+    }
+    // Single consumer takes the whole list with exchange(), so a plain CAS
+    // push cannot suffer ABA.
+    FreeNode* head = remote_free_.load(std::memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!remote_free_.compare_exchange_weak(head, node, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+    remote_returns_.fetch_add(1, std::memory_order_relaxed);
+}
+
+PageBufferPoolStats PageBufferPool::GetStats() const {
+    PageBufferPoolStats stats;
+    stats.capacity = count_;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.fallbacks = fallbacks_.load(std::memory_order_relaxed);
+    uint64_t returned = local_returns_.load(std::memory_order_relaxed) +
+                        remote_returns_.load(std::memory_order_relaxed);
+    stats.in_use = stats.hits > returned ? stats.hits - returned : 0;
+    return stats;
+}
@@ -0,0 +1,138 @@
+// page_buffer_pool.h
+// Per-thread slab of pinned DMA page buffers for SpdkPageStore.
+
+#pragma once
+
+#include <spdk/env.h>
+#include <spdk/thread.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct PageBufferPoolStats {
+    uint64_t capacity = 0;  // buffers carved out of the slab
+    uint64_t in_use = 0;    // slab buffers currently handed out
+    uint64_t hits = 0;      // Get() served from the slab
+    uint64_t misses = 0;    // Get() found the slab empty
+    uint64_t fallbacks = 0; // misses served by a one-off spdk_zmalloc
+
+    PageBufferPoolStats& operator+=(const PageBufferPoolStats& o) {
+        capacity += o.capacity;
+        in_use += o.in_use;
+        hits += o.hits;
+        misses += o.misses;
+        fallbacks += o.fallbacks;
+        return *this;
+    }
+};
+
+// Fixed slab of pinned, bufSize-aligned DMA buffers carved out of one
+// spdk_malloc on the owner thread's NUMA socket. Get() and Put() on the owner
+// thread only touch a plain intrusive free list. Put() from any other thread
+// pushes onto a lock-free stack which the owner adopts wholesale the next time
+// its local list runs dry, so there is never a lock or CAS on the owner path.
+class PageBufferPool {
+public:
+    PageBufferPool(size_t bufSize, size_t count, bool fallback);
+    ~PageBufferPool();
+
+    PageBufferPool(const PageBufferPool&) = delete;
+    PageBufferPool& operator=(const PageBufferPool&) = delete;
+
+    // Must run on the owner thread.
+    bool Init();
+
+    // Owner thread only. Returns nullptr when the slab is exhausted and
+    // fallback allocation is disabled.
+    void* Get();
+
+    // Any thread. Slab buffers go back on a free list, fallback buffers are
+    // released with spdk_free.
+    void Put(void* buf);
+
+    bool Owns(const void* buf) const {
+        auto p = static_cast<const char*>(buf);
+        return p >= slab_ && p < slab_ + buf_size_ * count_;
+    }
+    bool Empty() const {
+        return !local_free_ && !remote_free_.load(std::memory_order_relaxed);
+    }
+    size_t BufSize() const { return buf_size_; }
+    PageBufferPoolStats GetStats() const;
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    // Owner-only counter bump; readers may observe it from any thread.
+    static void Bump(std::atomic<uint64_t>& c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    const size_t buf_size_;
+    const size_t count_;
+    const bool fallback_;
+    char* slab_ = nullptr;
+    struct spdk_thread* owner_ = nullptr;
+
+    FreeNode* local_free_ = nullptr;
+    alignas(64) std::atomic<FreeNode*> remote_free_{nullptr};
+
+    alignas(64) std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> fallbacks_{0};
+    std::atomic<uint64_t> local_returns_{0};
+    alignas(64) std::atomic<uint64_t> remote_returns_{0};
+};
+
+// Move-only handle on one pooled DMA page. Dropping the lease returns the page
+// to the pool it came from, from whichever thread that happens on. A lease must
+// not outlive the store (and therefore the pool) that handed it out.
+class PageLease {
+public:
+    PageLease() = default;
+    PageLease(PageBufferPool* pool, void* buf) : pool_(pool), buf_(buf) {}
+    ~PageLease() { Release(); }
+
+    PageLease(PageLease&& o) noexcept : pool_(o.pool_), buf_(o.buf_) {
+        o.pool_ = nullptr;
+        o.buf_ = nullptr;
+    }
+    PageLease& operator=(PageLease&& o) noexcept {
+        if (this != &o) {
+            Release();
+            pool_ = o.pool_;
+            buf_ = o.buf_;
+            o.pool_ = nullptr;
+            o.buf_ = nullptr;
+        }
+        return *this;
+    }
+    PageLease(const PageLease&) = delete;
+    PageLease& operator=(const PageLease&) = delete;
+
+    void* data() const { return buf_; }
+    size_t size() const { return pool_ ? pool_->BufSize() : 0; }
+    PageBufferPool* pool() const { return pool_; }
+    explicit operator bool() const { return buf_ != nullptr; }
+
+    void Release() {
+        if (buf_) pool_->Put(buf_);
+        pool_ = nullptr;
+        buf_ = nullptr;
+    }
+
+    // Give up ownership without returning the page; the caller becomes
+    // responsible for handing buf back to pool.
+    void* Detach() {
+        void* buf = buf_;
+        pool_ = nullptr;
+        buf_ = nullptr;
+        return buf;
+    }
+
+private:
+    PageBufferPool* pool_ = nullptr;
+    void* buf_ = nullptr;
+};
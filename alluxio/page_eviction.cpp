@@ -0,0 +1,236 @@
+// page_eviction.cpp
+#include "page_eviction.h"
+
+#include <algorithm>
+#include <bit>
+
+std::unique_ptr<EvictionPolicy> MakeEvictionPolicy(EvictionPolicyType type, uint64_t numSlots) {
+    switch (type) {
+    case EvictionPolicyType::kLru:
+        return std::make_unique<LruPolicy>(numSlots);
+    case EvictionPolicyType::kClock:
+        return std::make_unique<ClockPolicy>(numSlots);
+    case EvictionPolicyType::kS3Fifo:
+        return std::make_unique<S3FifoPolicy>(numSlots);
+    default:
+        return nullptr;
+    }
+}
+
+// ---------------------------------------------------------------- LRU
+
+LruPolicy::LruPolicy(uint64_t numSlots)
+    : head_(static_cast<uint32_t>(numSlots)),
+      prev_(numSlots + 1),
+      next_(numSlots + 1),
+      resident_(numSlots) {
+    prev_[head_] = head_;
+    next_[head_] = head_;
+}
+
+void LruPolicy::Unlink(uint32_t slot) {
+    next_[prev_[slot]] = next_[slot];
+    prev_[next_[slot]] = prev_[slot];
+}
+
+void LruPolicy::PushFront(uint32_t slot) {
+    prev_[slot] = head_;
+    next_[slot] = next_[head_];
+    prev_[next_[head_]] = slot;
+    next_[head_] = slot;
+}
+
+void LruPolicy::OnInsert(uint64_t slot, uint64_t) {
+    if (slot >= resident_.size()) return;
+    if (resident_[slot]) {
+        Unlink(static_cast<uint32_t>(slot));
+    } else {
+        resident_[slot] = true;
+        size_++;
+    }
+    PushFront(static_cast<uint32_t>(slot));
+}
+
+void LruPolicy::OnAccess(uint64_t slot) {
+    if (slot >= resident_.size() || !resident_[slot]) return;
+    Unlink(static_cast<uint32_t>(slot));
+    PushFront(static_cast<uint32_t>(slot));
+}
+
+void LruPolicy::OnRemove(uint64_t slot) {
+    if (slot >= resident_.size() || !resident_[slot]) return;
+    Unlink(static_cast<uint32_t>(slot));
+    resident_[slot] = false;
+    size_--;
+}
+
+uint64_t LruPolicy::Evict() {
+    uint32_t victim = prev_[head_];
+    if (victim == head_) return kNoVictim;
+    OnRemove(victim);
+    return victim;
+}
+
+// ---------------------------------------------------------------- CLOCK
+
+ClockPolicy::ClockPolicy(uint64_t numSlots) : resident_(numSlots), referenced_(numSlots) {}
+
+void ClockPolicy::OnInsert(uint64_t slot, uint64_t) {
+    if (slot >= resident_.size()) return;
+    if (!resident_[slot]) size_++;
+    resident_[slot] = true;
+    referenced_[slot] = false;
+}
+
+void ClockPolicy::OnAccess(uint64_t slot) {
+    if (slot < resident_.size() && resident_[slot]) referenced_[slot] = true;
+}
+
+void ClockPolicy::OnRemove(uint64_t slot) {
+    if (slot >= resident_.size() || !resident_[slot]) return;
+    resident_[slot] = false;
+    size_--;
+}
+
+uint64_t ClockPolicy::Evict() {
+    if (size_ == 0) return kNoVictim;
+    // Two sweeps clear every reference bit, so a victim is always found.
+    for (uint64_t n = 0; n < 2 * resident_.size(); n++) {
+        uint64_t slot = hand_;
+        hand_ = (hand_ + 1) % resident_.size();
+        if (!resident_[slot]) continue;
+        if (referenced_[slot]) {
+            referenced_[slot] = false;
+            continue;
+        }
+        OnRemove(slot);
+        return slot;
+    }
+    return kNoVictim;
+}
+
+// ---------------------------------------------------------------- S3-FIFO
+
+S3FifoPolicy::S3FifoPolicy(uint64_t numSlots)
+    : small_target_(std::max<uint64_t>(1, numSlots / 10)),
+      slots_(numSlots),
+      ghost_ring_(std::max<uint64_t>(1, numSlots - numSlots / 10)),
+      ghost_filter_(std::bit_ceil(2 * ghost_ring_.size())) {}
+
+bool S3FifoPolicy::Live(uint64_t entry, Queue queue) const {
+    const SlotState& s = slots_[entry & UINT32_MAX];
+    return s.queue == queue && s.epoch == static_cast<uint32_t>(entry >> 32);
+}
+
+void S3FifoPolicy::MaybeCompact(std::deque<uint64_t>& q, Queue queue, uint64_t live) {
+    if (q.size() <= 2 * live + kMinCompact) return;
+    // Each pass removes at least half the queue, so the cost is amortized
+    // over the removals that made the entries stale.
+    std::erase_if(q, [this, queue](uint64_t entry) { return !Live(entry, queue); });
+}
+
+void S3FifoPolicy::AddGhost(uint64_t keyHash) {
+    size_t mask = ghost_filter_.size() - 1;
+    uint64_t old = ghost_ring_[ghost_head_];
+    if (old && ghost_filter_[old & mask] == old) ghost_filter_[old & mask] = 0;
+    // 0 marks an empty ring or filter entry.
+    keyHash |= 1;
+    ghost_ring_[ghost_head_] = keyHash;
+    ghost_head_ = (ghost_head_ + 1) % ghost_ring_.size();
+    ghost_filter_[keyHash & mask] = keyHash;
+}
+
+bool S3FifoPolicy::TakeGhost(uint64_t keyHash) {
+    keyHash |= 1;
+    uint64_t& f = ghost_filter_[keyHash & (ghost_filter_.size() - 1)];
+    if (f != keyHash) return false;
+    f = 0;
+    return true;
+}
+
+void S3FifoPolicy::OnInsert(uint64_t slot, uint64_t keyHash) {
+    if (slot >= slots_.size()) return;
+    if (slots_[slot].queue != kOut) OnRemove(slot);
+    SlotState& s = slots_[slot];
+    s.freq = 0;
+    s.key_hash = keyHash;
+    if (TakeGhost(keyHash)) {
+        s.queue = kMain;
+        main_.push_back(Entry(slot, s.epoch));
+        main_size_++;
+        MaybeCompact(main_, kMain, main_size_);
+    } else {
+        s.queue = kSmall;
+        small_.push_back(Entry(slot, s.epoch));
+        small_size_++;
+        MaybeCompact(small_, kSmall, small_size_);
+    }
+}
+
+void S3FifoPolicy::OnAccess(uint64_t slot) {
+    if (slot >= slots_.size() || slots_[slot].queue == kOut) return;
+    SlotState& s = slots_[slot];
+    if (s.freq < 3) s.freq++;
+}
+
+void S3FifoPolicy::Retire(uint64_t slot) {
+    SlotState& s = slots_[slot];
+    if (s.queue == kSmall) small_size_--;
+    if (s.queue == kMain) main_size_--;
+    s.queue = kOut;
+    s.epoch++;
+}
+
+void S3FifoPolicy::OnRemove(uint64_t slot) {
+    if (slot >= slots_.size() || slots_[slot].queue == kOut) return;
+    Retire(slot);
+}
+
+uint64_t S3FifoPolicy::EvictSmall() {
+    while (!small_.empty()) {
+        uint64_t entry = small_.front();
+        small_.pop_front();
+        if (!Live(entry, kSmall)) continue;
+        uint64_t slot = entry & UINT32_MAX;
+        SlotState& s = slots_[slot];
+        if (s.freq > 1) {
+            // Re-referenced while on probation: promote.
+            s.queue = kMain;
+            s.freq = 0;
+            small_size_--;
+            main_size_++;
+            main_.push_back(entry);
+            continue;
+        }
+        AddGhost(s.key_hash);
+        Retire(slot);
+        return slot;
+    }
+    return kNoVictim;
+}
+
+uint64_t S3FifoPolicy::EvictMain() {
+    while (!main_.empty()) {
+        uint64_t entry = main_.front();
+        main_.pop_front();
+        if (!Live(entry, kMain)) continue;
+        uint64_t slot = entry & UINT32_MAX;
+        SlotState& s = slots_[slot];
+        if (s.freq > 0) {
+            s.freq--;
+            main_.push_back(entry);
+            continue;
+        }
+        Retire(slot);
+        return slot;
+    }
+    return kNoVictim;
+}
+
+uint64_t S3FifoPolicy::Evict() {
+    uint64_t victim = kNoVictim;
+    if (small_size_ >= small_target_ || main_size_ == 0) victim = EvictSmall();
+    if (victim == kNoVictim) victim = EvictMain();
+    if (victim == kNoVictim) victim = EvictSmall();
+    return victim;
+}
@@ -0,0 +1,129 @@
+// page_eviction.h
+// Replacement policies for keyed pages. A policy tracks resident device slots
+// and picks victims when the store runs low on free slots.
+//
+// Policies are not thread-safe; SpdkPageStore calls them under its metadata
+// lock and feeds read hits in batches from per-thread access buffers, so a
+// lookup never touches policy state directly.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+enum class EvictionPolicyType : uint8_t {
+    kNone,   // never evict; PutPage fails with kNoSpace when full
+    kLru,
+    kClock,
+    kS3Fifo,
+};
+
+class EvictionPolicy {
+public:
+    static constexpr uint64_t kNoVictim = UINT64_MAX;
+
+    virtual ~EvictionPolicy() = default;
+
+    // slot became resident; keyHash identifies the page across slots.
+    virtual void OnInsert(uint64_t slot, uint64_t keyHash) = 0;
+    // Hit on a resident slot. Untracked slots are ignored.
+    virtual void OnAccess(uint64_t slot) = 0;
+    // slot left the cache for a reason other than Evict().
+    virtual void OnRemove(uint64_t slot) = 0;
+    // Choose a victim and stop tracking it; kNoVictim if nothing is resident.
+    virtual uint64_t Evict() = 0;
+    virtual uint64_t Size() const = 0;
+};
+
+std::unique_ptr<EvictionPolicy> MakeEvictionPolicy(EvictionPolicyType type, uint64_t numSlots);
+
+// Doubly linked recency list threaded through per-slot arrays.
+class LruPolicy : public EvictionPolicy {
+public:
+    explicit LruPolicy(uint64_t numSlots);
+
+    void OnInsert(uint64_t slot, uint64_t keyHash) override;
+    void OnAccess(uint64_t slot) override;
+    void OnRemove(uint64_t slot) override;
+    uint64_t Evict() override;
+    uint64_t Size() const override { return size_; }
+
+private:
+    void Unlink(uint32_t slot);
+    void PushFront(uint32_t slot);
+
+    uint32_t head_;              // sentinel index == numSlots
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    std::vector<bool> resident_;
+    uint64_t size_ = 0;
+};
+
+// Second-chance CLOCK: one reference bit per slot and a sweeping hand.
+class ClockPolicy : public EvictionPolicy {
+public:
+    explicit ClockPolicy(uint64_t numSlots);
+
+    void OnInsert(uint64_t slot, uint64_t keyHash) override;
+    void OnAccess(uint64_t slot) override;
+    void OnRemove(uint64_t slot) override;
+    uint64_t Evict() override;
+    uint64_t Size() const override { return size_; }
+
+private:
+    std::vector<bool> resident_;
+    std::vector<bool> referenced_;
+    uint64_t hand_ = 0;
+    uint64_t size_ = 0;
+};
+
+// S3-FIFO (Yang et al., SOSP'23): a small probationary FIFO holding ~10% of
+// the pages, a main FIFO with 2-bit frequency counters, and a ghost FIFO of
+// recently evicted key hashes that admits returning pages straight to main.
+class S3FifoPolicy : public EvictionPolicy {
+public:
+    explicit S3FifoPolicy(uint64_t numSlots);
+
+    void OnInsert(uint64_t slot, uint64_t keyHash) override;
+    void OnAccess(uint64_t slot) override;
+    void OnRemove(uint64_t slot) override;
+    uint64_t Evict() override;
+    uint64_t Size() const override { return small_size_ + main_size_; }
+
+private:
+    enum Queue : uint8_t { kOut, kSmall, kMain };
+    // Stale queue entries tolerated beyond the live count before compacting.
+    static constexpr size_t kMinCompact = 64;
+
+    struct SlotState {
+        Queue queue = kOut;
+        uint8_t freq = 0;
+        uint32_t epoch = 0;  // bumped on removal; stale queue entries are skipped
+        uint64_t key_hash = 0;
+    };
+
+    static uint64_t Entry(uint64_t slot, uint32_t epoch) { return slot | uint64_t{epoch} << 32; }
+    bool Live(uint64_t entry, Queue queue) const;
+    // Drops stale entries once they outnumber the live ones, so removals
+    // that are never followed by Evict() cannot grow the queue without bound.
+    void MaybeCompact(std::deque<uint64_t>& q, Queue queue, uint64_t live);
+    uint64_t EvictSmall();
+    uint64_t EvictMain();
+    void Retire(uint64_t slot);
+    void AddGhost(uint64_t keyHash);
+    bool TakeGhost(uint64_t keyHash);
+
+    uint64_t small_target_;
+    std::vector<SlotState> slots_;
+    std::deque<uint64_t> small_;  // Entry(slot, epoch)
+    std::deque<uint64_t> main_;
+    uint64_t small_size_ = 0;
+    uint64_t main_size_ = 0;
+    // Ghost FIFO of key hashes with a direct-mapped membership filter; a
+    // filter collision only costs an early or missed promotion.
+    std::vector<uint64_t> ghost_ring_;
+    size_t ghost_head_ = 0;
+    std::vector<uint64_t> ghost_filter_;
+};
@@ -0,0 +1,201 @@
+// page_index.cpp
+#include "page_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr std::align_val_t kCtrlAlign{64};
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// At most 7/8 of the buckets (live or deleted) are used, so every probe
+// sequence reaches an empty bucket.
+size_t MaxLoad(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+} // namespace
+
+PageIndex::~PageIndex() {
+    if (ctrl_) ::operator delete[](ctrl_, kCtrlAlign);
+    delete[] entries_;
+}
+
+uint64_t PageIndex::Hash(const PageKey& key) {
+    return Mix(key.file_id ^ Mix(key.page_index + 0x9e3779b97f4a7c15ULL));
+}
+
+uint32_t PageIndex::MatchByte(const int8_t* group, int8_t tag) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+        if (group[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+uint32_t PageIndex::MatchEmpty(const int8_t* group) {
+    return MatchByte(group, kEmpty);
+}
+
+uint32_t PageIndex::MatchFree(const int8_t* group) {
+    // kEmpty and kDeleted are the only control bytes with the sign bit set.
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+        if (group[i] < 0) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+void PageIndex::Reserve(size_t n) {
+    size_t capacity = kGroupSize;
+    while (MaxLoad(capacity) < n) capacity *= 2;
+    if (capacity > capacity_) Rehash(capacity);
+}
+
+void PageIndex::Clear() {
+    if (!ctrl_) return;
+    memset(ctrl_, kEmpty, capacity_);
+    size_ = 0;
+    growth_left_ = MaxLoad(capacity_);
+}
+
+uint64_t PageIndex::Find(const PageKey& key) const {
+    if (!capacity_) return kNotFound;
+    uint64_t hash = Hash(key);
+    auto tag = static_cast<int8_t>(hash & 0x7f);
+    size_t mask = capacity_ / kGroupSize - 1;
+    size_t g = (hash >> 7) & mask;
+    // Triangular probing over groups visits each group once.
+    for (size_t step = 1; step <= mask + 1; step++) {
+        const int8_t* group = ctrl_ + g * kGroupSize;
+        for (uint32_t m = MatchByte(group, tag); m; m &= m - 1) {
+            const Entry& e = entries_[g * kGroupSize + __builtin_ctz(m)];
+            if (e.key == key) return e.slot;
+        }
+        if (MatchEmpty(group)) break;
+        g = (g + step) & mask;
+    }
+    return kNotFound;
+}
+
+size_t PageIndex::FindFree(uint64_t hash) const {
+    size_t mask = capacity_ / kGroupSize - 1;
+    size_t g = (hash >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        uint32_t m = MatchFree(ctrl_ + g * kGroupSize);
+        if (m) return g * kGroupSize + __builtin_ctz(m);
+        g = (g + step) & mask;
+    }
+}
+
+bool PageIndex::Insert(const PageKey& key, uint64_t slot) {
+    if (growth_left_ == 0) {
+        if (Find(key) != kNotFound) return false;
+        // Mostly tombstones: purge them in place, otherwise grow.
+        bool purge = capacity_ && size_ < MaxLoad(capacity_) / 2;
+        Rehash(purge ? capacity_ : std::max(capacity_ * 2, kGroupSize));
+    }
+    uint64_t hash = Hash(key);
+    auto tag = static_cast<int8_t>(hash & 0x7f);
+    size_t mask = capacity_ / kGroupSize - 1;
+    size_t g = (hash >> 7) & mask;
+    // One pass: look for the key and remember the first reusable bucket.
+    size_t target = capacity_;
+    for (size_t step = 1; step <= mask + 1; step++) {
+        const int8_t* group = ctrl_ + g * kGroupSize;
+        for (uint32_t m = MatchByte(group, tag); m; m &= m - 1) {
+            if (entries_[g * kGroupSize + __builtin_ctz(m)].key == key) return false;
+        }
+        uint32_t free = MatchFree(group);
+        if (free && target == capacity_) target = g * kGroupSize + __builtin_ctz(free);
+        if (MatchEmpty(group)) break;
+        g = (g + step) & mask;
+    }
+    if (ctrl_[target] == kEmpty) {
+        if (growth_left_ == 0) {
+            // Only tombstones were reusable on the way; make room and retry.
+            Rehash(capacity_ * 2);
+            return Insert(key, slot);
+        }
+        growth_left_--;
+    }
+    ctrl_[target] = tag;
+    entries_[target] = Entry{key, slot};
+    size_++;
+    return true;
+}
+
+bool PageIndex::Erase(const PageKey& key) {
+    if (!capacity_) return false;
+    uint64_t hash = Hash(key);
+    auto tag = static_cast<int8_t>(hash & 0x7f);
+    size_t mask = capacity_ / kGroupSize - 1;
+    size_t g = (hash >> 7) & mask;
+    for (size_t step = 1; step <= mask + 1; step++) {
+        int8_t* group = ctrl_ + g * kGroupSize;
+        for (uint32_t m = MatchByte(group, tag); m; m &= m - 1) {
+            size_t i = g * kGroupSize + __builtin_ctz(m);
+            if (!(entries_[i].key == key)) continue;
+            // A group that still has an empty bucket has never been full, so
+            // no probe sequence continues past it and the bucket can be
+            // reused outright instead of leaving a tombstone.
+            if (MatchEmpty(group)) {
+                ctrl_[i] = kEmpty;
+                growth_left_++;
+            } else {
+                ctrl_[i] = kDeleted;
+            }
+            size_--;
+            return true;
+        }
+        if (MatchEmpty(group)) break;
+        g = (g + step) & mask;
+    }
+    return false;
+}
+
+void PageIndex::Rehash(size_t capacity) {
+    int8_t* oldCtrl = ctrl_;
+    Entry* oldEntries = entries_;
+    size_t oldCapacity = capacity_;
+
+    ctrl_ = static_cast<int8_t*>(::operator new[](capacity, kCtrlAlign));
+    entries_ = new Entry[capacity];
+    memset(ctrl_, kEmpty, capacity);
+    capacity_ = capacity;
+    growth_left_ = MaxLoad(capacity) - size_;
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldCtrl[i] < 0) continue;
+        uint64_t hash = Hash(oldEntries[i].key);
+        size_t j = FindFree(hash);
+        ctrl_[j] = static_cast<int8_t>(hash & 0x7f);
+        entries_[j] = oldEntries[i];
+    }
+
+    if (oldCtrl) ::operator delete[](oldCtrl, kCtrlAlign);
+    delete[] oldEntries;
+}
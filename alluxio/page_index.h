@@ -0,0 +1,67 @@
+// page_index.h
+// Open-addressing (Swiss-table style) index from an Alluxio page key to the
+// device slot holding it.
+//
+// Every bucket has a one-byte control word: kEmpty, kDeleted, or the low 7
+// bits of the key's hash. Control bytes are packed into 16-byte groups (four
+// per cache line) and a probe compares a whole group against the hash tag
+// with one SSE2 compare, so most lookups touch one control line and one entry.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct PageKey {
+    uint64_t file_id;
+    uint64_t page_index;
+
+    bool operator==(const PageKey&) const = default;
+};
+
+class PageIndex {
+public:
+    static constexpr uint64_t kNotFound = UINT64_MAX;
+    static constexpr size_t kGroupSize = 16;
+
+    PageIndex() = default;
+    ~PageIndex();
+
+    PageIndex(const PageIndex&) = delete;
+    PageIndex& operator=(const PageIndex&) = delete;
+
+    // Size the table for n keys without rehashing.
+    void Reserve(size_t n);
+    void Clear();
+
+    uint64_t Find(const PageKey& key) const;
+    // Returns false, leaving the table unchanged, if key is already present.
+    bool Insert(const PageKey& key, uint64_t slot);
+    bool Erase(const PageKey& key);
+
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return capacity_; }
+
+    static uint64_t Hash(const PageKey& key);
+
+private:
+    struct Entry {
+        PageKey key;
+        uint64_t slot;
+    };
+
+    static constexpr int8_t kEmpty = -128;
+    static constexpr int8_t kDeleted = -2;
+
+    static uint32_t MatchByte(const int8_t* group, int8_t tag);
+    static uint32_t MatchEmpty(const int8_t* group);
+    static uint32_t MatchFree(const int8_t* group);
+    size_t FindFree(uint64_t hash) const;
+    void Rehash(size_t capacity);
+
+    int8_t* ctrl_ = nullptr;
+    Entry* entries_ = nullptr;
+    size_t capacity_ = 0;    // buckets, a power of two multiple of kGroupSize
+    size_t size_ = 0;
+    size_t growth_left_ = 0; // inserts into empty buckets before a rehash
+};
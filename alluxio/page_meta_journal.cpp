@@ -0,0 +1,702 @@
+// page_meta_journal.cpp
+#include "page_meta_journal.h"
+
+#include <spdk/crc32.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+uint64_t AlignUp(uint64_t v, uint64_t align) {
+    return (v + align - 1) / align * align;
+}
+
+uint64_t TableBlocks(uint64_t numPages) {
+    return (numPages + kCheckpointEntriesPerBlock - 1) / kCheckpointEntriesPerBlock;
+}
+
+} // namespace
+
+MetadataLayout ComputeMetadataLayout(uint64_t numPages, uint64_t journalBlocks) {
+    MetadataLayout layout{};
+    layout.checkpoint_bytes = (1 + TableBlocks(numPages)) * kMetaBlockSize;
+    layout.checkpoint_offset[0] = 2 * kMetaBlockSize;
+    layout.checkpoint_offset[1] = layout.checkpoint_offset[0] + layout.checkpoint_bytes;
+    layout.journal_offset = layout.checkpoint_offset[1] + layout.checkpoint_bytes;
+    layout.journal_blocks = journalBlocks;
+    layout.data_offset = AlignUp(layout.journal_offset + journalBlocks * kMetaBlockSize, 1 << 20);
+    return layout;
+}
+
+PageMetaJournal::~PageMetaJournal() {
+    for (auto& batch : batches_) {
+        if (batch.buf) spdk_free(batch.buf);
+    }
+    if (cp_buf_) spdk_free(cp_buf_);
+    if (recover_buf_) spdk_free(recover_buf_);
+}
+
+uint32_t Crc32c(const void* buf, size_t len) {
+    // SPDK dispatches to ISA-L's PCLMUL folding or the SSE4.2 crc32
+    // instruction when available and to a table otherwise.
+    return spdk_crc32c_update(buf, len, ~0u) ^ ~0u;
+}
+
+void PageMetaJournal::Recover(struct spdk_bdev_desc* desc, struct spdk_io_channel* ch,
+                              uint32_t pageSize, uint64_t numPages, uint64_t journalBlocks,
+                              IoCallback done) {
+    desc_ = desc;
+    page_size_ = pageSize;
+    num_pages_ = numPages;
+    layout_ = ComputeMetadataLayout(numPages, journalBlocks);
+    table_.assign(numPages, PageMeta{});
+    // Neither checkpoint slot is known to match the table until one is loaded.
+    cp_stale_.assign(TableBlocks(numPages), 3);
+
+    for (auto& batch : batches_) {
+        batch.buf = static_cast<char*>(spdk_zmalloc(kBatchBlocks * kMetaBlockSize, kMetaBlockSize,
+                                                    nullptr, SPDK_ENV_SOCKET_ID_ANY,
+                                                    SPDK_MALLOC_DMA));
+        if (!batch.buf) {
+            std::cerr << "SPDK: Failed to allocate journal batch buffer" << std::endl;
+            done(false);
+            return;
+        }
+        batch.undo.reserve(kBatchBlocks * kRecordsPerBlock);
+    }
+    size_t len = std::max<size_t>({2 * kMetaBlockSize, kCheckpointIoBlocks * kMetaBlockSize,
+                                   layout_.journal_blocks * kMetaBlockSize});
+    recover_buf_ = spdk_zmalloc(len, kMetaBlockSize, nullptr, SPDK_ENV_SOCKET_ID_ANY,
+                                SPDK_MALLOC_DMA);
+    if (!recover_buf_) {
+        std::cerr << "SPDK: Failed to allocate metadata recovery buffer" << std::endl;
+        done(false);
+        return;
+    }
+    recover_ch_ = ch;
+    recover_done_ = std::move(done);
+    RecoverNext(Phase::kSuperblock);
+}
+
+void PageMetaJournal::RecoverNext(Phase phase) {
+    recover_phase_ = phase;
+    uint64_t offset = 0;
+    uint64_t len = 2 * kMetaBlockSize;
+    if (phase == Phase::kCheckpoint) {
+        offset = layout_.checkpoint_offset[sb_.active_checkpoint];
+        len = kMetaBlockSize;
+    } else if (phase == Phase::kCheckpointTable) {
+        recover_blocks_ = std::min<uint64_t>(kCheckpointIoBlocks,
+                                             TableBlocks(num_pages_) - recover_block_);
+        offset = layout_.checkpoint_offset[sb_.active_checkpoint] +
+                 (1 + recover_block_) * kMetaBlockSize;
+        len = recover_blocks_ * kMetaBlockSize;
+    } else if (phase == Phase::kJournal) {
+        offset = layout_.journal_offset;
+        len = layout_.journal_blocks * kMetaBlockSize;
+    }
+    int rc = spdk_bdev_read(desc_, recover_ch_, recover_buf_, offset, len, OnRecoveryRead, this);
+    if (rc != 0) {
+        std::cerr << "SPDK: Failed to submit metadata read" << std::endl;
+        FinishRecovery(false);
+    }
+}
+
+void PageMetaJournal::OnRecoveryRead(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* self = static_cast<PageMetaJournal*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    if (!success) {
+        std::cerr << "SPDK: Metadata read failed" << std::endl;
+        self->FinishRecovery(false);
+        return;
+    }
+
+    auto* buf = static_cast<char*>(self->recover_buf_);
+    switch (self->recover_phase_) {
+    case Phase::kSuperblock: {
+        const MetaSuperblock* best = nullptr;
+        for (int i = 0; i < 2; i++) {
+            MetaSuperblock sb;
+            memcpy(&sb, buf + i * kMetaBlockSize, sizeof(sb));
+            uint32_t crc = sb.crc;
+            sb.crc = 0;
+            bool valid = sb.magic == kMetaMagic && sb.format_version == kMetaFormatVersion &&
+                         crc == Crc32c(&sb, sizeof(sb)) && sb.page_size == self->page_size_ &&
+                         sb.num_pages == self->num_pages_ &&
+                         sb.checkpoint_bytes == self->layout_.checkpoint_bytes &&
+                         sb.journal_offset == self->layout_.journal_offset &&
+                         sb.journal_blocks == self->layout_.journal_blocks &&
+                         sb.data_offset == self->layout_.data_offset;
+            auto* copy = reinterpret_cast<const MetaSuperblock*>(buf + i * kMetaBlockSize);
+            if (valid && (!best || copy->sb_seq > best->sb_seq)) best = copy;
+        }
+
+        if (best) {
+            self->sb_ = *best;
+            self->replay_ = true;
+        } else {
+            std::cerr << "SPDK: No usable page metadata found, formatting" << std::endl;
+            MetaSuperblock sb{};
+            sb.magic = kMetaMagic;
+            sb.format_version = kMetaFormatVersion;
+            sb.page_size = self->page_size_;
+            sb.num_pages = self->num_pages_;
+            sb.checkpoint_offset[0] = self->layout_.checkpoint_offset[0];
+            sb.checkpoint_offset[1] = self->layout_.checkpoint_offset[1];
+            sb.checkpoint_bytes = self->layout_.checkpoint_bytes;
+            sb.journal_offset = self->layout_.journal_offset;
+            sb.journal_blocks = self->layout_.journal_blocks;
+            sb.data_offset = self->layout_.data_offset;
+            sb.active_checkpoint = kNoCheckpoint;
+            self->sb_ = sb;
+            self->replay_ = false;
+        }
+        // The journal is scanned even when formatting so the new sequence
+        // numbers start above anything a previous store left in the ring.
+        self->RecoverNext(self->sb_.active_checkpoint == kNoCheckpoint ? Phase::kJournal
+                                                                        : Phase::kCheckpoint);
+        return;
+    }
+
+    case Phase::kCheckpoint: {
+        CheckpointHeader hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        uint32_t crc = hdr.crc;
+        hdr.crc = 0;
+        if (hdr.magic != kCheckpointMagic || crc != Crc32c(&hdr, sizeof(hdr)) ||
+            hdr.seq != self->sb_.checkpoint_seq || hdr.num_pages != self->num_pages_) {
+            // Losing cache metadata only costs refetches; never guess.
+            std::cerr << "SPDK: Page metadata checkpoint is corrupt, starting empty" << std::endl;
+            self->replay_ = false;
+            self->RecoverNext(Phase::kJournal);
+            return;
+        }
+        self->recover_block_ = 0;
+        self->RecoverNext(self->cp_stale_.empty() ? Phase::kJournal : Phase::kCheckpointTable);
+        return;
+    }
+
+    case Phase::kCheckpointTable: {
+        if (!self->LoadCheckpointRun(buf, self->recover_block_, self->recover_blocks_)) {
+            std::cerr << "SPDK: Page metadata checkpoint is corrupt, starting empty" << std::endl;
+            self->table_.assign(self->num_pages_, PageMeta{});
+            self->replay_ = false;
+            self->RecoverNext(Phase::kJournal);
+            return;
+        }
+        self->recover_block_ += self->recover_blocks_;
+        if (self->recover_block_ < self->cp_stale_.size()) {
+            self->RecoverNext(Phase::kCheckpointTable);
+            return;
+        }
+        // The active slot now matches the table; only the other one is stale.
+        std::fill(self->cp_stale_.begin(), self->cp_stale_.end(),
+                  static_cast<uint8_t>(1u << (1 - self->sb_.active_checkpoint)));
+        self->RecoverNext(Phase::kJournal);
+        return;
+    }
+
+    case Phase::kJournal: {
+        std::vector<std::pair<uint64_t, uint64_t>> blocks; // {seq, ring index}
+        uint64_t maxSeq = 0;
+        bool any = false;
+        for (uint64_t i = 0; i < self->layout_.journal_blocks; i++) {
+            char* block = buf + i * kMetaBlockSize;
+            auto* hdr = reinterpret_cast<JournalBlockHeader*>(block);
+            if (hdr->magic != kJournalMagic || hdr->count > kRecordsPerBlock) continue;
+            uint32_t crc = hdr->crc;
+            hdr->crc = 0;
+            bool valid = crc == Crc32c(block, sizeof(*hdr) + hdr->count * sizeof(JournalRecord));
+            hdr->crc = crc;
+            if (!valid) continue;
+            blocks.emplace_back(hdr->seq, i);
+            maxSeq = std::max(maxSeq, hdr->seq);
+            any = true;
+        }
+
+        std::sort(blocks.begin(), blocks.end());
+        uint64_t expect = self->sb_.checkpoint_seq;
+        uint64_t replayed = 0;
+        for (const auto& [seq, idx] : blocks) {
+            if (!self->replay_ || seq > expect) break;
+            if (seq < expect) continue;
+            char* block = buf + idx * kMetaBlockSize;
+            auto* hdr = reinterpret_cast<JournalBlockHeader*>(block);
+            auto* recs = reinterpret_cast<JournalRecord*>(block + sizeof(*hdr));
+            for (uint32_t r = 0; r < hdr->count; r++) {
+                if (recs[r].slot < self->num_pages_) {
+                    const JournalRecord& rec = recs[r];
+                    self->table_[rec.slot] =
+                        PageMeta{rec.version, rec.crc32, rec.file_id, rec.page_index,
+                                 rec.stored_size, rec.codec, {}};
+                    self->MarkStaleLocked(rec.slot);
+                }
+            }
+            replayed++;
+            expect++;
+        }
+        if (replayed) {
+            std::cerr << "SPDK: Replayed " << replayed << " page metadata journal blocks"
+                      << std::endl;
+        }
+
+        self->next_seq_ = std::max(any ? maxSeq + 1 : 0, self->sb_.checkpoint_seq);
+        self->durable_cp_seq_ = self->next_seq_;
+        spdk_free(self->recover_buf_);
+        self->recover_buf_ = nullptr;
+        self->StartCheckpoint(self->recover_ch_, [self](bool ok) { self->FinishRecovery(ok); });
+        return;
+    }
+    }
+}
+
+bool PageMetaJournal::LoadCheckpointRun(char* buf, uint64_t firstBlock, uint64_t blocks) {
+    for (uint64_t i = 0; i < blocks; i++) {
+        char* block = buf + i * kMetaBlockSize;
+        auto* footer = reinterpret_cast<CheckpointBlockFooter*>(block + kMetaBlockSize -
+                                                                 sizeof(CheckpointBlockFooter));
+        uint64_t first = (firstBlock + i) * kCheckpointEntriesPerBlock;
+        uint32_t crc = footer->crc;
+        footer->crc = 0;
+        if (footer->magic != kCheckpointMagic || footer->first_slot != first ||
+            crc != Crc32c(block, kMetaBlockSize)) {
+            return false;
+        }
+        uint64_t n = std::min<uint64_t>(kCheckpointEntriesPerBlock, num_pages_ - first);
+        memcpy(table_.data() + first, block, n * sizeof(PageMeta));
+    }
+    return true;
+}
+
+void PageMetaJournal::FinishRecovery(bool success) {
+    if (recover_buf_) {
+        spdk_free(recover_buf_);
+        recover_buf_ = nullptr;
+    }
+    IoCallback done = std::move(recover_done_);
+    if (done) done(success);
+}
+
+PageMeta PageMetaJournal::Get(uint64_t slot) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slot < table_.size() ? table_[slot] : PageMeta{};
+}
+
+PageMetaJournalStats PageMetaJournal::GetStats() const {
+    PageMetaJournalStats stats;
+    stats.journal_writes = journal_writes_.load(std::memory_order_relaxed);
+    stats.journal_blocks = journal_blocks_written_.load(std::memory_order_relaxed);
+    stats.records = records_.load(std::memory_order_relaxed);
+    stats.checkpoints = checkpoints_.load(std::memory_order_relaxed);
+    stats.stalls = stalls_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PageMetaJournal::Commit(JournalWaiter* w, struct spdk_io_channel* ch) {
+    if (w->count > kBatchBlocks * kRecordsPerBlock) {
+        w->done(w, false);
+        return;
+    }
+
+    bool submit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records_.fetch_add(w->count, std::memory_order_relaxed);
+
+        // Keep commit order: nothing jumps ahead of already parked waiters.
+        if (overflow_ || !TryAppend(w)) {
+            w->next = nullptr;
+            *overflow_tail_ = w;
+            overflow_tail_ = &w->next;
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+        }
+        submit = SealLocked();
+        if (submit) flight_ch_ = ch;
+    }
+    if (submit) SubmitFlight(ch);
+}
+
+size_t PageMetaJournal::OpenCapacityBlocks() const {
+    uint64_t ring = layout_.journal_blocks;
+    // Never overwrite a block the durable checkpoint does not cover yet.
+    uint64_t limit = durable_cp_seq_ + ring;
+    if (next_seq_ >= limit) return 0;
+    uint64_t cap = std::min<uint64_t>(kBatchBlocks, ring - next_seq_ % ring);
+    return static_cast<size_t>(std::min<uint64_t>(cap, limit - next_seq_));
+}
+
+bool PageMetaJournal::TryAppend(JournalWaiter* w) {
+    Batch* b = open_;
+    size_t used = b->blocks == 0 ? 0 : (b->blocks - 1) * kRecordsPerBlock + b->records;
+    if (used + w->count > OpenCapacityBlocks() * kRecordsPerBlock) return false;
+
+    for (uint32_t i = 0; i < w->count; i++) {
+        JournalRecord& rec = w->records[i];
+        if (rec.slot < table_.size()) {
+            MarkStaleLocked(rec.slot);
+            PageMeta& meta = table_[rec.slot];
+            b->undo.emplace_back(rec.slot, meta);
+            if (rec.version != 0) {
+                rec.version = meta.version + 1;
+                if (rec.version == 0) rec.version = 1;
+            }
+            meta = PageMeta{rec.version, rec.crc32, rec.file_id, rec.page_index,
+                            rec.stored_size, rec.codec, {}};
+        }
+        if (b->blocks == 0 || b->records == kRecordsPerBlock) {
+            b->blocks++;
+            b->records = 0;
+        }
+        char* block = b->buf + (b->blocks - 1) * kMetaBlockSize;
+        auto* recs = reinterpret_cast<JournalRecord*>(block + sizeof(JournalBlockHeader));
+        recs[b->records++] = rec;
+    }
+    w->next = nullptr;
+    *b->tail = w;
+    b->tail = &w->next;
+    return true;
+}
+
+bool PageMetaJournal::SealLocked() {
+    if (flight_ || open_->blocks == 0) return false;
+
+    Batch* b = open_;
+    b->start_seq = next_seq_;
+    for (size_t i = 0; i < b->blocks; i++) {
+        char* block = b->buf + i * kMetaBlockSize;
+        auto* hdr = reinterpret_cast<JournalBlockHeader*>(block);
+        hdr->magic = kJournalMagic;
+        hdr->seq = b->start_seq + i;
+        hdr->count = static_cast<uint32_t>(i + 1 == b->blocks ? b->records : kRecordsPerBlock);
+        hdr->reserved = 0;
+        hdr->crc = 0;
+        hdr->crc = Crc32c(block, sizeof(*hdr) + hdr->count * sizeof(JournalRecord));
+    }
+    next_seq_ += b->blocks;
+    flight_ = b;
+
+    open_ = (b == &batches_[0]) ? &batches_[1] : &batches_[0];
+    open_->blocks = 0;
+    open_->records = 0;
+    open_->undo.clear();
+    open_->waiters = nullptr;
+    open_->tail = &open_->waiters;
+    DrainOverflowLocked();
+    return true;
+}
+
+void PageMetaJournal::DrainOverflowLocked() {
+    while (overflow_) {
+        JournalWaiter* w = overflow_;
+        JournalWaiter* next = w->next;
+        if (!TryAppend(w)) break;
+        overflow_ = next;
+        if (!overflow_) overflow_tail_ = &overflow_;
+    }
+}
+
+void PageMetaJournal::SubmitFlight(struct spdk_io_channel* ch) {
+    // flight_ only changes in CompleteFlight(), after this write completes.
+    Batch* b = flight_;
+    uint64_t offset = layout_.journal_offset + (b->start_seq % layout_.journal_blocks) * kMetaBlockSize;
+    int rc = spdk_bdev_write(desc_, ch, b->buf, offset, b->blocks * kMetaBlockSize,
+                             OnJournalWritten, this);
+    if (rc == -ENOMEM) {
+        // The bdev_io pool is momentarily empty; resubmit once one is freed
+        // rather than failing every record of the batch.
+        io_wait_.bdev = spdk_bdev_desc_get_bdev(desc_);
+        io_wait_.cb_fn = RetryFlight;
+        io_wait_.cb_arg = this;
+        rc = spdk_bdev_queue_io_wait(io_wait_.bdev, ch, &io_wait_);
+    }
+    if (rc != 0) {
+        std::cerr << "SPDK: Failed to submit journal write" << std::endl;
+        CompleteFlight(false, ch);
+    }
+}
+
+void PageMetaJournal::RetryFlight(void* arg) {
+    auto* self = static_cast<PageMetaJournal*>(arg);
+    self->SubmitFlight(self->flight_ch_);
+}
+
+void PageMetaJournal::OnJournalWritten(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* self = static_cast<PageMetaJournal*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    self->CompleteFlight(success, self->flight_ch_);
+}
+
+void PageMetaJournal::CompleteFlight(bool success, struct spdk_io_channel* ch) {
+    JournalWaiter* waiters;
+    bool submit;
+    bool checkpoint = false;
+    std::vector<IoCallback> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Batch* b = flight_;
+        flight_ = nullptr;
+        waiters = b->waiters;
+        if (success) {
+            journal_writes_.fetch_add(1, std::memory_order_relaxed);
+            journal_blocks_written_.fetch_add(b->blocks, std::memory_order_relaxed);
+        } else {
+            // Callers learn the records failed, so they must not surface
+            // later through the table or a checkpoint of it.
+            RollBackLocked(b);
+            if (!checkpointing_ && durable_cp_seq_ <= b->start_seq) {
+                // Reuse the sequence numbers so replay does not stop at a hole.
+                next_seq_ = b->start_seq;
+            } else if (checkpointing_) {
+                // A snapshot already depends on next_seq_; cover the hole
+                // with a follow-up checkpoint instead.
+                checkpoint_pending_ = true;
+            } else {
+                // A checkpoint finished while the batch was in flight and may
+                // hold its records; replace it.
+                checkpointing_ = true;
+                checkpoint = true;
+            }
+        }
+        submit = SealLocked();
+        if (submit) flight_ch_ = ch;
+        if (!checkpointing_ && next_seq_ - durable_cp_seq_ >= layout_.journal_blocks / 2) {
+            checkpointing_ = true;
+            checkpoint = true;
+        }
+        TakeDrainWaitersLocked(ready);
+    }
+
+    while (waiters) {
+        JournalWaiter* next = waiters->next;
+        waiters->done(waiters, success);
+        waiters = next;
+    }
+    if (submit) SubmitFlight(ch);
+    if (checkpoint) StartCheckpoint(ch, nullptr);
+    for (auto& cb : ready) cb(true);
+}
+
+void PageMetaJournal::RollBackLocked(Batch* b) {
+    // Newest first, so a slot with several records ends at its oldest value.
+    for (auto it = b->undo.rbegin(); it != b->undo.rend(); ++it) {
+        auto [slot, prev] = *it;
+        MarkStaleLocked(slot);
+        // A record of the open batch already replaced this one; undoing that
+        // one must not bring the failed value back either.
+        auto later = std::find_if(open_->undo.begin(), open_->undo.end(),
+                                  [slot](const auto& u) { return u.first == slot; });
+        if (later != open_->undo.end()) {
+            later->second = prev;
+        } else {
+            table_[slot] = prev;
+        }
+    }
+}
+
+void PageMetaJournal::MarkStaleLocked(uint64_t slot) {
+    cp_stale_[slot / kCheckpointEntriesPerBlock] = 3;
+}
+
+void PageMetaJournal::StartCheckpoint(struct spdk_io_channel* ch, IoCallback done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        checkpointing_ = true;
+        // Everything below next_seq_ is already reflected in table_; later
+        // blocks are replayed on top of this checkpoint, whose table blocks
+        // are copied as the write goes and may include some of them.
+        cp_seq_ = next_seq_;
+        cp_slot_ = sb_.active_checkpoint == 0 ? 1 : 0;
+        cp_ch_ = ch;
+        cp_done_ = std::move(done);
+        cp_next_block_ = 0;
+        if (!cp_buf_) {
+            cp_buf_ = spdk_zmalloc(kCheckpointIoBlocks * kMetaBlockSize, kMetaBlockSize, nullptr,
+                                   SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA);
+        }
+    }
+    if (!cp_buf_) {
+        std::cerr << "SPDK: Failed to allocate checkpoint buffer" << std::endl;
+        FinishCheckpoint(false);
+        return;
+    }
+    WriteCheckpointRun();
+}
+
+void PageMetaJournal::WriteCheckpointRun() {
+    auto* buf = static_cast<char*>(cp_buf_);
+    auto bit = static_cast<uint8_t>(1u << cp_slot_);
+    uint64_t first;
+    uint64_t blocks = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t b = cp_next_block_;
+        while (b < cp_stale_.size() && !(cp_stale_[b] & bit)) b++;
+        first = b;
+        for (; b < cp_stale_.size() && blocks < kCheckpointIoBlocks && (cp_stale_[b] & bit);
+             b++, blocks++) {
+            char* block = buf + blocks * kMetaBlockSize;
+            uint64_t slot = b * kCheckpointEntriesPerBlock;
+            uint64_t n = std::min<uint64_t>(kCheckpointEntriesPerBlock, num_pages_ - slot);
+            memset(block, 0, kMetaBlockSize);
+            memcpy(block, table_.data() + slot, n * sizeof(PageMeta));
+            cp_stale_[b] &= static_cast<uint8_t>(~bit);
+        }
+        cp_next_block_ = b;
+    }
+    if (blocks == 0) {
+        WriteCheckpointHeader();
+        return;
+    }
+
+    for (uint64_t i = 0; i < blocks; i++) {
+        char* block = buf + i * kMetaBlockSize;
+        CheckpointBlockFooter footer{};
+        footer.magic = kCheckpointMagic;
+        footer.first_slot = (first + i) * kCheckpointEntriesPerBlock;
+        char* tail = block + kMetaBlockSize - sizeof(footer);
+        memcpy(tail, &footer, sizeof(footer));
+        footer.crc = Crc32c(block, kMetaBlockSize);
+        memcpy(tail, &footer, sizeof(footer));
+    }
+    WriteCheckpointBlocks(layout_.checkpoint_offset[cp_slot_] + (1 + first) * kMetaBlockSize,
+                          blocks * kMetaBlockSize, OnCheckpointRunWritten);
+}
+
+void PageMetaJournal::OnCheckpointRunWritten(struct spdk_bdev_io* bdev_io, bool success,
+                                             void* cb_arg) {
+    auto* self = static_cast<PageMetaJournal*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    if (!success) {
+        std::cerr << "SPDK: Checkpoint write failed" << std::endl;
+        self->FinishCheckpoint(false);
+        return;
+    }
+    self->WriteCheckpointRun();
+}
+
+void PageMetaJournal::WriteCheckpointHeader() {
+    CheckpointHeader hdr{};
+    hdr.magic = kCheckpointMagic;
+    hdr.seq = cp_seq_;
+    hdr.num_pages = num_pages_;
+    hdr.crc = 0;
+    hdr.crc = Crc32c(&hdr, sizeof(hdr));
+    memset(cp_buf_, 0, kMetaBlockSize);
+    memcpy(cp_buf_, &hdr, sizeof(hdr));
+
+    WriteCheckpointBlocks(layout_.checkpoint_offset[cp_slot_], kMetaBlockSize,
+                          OnCheckpointWritten);
+}
+
+void PageMetaJournal::WriteCheckpointBlocks(uint64_t offset, uint64_t len,
+                                            spdk_bdev_io_completion_cb done) {
+    cp_io_offset_ = offset;
+    cp_io_len_ = len;
+    cp_io_done_ = done;
+    SubmitCheckpointWrite(this);
+}
+
+void PageMetaJournal::SubmitCheckpointWrite(void* arg) {
+    auto* self = static_cast<PageMetaJournal*>(arg);
+    int rc = spdk_bdev_write(self->desc_, self->cp_ch_, self->cp_buf_, self->cp_io_offset_,
+                             self->cp_io_len_, self->cp_io_done_, self);
+    if (rc == -ENOMEM) {
+        // A failed checkpoint holds back ring reuse until the next one, so
+        // wait for a bdev_io instead.
+        self->cp_io_wait_.bdev = spdk_bdev_desc_get_bdev(self->desc_);
+        self->cp_io_wait_.cb_fn = SubmitCheckpointWrite;
+        self->cp_io_wait_.cb_arg = self;
+        rc = spdk_bdev_queue_io_wait(self->cp_io_wait_.bdev, self->cp_ch_, &self->cp_io_wait_);
+    }
+    if (rc != 0) {
+        std::cerr << "SPDK: Failed to submit checkpoint write" << std::endl;
+        self->FinishCheckpoint(false);
+    }
+}
+
+void PageMetaJournal::OnCheckpointWritten(struct spdk_bdev_io* bdev_io, bool success,
+                                          void* cb_arg) {
+    auto* self = static_cast<PageMetaJournal*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    if (!success) {
+        std::cerr << "SPDK: Checkpoint write failed" << std::endl;
+        self->FinishCheckpoint(false);
+        return;
+    }
+
+    MetaSuperblock sb;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        sb = self->sb_;
+    }
+    sb.sb_seq++;
+    sb.active_checkpoint = self->cp_slot_;
+    sb.checkpoint_seq = self->cp_seq_;
+    sb.crc = 0;
+    sb.crc = Crc32c(&sb, sizeof(sb));
+    self->cp_sb_ = sb;
+
+    memset(self->cp_buf_, 0, kMetaBlockSize);
+    memcpy(self->cp_buf_, &sb, sizeof(sb));
+    self->WriteCheckpointBlocks((sb.sb_seq % 2) * kMetaBlockSize, kMetaBlockSize,
+                                OnSuperblockWritten);
+}
+
+void PageMetaJournal::OnSuperblockWritten(struct spdk_bdev_io* bdev_io, bool success,
+                                          void* cb_arg) {
+    auto* self = static_cast<PageMetaJournal*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    self->FinishCheckpoint(success);
+}
+
+void PageMetaJournal::FinishCheckpoint(bool success) {
+    IoCallback done;
+    bool submit;
+    bool again;
+    std::vector<IoCallback> ready;
+    struct spdk_io_channel* ch = cp_ch_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (success) {
+            sb_ = cp_sb_;
+            durable_cp_seq_ = cp_seq_;
+            checkpoints_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // Blocks of the slot may be torn; rewrite all of them next time.
+            for (auto& stale : cp_stale_) stale |= static_cast<uint8_t>(1u << cp_slot_);
+        }
+        done = std::move(cp_done_);
+        // The ring may have room again for parked commits.
+        DrainOverflowLocked();
+        submit = SealLocked();
+        if (submit) flight_ch_ = ch;
+        again = checkpoint_pending_;
+        checkpoint_pending_ = false;
+        checkpointing_ = again;
+        TakeDrainWaitersLocked(ready);
+    }
+    if (submit) SubmitFlight(ch);
+    if (done) done(success);
+    if (again) StartCheckpoint(ch, nullptr);
+    for (auto& cb : ready) cb(true);
+}
+
+bool PageMetaJournal::IdleLocked() const {
+    return !flight_ && !checkpointing_ && open_->blocks == 0 && !overflow_;
+}
+
+void PageMetaJournal::TakeDrainWaitersLocked(std::vector<IoCallback>& ready) {
+    if (!drain_waiters_.empty() && IdleLocked()) ready.swap(drain_waiters_);
+}
+
+void PageMetaJournal::Drain(IoCallback cb) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!IdleLocked()) {
+            drain_waiters_.push_back(std::move(cb));
+            return;
+        }
+    }
+    cb(true);
+}
@@ -0,0 +1,289 @@
+// page_meta_journal.h
+// On-device page metadata: superblock, A/B checkpoints and an append-only,
+// group-committed journal of per-page updates.
+//
+// Device layout (all offsets in bytes, 4 KiB granularity):
+//
+//   [0, 8K)            two superblock copies, written alternately
+//   [cp0, cp0 + cpLen)  checkpoint slot 0: header block + PageMeta table blocks
+//   [cp1, cp1 + cpLen)  checkpoint slot 1
+//   [jr, jr + jrLen)    journal ring of 4 KiB blocks
+//   [data_offset, ...)  page data, 1 MiB aligned
+//
+// A journal block is a header plus up to kRecordsPerBlock records, each the
+// absolute new state of one slot, so replay is idempotent. Recovery loads the
+// active checkpoint, replays the consecutive run of valid blocks starting at
+// the checkpoint's sequence number, and immediately writes a fresh checkpoint
+// so torn or stale blocks left in the ring can never be replayed later.
+//
+// The table is stored as 4 KiB blocks of kCheckpointEntriesPerBlock entries,
+// each with its own CRC, and is read and written in runs of at most
+// kCheckpointIoBlocks blocks, so no DMA buffer grows with the device. A
+// checkpoint only rewrites the blocks of its slot that changed since that
+// slot was last written; this is safe because replay starts at the seq taken
+// when the checkpoint began and every record is an absolute slot state.
+
+#pragma once
+
+#include <spdk/bdev.h>
+#include <spdk/env.h>
+#include <spdk/thread.h>
+#include "io_callback.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// file_id of slots written by raw pageId rather than through a PageKey.
+constexpr uint64_t kNoFileId = UINT64_MAX;
+
+// How a page's bytes are stored on the device.
+enum class PageCodec : uint8_t {
+    kNone,    // the page as written
+    kDeflate, // raw DEFLATE stream, produced by the accel framework
+};
+
+// One entry per slot. A page occupies the slot its entry is in plus as many
+// following slots as stored_size needs; only that first slot has an entry.
+struct PageMeta {
+    uint32_t version;     // 0 = slot unused
+    uint32_t crc32;       // CRC32C of the stored slots, padding included
+    uint64_t file_id;     // key of the page held in the slot
+    uint64_t page_index;
+    uint32_t stored_size; // bytes of (possibly compressed) page data
+    uint8_t codec;        // PageCodec
+    uint8_t reserved[3];
+};
+
+struct JournalRecord {
+    uint64_t slot;
+    uint32_t version;
+    uint32_t crc32;
+    uint64_t file_id;
+    uint64_t page_index;
+    uint32_t stored_size;
+    uint8_t codec;
+    uint8_t reserved[3];
+};
+
+constexpr uint64_t kMetaMagic = 0x50475354'4D455441ULL;
+constexpr uint64_t kJournalMagic = 0x50475354'4A524E4CULL;
+constexpr uint64_t kCheckpointMagic = 0x50475354'43484B50ULL;
+constexpr uint32_t kMetaFormatVersion = 4;
+constexpr size_t kMetaBlockSize = 4096;
+constexpr uint32_t kNoCheckpoint = UINT32_MAX;
+
+struct MetaSuperblock {
+    uint64_t magic;
+    uint32_t format_version;
+    uint32_t page_size;
+    uint64_t num_pages;
+    uint64_t sb_seq;            // higher copy wins
+    uint64_t checkpoint_offset[2];
+    uint64_t checkpoint_bytes;
+    uint64_t journal_offset;
+    uint64_t journal_blocks;
+    uint64_t data_offset;
+    uint64_t checkpoint_seq;    // first journal seq not covered by the checkpoint
+    uint32_t active_checkpoint; // 0, 1 or kNoCheckpoint
+    uint32_t crc;               // crc32c of the struct with crc = 0
+};
+
+struct CheckpointHeader {
+    uint64_t magic;
+    uint64_t seq;
+    uint64_t num_pages;
+    uint32_t reserved;
+    uint32_t crc;
+};
+
+// Entries per checkpoint table block; the rest of the block is its footer.
+constexpr size_t kCheckpointEntriesPerBlock = kMetaBlockSize / sizeof(PageMeta) - 1;
+
+struct CheckpointBlockFooter {
+    uint64_t magic;
+    uint64_t first_slot;
+    uint32_t reserved[3];
+    uint32_t crc;               // crc32c of the block with crc = 0
+};
+
+struct JournalBlockHeader {
+    uint64_t magic;
+    uint64_t seq;
+    uint32_t count;
+    uint32_t crc;               // crc32c of header (crc = 0) and records
+    uint64_t reserved;
+};
+
+constexpr size_t kRecordsPerBlock =
+    (kMetaBlockSize - sizeof(JournalBlockHeader)) / sizeof(JournalRecord);
+
+struct MetadataLayout {
+    uint64_t checkpoint_offset[2];
+    uint64_t checkpoint_bytes;
+    uint64_t journal_offset;
+    uint64_t journal_blocks;
+    uint64_t data_offset;
+};
+
+MetadataLayout ComputeMetadataLayout(uint64_t numPages, uint64_t journalBlocks);
+
+// CRC32C (Castagnoli) of buf, as stored in PageMeta and the metadata blocks.
+uint32_t Crc32c(const void* buf, size_t len);
+
+// One caller waiting for its records to become durable. The caller owns the
+// storage of both the waiter and its records until done() runs, which
+// happens on whichever thread completed the journal write.
+struct JournalWaiter {
+    JournalWaiter* next = nullptr;
+    JournalRecord* records = nullptr;
+    uint32_t count = 0;
+    void (*done)(JournalWaiter* w, bool success) = nullptr;
+    void* ctx = nullptr;
+};
+
+struct PageMetaJournalStats {
+    uint64_t journal_writes = 0;
+    uint64_t journal_blocks = 0;
+    uint64_t records = 0;
+    uint64_t checkpoints = 0;
+    uint64_t stalls = 0; // commits parked because the open batch was full
+};
+
+class PageMetaJournal {
+public:
+    // Blocks written in one group commit.
+    static constexpr size_t kBatchBlocks = 16;
+    // Checkpoint table blocks read or written by one bdev I/O.
+    static constexpr size_t kCheckpointIoBlocks = 256;
+
+    PageMetaJournal() = default;
+    ~PageMetaJournal();
+
+    PageMetaJournal(const PageMetaJournal&) = delete;
+    PageMetaJournal& operator=(const PageMetaJournal&) = delete;
+
+    // Load (or format) the metadata region and replay the journal. done runs
+    // on the calling thread once the post-recovery checkpoint is durable.
+    // pageSize is the slot size; metadata of another geometry is not reused.
+    void Recover(struct spdk_bdev_desc* desc, struct spdk_io_channel* ch, uint32_t pageSize,
+                 uint64_t numPages, uint64_t journalBlocks, IoCallback done);
+
+    // Queue w's records for the next group commit on ch. They are applied to
+    // the in-memory table as they join a batch, at once unless the ring is
+    // full, and rolled back if the batch's write fails. A non-zero record
+    // version is replaced by the slot's current version + 1; a zero version
+    // marks the slot free.
+    void Commit(JournalWaiter* w, struct spdk_io_channel* ch);
+
+    // Runs cb once no journal or checkpoint write is in flight.
+    void Drain(IoCallback cb);
+
+    PageMeta Get(uint64_t slot) const;
+    // Calls fn(slot, meta) for every used slot, e.g. to rebuild allocation
+    // state after Recover, without copying the table. fn must not call back
+    // into the journal.
+    template <typename Fn>
+    void ForEachUsed(Fn&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint64_t slot = 0; slot < table_.size(); slot++) {
+            if (table_[slot].version != 0) fn(slot, table_[slot]);
+        }
+    }
+    const MetadataLayout& Layout() const { return layout_; }
+    PageMetaJournalStats GetStats() const;
+
+private:
+    struct Batch {
+        char* buf = nullptr;
+        size_t blocks = 0;       // blocks holding at least one record
+        size_t records = 0;      // records in the last block
+        uint64_t start_seq = 0;  // assigned when sealed
+        // Each record's slot and its metadata from before the record.
+        std::vector<std::pair<uint64_t, PageMeta>> undo;
+        JournalWaiter* waiters = nullptr;
+        JournalWaiter** tail = &waiters;
+    };
+
+    enum class Phase { kSuperblock, kCheckpoint, kCheckpointTable, kJournal };
+
+    size_t OpenCapacityBlocks() const;
+    bool TryAppend(JournalWaiter* w);
+    bool SealLocked();
+    void DrainOverflowLocked();
+    void SubmitFlight(struct spdk_io_channel* ch);
+    void CompleteFlight(bool success, struct spdk_io_channel* ch);
+    // Restores the table to what it was before b's records.
+    void RollBackLocked(Batch* b);
+    void StartCheckpoint(struct spdk_io_channel* ch, IoCallback done);
+    void WriteCheckpointRun();
+    void WriteCheckpointHeader();
+    // Writes cp_buf_ to offset; -ENOMEM waits for a bdev_io like SubmitFlight.
+    void WriteCheckpointBlocks(uint64_t offset, uint64_t len, spdk_bdev_io_completion_cb done);
+    void FinishCheckpoint(bool success);
+    void MarkStaleLocked(uint64_t slot);
+    bool LoadCheckpointRun(char* buf, uint64_t firstBlock, uint64_t blocks);
+    bool IdleLocked() const;
+    void TakeDrainWaitersLocked(std::vector<IoCallback>& ready);
+    void RecoverNext(Phase phase);
+    void FinishRecovery(bool success);
+
+    static void OnRecoveryRead(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnJournalWritten(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void RetryFlight(void* arg);
+    static void SubmitCheckpointWrite(void* arg);
+    static void OnCheckpointRunWritten(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnCheckpointWritten(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnSuperblockWritten(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+
+    struct spdk_bdev_desc* desc_ = nullptr;
+    uint32_t page_size_ = 0;
+    uint64_t num_pages_ = 0;
+    MetadataLayout layout_{};
+
+    mutable std::mutex mutex_;
+    std::vector<PageMeta> table_;
+    MetaSuperblock sb_{};
+    uint64_t next_seq_ = 0;       // seq of the next block handed to a batch
+    uint64_t durable_cp_seq_ = 0; // blocks below this may be overwritten
+    Batch batches_[2];
+    Batch* open_ = &batches_[0];
+    Batch* flight_ = nullptr;
+    JournalWaiter* overflow_ = nullptr;
+    JournalWaiter** overflow_tail_ = &overflow_;
+    bool checkpointing_ = false;
+    bool checkpoint_pending_ = false;
+    // One byte per checkpoint table block; bit s set = checkpoint slot s does
+    // not hold the block's current contents.
+    std::vector<uint8_t> cp_stale_;
+    void* cp_buf_ = nullptr;
+    uint64_t cp_seq_ = 0;
+    uint32_t cp_slot_ = 0;
+    uint64_t cp_next_block_ = 0;  // where the running checkpoint resumes its scan
+    MetaSuperblock cp_sb_{};
+    struct spdk_io_channel* cp_ch_ = nullptr;
+    struct spdk_io_channel* flight_ch_ = nullptr;
+    struct spdk_bdev_io_wait_entry io_wait_{}; // flight write waiting out -ENOMEM
+    struct spdk_bdev_io_wait_entry cp_io_wait_{};
+    uint64_t cp_io_offset_ = 0; // checkpoint write being submitted
+    uint64_t cp_io_len_ = 0;
+    spdk_bdev_io_completion_cb cp_io_done_ = nullptr;
+    IoCallback cp_done_;
+    std::vector<IoCallback> drain_waiters_;
+
+    // Recovery state; only touched on the Recover() thread.
+    struct spdk_io_channel* recover_ch_ = nullptr;
+    void* recover_buf_ = nullptr;
+    Phase recover_phase_ = Phase::kSuperblock;
+    uint64_t recover_block_ = 0;  // next checkpoint table block to read
+    uint64_t recover_blocks_ = 0; // table blocks in the current read
+    bool replay_ = false;
+    IoCallback recover_done_;
+
+    std::atomic<uint64_t> journal_writes_{0};
+    std::atomic<uint64_t> journal_blocks_written_{0};
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> checkpoints_{0};
+    std::atomic<uint64_t> stalls_{0};
+};
@@ -0,0 +1,177 @@
+// page_recorder.cpp
+#include "page_recorder.h"
+
+#include <spdk/env.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+
+bool PWriteAll(int fd, const void* data, size_t len, uint64_t offset) {
+    auto p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool PReadAll(int fd, void* data, size_t len, uint64_t offset) {
+    auto p = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+bool ReadPageRecordFile(const std::string& path, PageRecordFileHeader* header,
+                        std::vector<PageRecord>* records, std::string* error) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        *error = path + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = PReadAll(fd, header, sizeof(*header), 0);
+    if (!ok || memcmp(header->magic, PageRecordFileHeader::kMagic, sizeof(header->magic)) != 0 ||
+        header->version != PageRecordFileHeader::kVersion ||
+        header->record_size != sizeof(PageRecord) || header->capacity == 0) {
+        close(fd);
+        *error = path + ": not a PageStore capture";
+        return false;
+    }
+    // Oldest record first: once the ring has wrapped that is the next one to
+    // be overwritten.
+    uint64_t count = std::min(header->written, header->capacity);
+    uint64_t first = header->written > header->capacity ? header->written % header->capacity : 0;
+    records->resize(count);
+    uint64_t head = std::min(count, header->capacity - first);
+    ok = PReadAll(fd, records->data(), head * sizeof(PageRecord),
+                  kPageRecordDataOffset + first * sizeof(PageRecord)) &&
+         PReadAll(fd, records->data() + head, (count - head) * sizeof(PageRecord),
+                  kPageRecordDataOffset);
+    close(fd);
+    if (!ok) {
+        *error = path + ": truncated capture";
+        return false;
+    }
+    // Threads hand in their chunks at different times.
+    std::stable_sort(records->begin(), records->end(),
+                     [](const PageRecord& a, const PageRecord& b) { return a.time_ns < b.time_ns; });
+    return true;
+}
+
+PageRecorder::~PageRecorder() {
+    if (fd_ < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    cv_.notify_one();
+    writer_.join();
+    WriteHeader();
+    close(fd_);
+}
+
+bool PageRecorder::Open(const std::string& path, uint64_t capacity, size_t maxChunks) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "SPDK: Cannot open capture file " << path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    capacity_ = std::max<uint64_t>(capacity, 1);
+    max_chunks_ = std::max<size_t>(maxChunks, 1);
+    start_ticks_ = spdk_get_ticks();
+    WriteHeader();
+    writer_ = std::thread([this] { WriterLoop(); });
+    return true;
+}
+
+PageRecorder::Chunk* PageRecorder::Exchange(Chunk* full) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (full) {
+        full_.push_back(full);
+        cv_.notify_one();
+    }
+    if (!free_.empty()) {
+        Chunk* chunk = free_.back();
+        free_.pop_back();
+        return chunk;
+    }
+    if (chunks_.size() == max_chunks_) return nullptr;
+    chunks_.push_back(std::make_unique<Chunk>());
+    return chunks_.back().get();
+}
+
+void PageRecorder::Release(Chunk* chunk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_.push_back(chunk);
+    cv_.notify_one();
+}
+
+void PageRecorder::CountDropped(uint64_t n) {
+    dropped_.fetch_add(n, std::memory_order_relaxed);
+}
+
+void PageRecorder::WriterLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this] { return !full_.empty() || closing_; });
+        if (full_.empty()) return;
+        Chunk* chunk = full_.front();
+        full_.pop_front();
+        lock.unlock();
+        WriteChunk(*chunk);
+        lock.lock();
+        chunk->count = 0;
+        free_.push_back(chunk);
+    }
+}
+
+void PageRecorder::WriteChunk(const Chunk& chunk) {
+    // Only the newest capacity_ records of an oversized chunk survive anyway.
+    size_t skip = chunk.count > capacity_ ? chunk.count - capacity_ : 0;
+    const PageRecord* records = chunk.records + skip;
+    uint64_t count = chunk.count - skip;
+    written_ += skip;
+    while (count > 0) {
+        uint64_t pos = written_ % capacity_;
+        uint64_t n = std::min(count, capacity_ - pos);
+        if (!PWriteAll(fd_, records, n * sizeof(PageRecord),
+                       kPageRecordDataOffset + pos * sizeof(PageRecord))) {
+            std::cerr << "SPDK: Capture write failed: " << strerror(errno) << std::endl;
+            CountDropped(count);
+            return;
+        }
+        records += n;
+        count -= n;
+        written_ += n;
+    }
+    WriteHeader();
+}
+
+void PageRecorder::WriteHeader() {
+    PageRecordFileHeader header = {};
+    memcpy(header.magic, PageRecordFileHeader::kMagic, sizeof(header.magic));
+    header.version = PageRecordFileHeader::kVersion;
+    header.record_size = sizeof(PageRecord);
+    header.capacity = capacity_;
+    header.written = written_;
+    header.dropped = dropped_.load(std::memory_order_relaxed);
+    PWriteAll(fd_, &header, sizeof(header), 0);
+}
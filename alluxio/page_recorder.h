@@ -0,0 +1,151 @@
+// page_recorder.h
+// Capture of PageStore calls for offline replay (tools/pagestore_replay).
+//
+// Each completed call becomes one 32-byte PageRecord: when it was issued,
+// what it was, which page (or key hash) and size, how long it took and how
+// it ended. SPDK threads fill records into their own chunk without locking;
+// a full chunk is handed to a writer thread, which appends it to a file laid
+// out as a header followed by a ring of capacity records, so the file never
+// grows past its configured size and always holds the most recent calls. If
+// the writer falls behind and no chunk is free, records are dropped and
+// counted rather than stalling the reactor.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class PageRecordOp : uint8_t {
+    kRead,   // ReadPage, or ReadPages with kPageRecordBatch
+    kWrite,  // WritePage/SubmitWrite, or WritePages with kPageRecordBatch
+    kGet,    // GetPage; page is PageIndex::Hash of the key
+    kPut,    // PutPage
+    kDelete, // DeletePage
+    kFlush,
+};
+constexpr size_t kNumPageRecordOps = 6;
+
+inline const char* PageRecordOpName(PageRecordOp op) {
+    static constexpr const char* kNames[kNumPageRecordOps] = {"read", "write", "get",
+                                                              "put",  "delete", "flush"};
+    return kNames[static_cast<size_t>(op)];
+}
+
+// The record covers a whole ReadPages/WritePages call: size / kPageSize pages
+// starting at page. Batches of non-consecutive pages are recorded from their
+// first page as well.
+constexpr uint16_t kPageRecordBatch = 1;
+
+struct PageRecord {
+    uint64_t time_ns;    // issue time, since recording started
+    uint64_t page;       // pageId, or the key hash of keyed calls
+    uint32_t latency_ns; // saturates at UINT32_MAX (about 4.3 s)
+    uint32_t size;       // bytes
+    PageRecordOp op;
+    uint8_t status;      // IoStatus::Code
+    uint16_t flags;
+    uint32_t thread;     // spdk_thread id of the caller
+};
+static_assert(sizeof(PageRecord) == 32);
+
+struct PageRecordFileHeader {
+    static constexpr char kMagic[8] = {'P', 'S', 'R', 'E', 'C', 'O', 'R', 'D'};
+    static constexpr uint32_t kVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity; // records the ring holds
+    uint64_t written;  // records ever written; the ring holds the last min(written, capacity)
+    uint64_t dropped;  // records lost because no chunk was free
+};
+// Records start here; the header is rewritten in place as the ring advances.
+constexpr uint64_t kPageRecordDataOffset = 4096;
+
+// Reads a capture back, oldest call first. Returns false with *error set if
+// the file is missing or not a capture.
+bool ReadPageRecordFile(const std::string& path, PageRecordFileHeader* header,
+                        std::vector<PageRecord>* records, std::string* error);
+
+class PageRecorder {
+public:
+    static constexpr size_t kChunkRecords = 2048; // 64 KiB
+
+    struct Chunk {
+        PageRecord records[kChunkRecords];
+        size_t count = 0;
+    };
+
+    PageRecorder() = default;
+    ~PageRecorder();
+
+    PageRecorder(const PageRecorder&) = delete;
+    PageRecorder& operator=(const PageRecorder&) = delete;
+
+    // Creates (or truncates) path as a ring of capacity records and starts the
+    // writer. maxChunks bounds the memory of records not yet written.
+    bool Open(const std::string& path, uint64_t capacity, size_t maxChunks);
+
+    // Hands full (if any) to the writer and returns an empty chunk, or
+    // nullptr if none is free. Any thread; takes a lock once per chunk.
+    Chunk* Exchange(Chunk* full);
+    // Hands a last, possibly partial chunk to the writer.
+    void Release(Chunk* chunk);
+    void CountDropped(uint64_t n);
+
+    uint64_t start_ticks() const { return start_ticks_; }
+
+private:
+    void WriterLoop();
+    void WriteChunk(const Chunk& chunk);
+    void WriteHeader();
+
+    int fd_ = -1;
+    uint64_t capacity_ = 0;
+    uint64_t start_ticks_ = 0;
+    uint64_t written_ = 0; // writer thread only
+    std::atomic<uint64_t> dropped_{0};
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+    std::deque<Chunk*> full_;
+    std::vector<Chunk*> free_;
+    size_t max_chunks_ = 0;
+    bool closing_ = false;
+    std::thread writer_;
+};
+
+// One SPDK thread's open chunk. Owner thread only; whatever it holds goes to
+// the writer when it is destroyed, and the recorder closes its file once the
+// store and every thread's buffer have let go of it.
+class PageRecordBuffer {
+public:
+    ~PageRecordBuffer() {
+        if (chunk_) recorder_->Release(chunk_);
+    }
+
+    void Append(const std::shared_ptr<PageRecorder>& recorder, const PageRecord& record) {
+        if (!recorder_) recorder_ = recorder;
+        if (!chunk_ || chunk_->count == PageRecorder::kChunkRecords) {
+            chunk_ = recorder_->Exchange(chunk_);
+            if (!chunk_) {
+                recorder_->CountDropped(1);
+                return;
+            }
+        }
+        chunk_->records[chunk_->count++] = record;
+    }
+
+private:
+    std::shared_ptr<PageRecorder> recorder_;
+    PageRecorder::Chunk* chunk_ = nullptr;
+};
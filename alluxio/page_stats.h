@@ -0,0 +1,135 @@
+// page_stats.h
+// Operation counters and latency histograms of a PageStore.
+//
+// Every SPDK thread records into its own PageOpCounters, one cache-line
+// aligned block per operation kind, written only by that thread with plain
+// relaxed stores: the hot path takes no lock, does no atomic read-modify-write
+// and shares no cache line with another core. Readers sum the threads' blocks
+// into PageOpStats when asked.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class PageStatOp : uint8_t {
+    kRead,   // ReadPage, GetPage and each run of ReadPages
+    kWrite,  // WritePage, PutPage and each run of WritePages
+    kFlush,
+    kDelete, // DeletePage
+};
+constexpr size_t kNumPageStatOps = 4;
+
+inline const char* PageStatOpName(PageStatOp op) {
+    static constexpr const char* kNames[kNumPageStatOps] = {"read", "write", "flush", "delete"};
+    return kNames[static_cast<size_t>(op)];
+}
+
+// HDR-style log-linear latency buckets in nanoseconds: exact below 16 ns,
+// then 16 buckets per power of two, so a percentile is off by at most 6.25%.
+// Latencies beyond about four minutes share the last bucket.
+struct PageLatencyStats {
+    static constexpr unsigned kSubBits = 4;
+    static constexpr unsigned kMaxShift = 33;
+    static constexpr size_t kBuckets = (kMaxShift + 2) << kSubBits;
+
+    static size_t Bucket(uint64_t ns) {
+        if (ns < (1u << kSubBits)) return ns;
+        unsigned shift = 63 - __builtin_clzll(ns) - kSubBits;
+        if (shift > kMaxShift) return kBuckets - 1;
+        return ((shift + 1) << kSubBits) + ((ns >> shift) & ((1u << kSubBits) - 1));
+    }
+    // Largest latency that falls into bucket b.
+    static uint64_t BucketMax(size_t b) {
+        if (b < (1u << kSubBits)) return b;
+        unsigned shift = static_cast<unsigned>(b >> kSubBits) - 1;
+        uint64_t sub = (b & ((1u << kSubBits) - 1)) | (1u << kSubBits);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, kBuckets> buckets = {};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+
+    // Upper bound of the q-quantile (0 < q <= 1), capped at the maximum seen.
+    uint64_t Percentile(double q) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; b++) {
+            seen += buckets[b];
+            if (seen >= rank) return std::min(BucketMax(b), max_ns);
+        }
+        return max_ns;
+    }
+    uint64_t MeanNs() const { return count ? sum_ns / count : 0; }
+
+    PageLatencyStats& operator+=(const PageLatencyStats& o) {
+        for (size_t b = 0; b < kBuckets; b++) buckets[b] += o.buckets[b];
+        count += o.count;
+        sum_ns += o.sum_ns;
+        max_ns = std::max(max_ns, o.max_ns);
+        return *this;
+    }
+};
+
+struct PageOpStats {
+    uint64_t ops = 0;    // pages for reads and writes
+    uint64_t errors = 0; // operations that did not complete with kOk
+    uint64_t bytes = 0;
+    PageLatencyStats latency; // one sample per operation or batch run
+
+    PageOpStats& operator+=(const PageOpStats& o) {
+        ops += o.ops;
+        errors += o.errors;
+        bytes += o.bytes;
+        latency += o.latency;
+        return *this;
+    }
+};
+
+// One thread's counters for one operation kind.
+struct alignas(64) PageOpCounters {
+    std::atomic<uint64_t> ops{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, PageLatencyStats::kBuckets> buckets{};
+
+    // Owning thread only.
+    void Record(uint64_t ns, uint64_t pages, uint64_t nbytes, bool ok) {
+        Add(ops, pages);
+        if (!ok) Add(errors, 1);
+        Add(bytes, nbytes);
+        Add(sum_ns, ns);
+        if (ns > max_ns.load(std::memory_order_relaxed)) {
+            max_ns.store(ns, std::memory_order_relaxed);
+        }
+        Add(buckets[PageLatencyStats::Bucket(ns)], 1);
+    }
+
+    // Any thread.
+    void AddTo(PageOpStats& s) const {
+        s.ops += ops.load(std::memory_order_relaxed);
+        s.errors += errors.load(std::memory_order_relaxed);
+        s.bytes += bytes.load(std::memory_order_relaxed);
+        PageLatencyStats& l = s.latency;
+        for (size_t b = 0; b < PageLatencyStats::kBuckets; b++) {
+            uint64_t n = buckets[b].load(std::memory_order_relaxed);
+            l.buckets[b] += n;
+            l.count += n;
+        }
+        l.sum_ns += sum_ns.load(std::memory_order_relaxed);
+        l.max_ns = std::max(l.max_ns, max_ns.load(std::memory_order_relaxed));
+    }
+
+private:
+    static void Add(std::atomic<uint64_t>& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
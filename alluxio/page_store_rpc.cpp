@@ -0,0 +1,199 @@
+// page_store_rpc.cpp
+#include "page_store_rpc.h"
+
+#include <spdk/json.h>
+#include <spdk/jsonrpc.h>
+#include <spdk/rpc.h>
+#include <spdk/util.h>
+#include "spdk_pagestore_interface.h"
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Registry {
+    std::mutex mutex; // also keeps a listed store alive while it is read
+    std::vector<std::pair<std::string, const SpdkPageStore*>> stores;
+};
+
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+double Ratio(uint64_t part, uint64_t whole) {
+    return whole ? static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+void WriteClass(struct spdk_json_write_ctx* w, const char* name, const PageIoClassStats& c) {
+    spdk_json_write_named_object_begin(w, name);
+    spdk_json_write_named_uint64(w, "in_flight", c.in_flight);
+    spdk_json_write_named_uint64(w, "queued", c.queued);
+    spdk_json_write_named_uint64(w, "dispatched", c.dispatched);
+    spdk_json_write_named_uint64(w, "waited", c.waited);
+    spdk_json_write_named_uint64(w, "throttled", c.throttled);
+    spdk_json_write_named_uint64(w, "wait_us", c.wait_us);
+    spdk_json_write_named_uint64(w, "max_wait_us", c.max_wait_us);
+    spdk_json_write_object_end(w);
+}
+
+struct GetStatsParams {
+    char* name = nullptr;
+};
+
+const struct spdk_json_object_decoder kGetStatsDecoders[] = {
+    {"name", offsetof(GetStatsParams, name), spdk_json_decode_string, true},
+};
+
+} // namespace
+
+void RegisterPageStoreStats(const std::string& name, const SpdkPageStore* store) {
+    Registry& r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto& entry : r.stores) {
+        if (entry.second == store) {
+            entry.first = name;
+            return;
+        }
+    }
+    r.stores.emplace_back(name, store);
+}
+
+void UnregisterPageStoreStats(const SpdkPageStore* store) {
+    Registry& r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::erase_if(r.stores, [store](const auto& entry) { return entry.second == store; });
+}
+
+void WritePageLatencyStats(struct spdk_json_write_ctx* w, const PageLatencyStats& l) {
+    spdk_json_write_named_object_begin(w, "latency_us");
+    spdk_json_write_named_double(w, "mean", l.MeanNs() / 1e3);
+    spdk_json_write_named_double(w, "p50", l.Percentile(0.5) / 1e3);
+    spdk_json_write_named_double(w, "p90", l.Percentile(0.9) / 1e3);
+    spdk_json_write_named_double(w, "p99", l.Percentile(0.99) / 1e3);
+    spdk_json_write_named_double(w, "p99.9", l.Percentile(0.999) / 1e3);
+    spdk_json_write_named_double(w, "max", l.max_ns / 1e3);
+    spdk_json_write_object_end(w);
+}
+
+void WritePageStoreStats(struct spdk_json_write_ctx* w, const std::string& name,
+                         const SpdkPageStore& store) {
+    spdk_json_write_object_begin(w);
+    spdk_json_write_named_string(w, "name", name.c_str());
+    spdk_json_write_named_uint64(w, "pages", store.NumPages());
+
+    uint64_t reads = 0;
+    spdk_json_write_named_object_begin(w, "operations");
+    for (size_t i = 0; i < kNumPageStatOps; i++) {
+        auto op = static_cast<PageStatOp>(i);
+        PageOpStats s = store.GetOpStats(op);
+        if (op == PageStatOp::kRead) reads = s.ops;
+        spdk_json_write_named_object_begin(w, PageStatOpName(op));
+        spdk_json_write_named_uint64(w, "ops", s.ops);
+        spdk_json_write_named_uint64(w, "errors", s.errors);
+        spdk_json_write_named_uint64(w, "bytes", s.bytes);
+        WritePageLatencyStats(w, s.latency);
+        spdk_json_write_object_end(w);
+    }
+    spdk_json_write_object_end(w);
+
+    PageQueueStats q = store.GetQueueStats();
+    spdk_json_write_named_object_begin(w, "queue");
+    spdk_json_write_named_uint64(w, "in_flight", q.in_flight);
+    spdk_json_write_named_uint64(w, "queued", q.queued);
+    spdk_json_write_named_uint64(w, "peak_in_flight", q.peak_in_flight);
+    spdk_json_write_named_uint64(w, "peak_queued", q.peak_queued);
+    spdk_json_write_named_uint64(w, "waited", q.waited);
+    spdk_json_write_named_uint64(w, "enomem", q.enomem);
+    spdk_json_write_named_uint64(w, "wait_us", q.wait_us);
+    spdk_json_write_named_uint64(w, "max_wait_us", q.max_wait_us);
+    spdk_json_write_named_object_begin(w, "classes");
+    WriteClass(w, "read", q.classes[static_cast<size_t>(PageIoClass::kRead)]);
+    WriteClass(w, "fill", q.classes[static_cast<size_t>(PageIoClass::kFill)]);
+    WriteClass(w, "background", q.classes[static_cast<size_t>(PageIoClass::kBackground)]);
+    spdk_json_write_object_end(w);
+    spdk_json_write_object_end(w);
+
+    PageBufferPoolStats pool = store.GetBufferPoolStats();
+    spdk_json_write_named_object_begin(w, "buffer_pool");
+    spdk_json_write_named_uint64(w, "capacity", pool.capacity);
+    spdk_json_write_named_uint64(w, "in_use", pool.in_use);
+    spdk_json_write_named_double(w, "usage", Ratio(pool.in_use, pool.capacity));
+    spdk_json_write_named_uint64(w, "hits", pool.hits);
+    spdk_json_write_named_uint64(w, "misses", pool.misses);
+    spdk_json_write_named_uint64(w, "fallbacks", pool.fallbacks);
+    spdk_json_write_named_double(w, "hit_ratio", Ratio(pool.hits, pool.hits + pool.misses));
+    spdk_json_write_named_uint64(w, "request_heap_allocs", store.GetRequestAllocations());
+    spdk_json_write_object_end(w);
+
+    PageLookupStats lookup = store.GetLookupStats();
+    PageReadAheadStats ra = store.GetReadAheadStats();
+    spdk_json_write_named_object_begin(w, "cache");
+    spdk_json_write_named_uint64(w, "lookup_hits", lookup.hits);
+    spdk_json_write_named_uint64(w, "lookup_misses", lookup.misses);
+    spdk_json_write_named_double(w, "lookup_hit_ratio",
+                                 Ratio(lookup.hits, lookup.hits + lookup.misses));
+    spdk_json_write_named_uint64(w, "readahead_reads", ra.reads);
+    spdk_json_write_named_uint64(w, "readahead_pages", ra.pages);
+    spdk_json_write_named_uint64(w, "readahead_hits", ra.hits);
+    spdk_json_write_named_uint64(w, "readahead_stale", ra.stale);
+    spdk_json_write_named_uint64(w, "readahead_wasted", ra.wasted);
+    // Share of page reads served from staged pages.
+    spdk_json_write_named_double(w, "readahead_hit_ratio", Ratio(ra.hits, reads));
+    spdk_json_write_object_end(w);
+
+    PageEvictionStats ev = store.GetEvictionStats();
+    PageCompressionStats comp = store.GetCompressionStats();
+    PageIntegrityStats crc = store.GetIntegrityStats();
+    PageMetaJournalStats journal = store.GetJournalStats();
+    spdk_json_write_named_object_begin(w, "metadata");
+    spdk_json_write_named_uint64(w, "evicted", ev.evicted);
+    spdk_json_write_named_uint64(w, "direct_evictions", ev.direct);
+    spdk_json_write_named_uint64(w, "compressed", comp.compressed);
+    spdk_json_write_named_uint64(w, "incompressible", comp.incompressible);
+    spdk_json_write_named_uint64(w, "bytes_saved", comp.bytes_saved);
+    spdk_json_write_named_uint64(w, "crc_verified", crc.verified);
+    spdk_json_write_named_uint64(w, "crc_mismatches", crc.mismatches);
+    spdk_json_write_named_uint64(w, "journal_writes", journal.journal_writes);
+    spdk_json_write_named_uint64(w, "journal_records", journal.records);
+    spdk_json_write_named_uint64(w, "checkpoints", journal.checkpoints);
+    spdk_json_write_named_uint64(w, "journal_stalls", journal.stalls);
+    spdk_json_write_object_end(w);
+
+    spdk_json_write_object_end(w);
+}
+
+static void rpc_pagestore_get_stats(struct spdk_jsonrpc_request* request,
+                                    const struct spdk_json_val* params) {
+    GetStatsParams req;
+    if (params && spdk_json_decode_object(params, kGetStatsDecoders,
+                                          SPDK_COUNTOF(kGetStatsDecoders), &req)) {
+        spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+                                         "Invalid parameters");
+        free(req.name);
+        return;
+    }
+    std::string name = req.name ? req.name : "";
+    free(req.name);
+
+    Registry& r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool found = name.empty();
+    for (const auto& entry : r.stores) found = found || entry.first == name;
+    if (!found) {
+        spdk_jsonrpc_send_error_response(request, -ENODEV, "No such PageStore");
+        return;
+    }
+    struct spdk_json_write_ctx* w = spdk_jsonrpc_begin_result(request);
+    spdk_json_write_object_begin(w);
+    spdk_json_write_named_array_begin(w, "stores");
+    for (const auto& [storeName, store] : r.stores) {
+        if (name.empty() || storeName == name) WritePageStoreStats(w, storeName, *store);
+    }
+    spdk_json_write_array_end(w);
+    spdk_json_write_object_end(w);
+    spdk_jsonrpc_end_result(request, w);
+}
+SPDK_RPC_REGISTER("pagestore_get_stats", rpc_pagestore_get_stats, SPDK_RPC_RUNTIME)
@@ -0,0 +1,29 @@
+// page_store_rpc.h
+// The pagestore_get_stats JSON-RPC method.
+//
+// An SpdkPageStore lists itself under its bdev name once Init has recovered
+// it and drops out when Close starts. The method merges the per-thread
+// counters of the listed stores on the RPC thread, so scraping it adds
+// nothing to the I/O path. Optional params: {"name": "<bdev>"} picks one
+// store.
+//
+//   echo '{"jsonrpc":"2.0","method":"pagestore_get_stats","id":1}' | nc -U /var/tmp/spdk.sock
+
+#pragma once
+
+#include <string>
+
+class SpdkPageStore;
+struct PageLatencyStats;
+struct spdk_json_write_ctx;
+
+void RegisterPageStoreStats(const std::string& name, const SpdkPageStore* store);
+void UnregisterPageStoreStats(const SpdkPageStore* store);
+
+// Writes l as a "latency_us" member: mean, p50, p90, p99, p99.9 and max.
+void WritePageLatencyStats(struct spdk_json_write_ctx* w, const PageLatencyStats& l);
+
+// Writes one store's stats as the JSON object pagestore_get_stats returns for
+// it; latencies are in microseconds.
+void WritePageStoreStats(struct spdk_json_write_ctx* w, const std::string& name,
+                         const SpdkPageStore& store);
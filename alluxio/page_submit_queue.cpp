@@ -0,0 +1,332 @@
+// page_submit_queue.cpp
+#include "page_submit_queue.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace {
+
+// Submissions popped from a ring at once.
+constexpr size_t kPopChunk = 32;
+
+} // namespace
+
+PageSubmitQueue::Producer::Producer(PageSubmitQueue* queue, Poller* poller, uint32_t depth)
+    : queue_(queue), poller_(poller), sq_(depth), cq_(depth), ctxs_(depth) {
+    for (OpCtx& ctx : ctxs_) {
+        ctx.producer = this;
+        ctx.next_free = free_ctxs_;
+        free_ctxs_ = &ctx;
+    }
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+PageSubmitQueue::Producer::~Producer() {
+    if (event_fd_ >= 0) close(event_fd_);
+}
+
+size_t PageSubmitQueue::Producer::Submit(std::span<const PageSubmission> batch) {
+    // Pairs with Stop and the poller's final pass: either this sees
+    // stopping_, or the poller sees submitting_ (or the pushed entries) and
+    // does not stop before serving them.
+    submitting_.store(true, std::memory_order_seq_cst);
+    if (queue_->stopping_.load(std::memory_order_seq_cst)) {
+        submitting_.store(false, std::memory_order_release);
+        return 0;
+    }
+    size_t room = ctxs_.size() - Outstanding();
+    size_t n = sq_.Push(batch.first(std::min(batch.size(), room)));
+    submitted_ += n;
+    submitting_.store(false, std::memory_order_release);
+    return n;
+}
+
+size_t PageSubmitQueue::Producer::Reap(std::span<PageCompletion> out) {
+    size_t n = cq_.Pop(out);
+    reaped_ += n;
+    return n;
+}
+
+void PageSubmitQueue::Producer::ArmWakeup() {
+    wants_wakeup_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in WakeProducer: either the poller sees the flag, or
+    // the Reap that follows sees its completion.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+size_t PageSubmitQueue::Producer::Wait(std::span<PageCompletion> out, int timeoutMs) {
+    size_t n = Reap(out);
+    while (n == 0 && !out.empty()) {
+        ArmWakeup();
+        if ((n = Reap(out)) != 0) break;
+        struct pollfd pfd = {event_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) > 0) {
+            uint64_t count;
+            (void)read(event_fd_, &count, sizeof(count));
+        }
+        n = Reap(out);
+        // A wakeup armed by an earlier Wait may have fired with nothing new;
+        // only a bounded wait gives up on that.
+        if (timeoutMs >= 0) break;
+    }
+    return n;
+}
+
+PageSubmitQueue::PageSubmitQueue(PageStore& store, const KeyedOps* keyed,
+                                 const PageSubmitQueueOptions& opts)
+    : store_(store), keyed_(keyed), opts_(opts) {
+    opts_.queue_depth = std::max<uint32_t>(1, opts_.queue_depth);
+    opts_.poll_batch = std::max<uint32_t>(1, opts_.poll_batch);
+}
+
+PageSubmitQueue::~PageSubmitQueue() {
+    for (Producer* p : producers_) delete p;
+}
+
+bool PageSubmitQueue::Start(const std::vector<struct spdk_thread*>& threads) {
+    if (threads.empty() || !pollers_.empty()) {
+        std::cerr << "SPDK: Submit queue needs a non-empty thread list and a single Start"
+                  << std::endl;
+        return false;
+    }
+    for (struct spdk_thread* thread : threads) {
+        auto poller = std::make_unique<Poller>();
+        poller->queue = this;
+        poller->thread = thread;
+        pollers_.push_back(std::move(poller));
+    }
+    pollers_running_.store(pollers_.size(), std::memory_order_relaxed);
+    for (auto& poller : pollers_) {
+        if (spdk_thread_send_msg(poller->thread, StartPollerMsg, poller.get()) != 0) {
+            std::cerr << "SPDK: Failed to start submit queue poller" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void PageSubmitQueue::StartPollerMsg(void* arg) {
+    auto poller = static_cast<Poller*>(arg);
+    if (poller->stopping) return;
+    poller->poller = SPDK_POLLER_REGISTER(Poll, poller, 0);
+    if (!poller->poller) {
+        std::cerr << "SPDK: Failed to register submit queue poller" << std::endl;
+    }
+}
+
+void PageSubmitQueue::Stop(IoCallback cb) {
+    stopping_.store(true, std::memory_order_seq_cst);
+    stop_cb_ = std::move(cb);
+    stop_thread_ = spdk_get_thread();
+    if (pollers_.empty()) {
+        stop_cb_(true);
+        return;
+    }
+    for (auto& poller : pollers_) {
+        if (spdk_thread_send_msg(poller->thread, StopPollerMsg, poller.get()) != 0) {
+            StopPollerMsg(poller.get());
+        }
+    }
+}
+
+void PageSubmitQueue::StopPollerMsg(void* arg) {
+    auto poller = static_cast<Poller*>(arg);
+    poller->stopping = true;
+    // Without a registered poller nothing was ever served here.
+    if (!poller->poller) poller->queue->StopPoller(poller);
+}
+
+void PageSubmitQueue::StopPoller(Poller* poller) {
+    if (poller->poller) spdk_poller_unregister(&poller->poller);
+    if (pollers_running_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    if (stop_thread_ == spdk_get_thread() ||
+        spdk_thread_send_msg(stop_thread_, StopDoneMsg, this) != 0) {
+        StopDoneMsg(this);
+    }
+}
+
+void PageSubmitQueue::StopDoneMsg(void* arg) {
+    auto self = static_cast<PageSubmitQueue*>(arg);
+    IoCallback cb = std::move(self->stop_cb_);
+    cb(true);
+}
+
+PageSubmitQueue::Producer* PageSubmitQueue::Register() {
+    if (pollers_.empty() || stopping_.load(std::memory_order_relaxed)) return nullptr;
+    Poller* poller =
+        pollers_[next_poller_.fetch_add(1, std::memory_order_relaxed) % pollers_.size()].get();
+    auto p = new Producer(this, poller, opts_.queue_depth);
+    if (p->event_fd_ < 0) {
+        std::cerr << "SPDK: Failed to create submit queue eventfd" << std::endl;
+        delete p;
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        producers_.insert(p);
+    }
+    // The poller adopts it on its next pass.
+    Producer* head = poller->incoming.load(std::memory_order_relaxed);
+    do {
+        p->next_ = head;
+    } while (!poller->incoming.compare_exchange_weak(head, p, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed));
+    return p;
+}
+
+void PageSubmitQueue::Unregister(Producer* producer) {
+    // The poller may free it as soon as this is visible.
+    producer->closed_.store(true, std::memory_order_release);
+}
+
+void PageSubmitQueue::Release(Producer* p) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        producers_.erase(p);
+    }
+    delete p;
+}
+
+int PageSubmitQueue::Poll(void* arg) {
+    auto poller = static_cast<Poller*>(arg);
+    PageSubmitQueue* self = poller->queue;
+
+    Producer* adopted = poller->incoming.exchange(nullptr, std::memory_order_acquire);
+    while (adopted) {
+        Producer* next = adopted->next_;
+        adopted->next_ = poller->producers;
+        poller->producers = adopted;
+        adopted = next;
+    }
+
+    size_t work = 0;
+    bool drained = true;
+    for (Producer** link = &poller->producers; Producer* p = *link;) {
+        bool closed = p->closed_.load(std::memory_order_acquire);
+        // Read before the ring: once it is clear, whatever Submit pushed is
+        // visible to the Pop below.
+        bool submitting = p->submitting_.load(std::memory_order_seq_cst);
+        work += self->ServeProducer(p);
+        if (p->wake_pending_) WakeProducer(p);
+        bool idle = !submitting && p->in_flight_ == 0 && p->sq_.Empty();
+        if (closed && idle) {
+            *link = p->next_;
+            self->Release(p);
+            continue;
+        }
+        drained = drained && idle;
+        link = &p->next_;
+    }
+
+    // A producer registered before Stop may not be adopted yet.
+    if (poller->stopping && drained && !poller->incoming.load(std::memory_order_seq_cst)) {
+        self->StopPoller(poller);
+        return SPDK_POLLER_IDLE;
+    }
+    return work ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+}
+
+size_t PageSubmitQueue::ServeProducer(Producer* p) {
+    size_t taken = 0;
+    PageSubmission batch[kPopChunk];
+    while (taken < opts_.poll_batch) {
+        size_t want = std::min<size_t>(kPopChunk, opts_.poll_batch - taken);
+        size_t n = p->sq_.Pop(std::span(batch, want));
+        // Outstanding submissions never exceed queue_depth, so every popped
+        // entry has a free context.
+        for (size_t i = 0; i < n; i++) {
+            Producer::OpCtx* ctx = p->free_ctxs_;
+            p->free_ctxs_ = ctx->next_free;
+            p->in_flight_++;
+            Dispatch(ctx, batch[i]);
+        }
+        taken += n;
+        if (n < want) break;
+    }
+    if (taken) Bump(p->poller_->submitted, taken);
+    return taken;
+}
+
+void PageSubmitQueue::Dispatch(Producer::OpCtx* ctx, const PageSubmission& s) {
+    ctx->user_data = s.user_data;
+    IoCallback cb(OnOpDone, ctx);
+    switch (s.op) {
+    case PageSubmitOp::kRead:
+        store_.ReadPage(s.pageId, s.buf, std::move(cb));
+        return;
+    case PageSubmitOp::kWrite:
+        store_.WritePage(s.pageId, s.buf, std::move(cb));
+        return;
+    case PageSubmitOp::kFlush:
+        store_.Flush(std::move(cb));
+        return;
+    case PageSubmitOp::kGet:
+        if (!keyed_) break;
+        keyed_->get(&store_, s.key, s.buf, std::move(cb));
+        return;
+    case PageSubmitOp::kPut:
+        if (!keyed_) break;
+        keyed_->put(&store_, s.key, s.buf, std::move(cb));
+        return;
+    case PageSubmitOp::kDelete:
+        if (!keyed_) break;
+        keyed_->del(&store_, s.key, std::move(cb));
+        return;
+    }
+    cb(IoStatus::kIoError);
+}
+
+void PageSubmitQueue::OnOpDone(void* arg, IoStatus status) {
+    auto ctx = static_cast<Producer::OpCtx*>(arg);
+    ctx->status = status;
+    // The completion ring has a single writer: the poller's thread.
+    struct spdk_thread* thread = ctx->producer->poller_->thread;
+    if (spdk_get_thread() != thread) {
+        if (spdk_thread_send_msg(thread, CompleteMsg, ctx) == 0) return;
+        std::cerr << "SPDK: Completing submit queue entry off its poller thread" << std::endl;
+    }
+    CompleteMsg(ctx);
+}
+
+void PageSubmitQueue::CompleteMsg(void* arg) {
+    auto ctx = static_cast<Producer::OpCtx*>(arg);
+    Producer* p = ctx->producer;
+    Poller* poller = p->poller_;
+    // Cannot fail: completions pending or unreaped never exceed queue_depth.
+    p->cq_.Push(PageCompletion{ctx->user_data, ctx->status});
+    ctx->next_free = p->free_ctxs_;
+    p->free_ctxs_ = ctx;
+    p->in_flight_--;
+    Bump(poller->completed);
+
+    // The eventfd is written on the poller's next pass, so completions that
+    // arrive together cost the producer a single wakeup.
+    p->wake_pending_ = true;
+}
+
+void PageSubmitQueue::WakeProducer(Producer* p) {
+    p->wake_pending_ = false;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (p->wants_wakeup_.load(std::memory_order_relaxed) &&
+        p->wants_wakeup_.exchange(false, std::memory_order_relaxed)) {
+        uint64_t one = 1;
+        (void)write(p->event_fd_, &one, sizeof(one));
+        Bump(p->poller_->wakeups);
+    }
+}
+
+PageSubmitQueueStats PageSubmitQueue::GetStats() const {
+    PageSubmitQueueStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.producers = producers_.size();
+    }
+    for (const auto& poller : pollers_) {
+        stats.submitted += poller->submitted.load(std::memory_order_relaxed);
+        stats.completed += poller->completed.load(std::memory_order_relaxed);
+        stats.wakeups += poller->wakeups.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,297 @@
+// page_submit_queue.h
+// Submission front-end for threads that are not SPDK threads.
+//
+// PageStore calls must come from SPDK threads, because bdev channels belong
+// to the thread that opened them. Application threads (e.g. Alluxio worker
+// threads) instead register a Producer, which owns one single-producer ring of
+// submissions and one single-consumer ring of completions. Every producer is
+// served by one SPDK poller, which drains its ring in batches and submits to
+// the store from the poller's thread; completions are pushed back onto the
+// producer's completion ring. Both rings are plain SPSC index pairs, so a
+// submission costs a few stores and never a spdk_thread_send_msg. A producer
+// that wants to sleep arms its eventfd first, and only then does the poller
+// write to it.
+
+#pragma once
+
+#include <spdk/thread.h>
+#include "io_callback.h"
+#include "page_index.h"
+#include "spdk_pagestore_interface.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+// Bounded lock-free ring for exactly one producer and one consumer thread.
+// Each side caches the other's index, so the shared cache lines are only
+// touched when the cached value says the ring looks full or empty.
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two.
+    explicit SpscRing(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        slots_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    // Producer only. Pushes as many entries as fit and returns that count.
+    size_t Push(std::span<const T> items) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t room = slots_.size() - (tail - head_cache_);
+        if (room < items.size()) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            room = slots_.size() - (tail - head_cache_);
+        }
+        size_t n = items.size() < room ? items.size() : room;
+        for (size_t i = 0; i < n; i++) slots_[(tail + i) & mask_] = items[i];
+        if (n) tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+    bool Push(const T& item) { return Push(std::span<const T>(&item, 1)) == 1; }
+
+    // Consumer only. Pops up to out.size() entries and returns that count.
+    size_t Pop(std::span<T> out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t avail = tail_cache_ - head;
+        if (avail < out.size()) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            avail = tail_cache_ - head;
+        }
+        size_t n = out.size() < avail ? out.size() : avail;
+        for (size_t i = 0; i < n; i++) out[i] = slots_[(head + i) & mask_];
+        if (n) head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Either side; exact only on the consumer.
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+    size_t Capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0}; // next entry to pop
+    size_t tail_cache_ = 0;                   // consumer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0}; // next free entry
+    size_t head_cache_ = 0;                   // producer's view of head_
+};
+
+enum class PageSubmitOp : uint8_t {
+    kRead,   // ReadPage(pageId, buf)
+    kWrite,  // WritePage(pageId, buf)
+    kFlush,  // Flush()
+    kGet,    // GetPage(key, buf)
+    kPut,    // PutPage(key, buf)
+    kDelete, // DeletePage(key)
+};
+
+struct PageSubmission {
+    PageSubmitOp op;
+    uint64_t pageId;    // kRead, kWrite
+    PageKey key;        // kGet, kPut, kDelete
+    void* buf;          // must stay valid until the completion is reaped
+    uint64_t user_data; // returned unchanged in the completion
+};
+
+struct PageCompletion {
+    uint64_t user_data;
+    IoStatus status;
+};
+
+struct PageSubmitQueueOptions {
+    // Submissions a producer may have outstanding, i.e. not yet reaped. Sizes
+    // both of its rings.
+    uint32_t queue_depth = 256;
+    // Submissions taken from one producer per poller pass, so a busy producer
+    // cannot starve the others on its poller.
+    uint32_t poll_batch = 64;
+};
+
+struct PageSubmitQueueStats {
+    uint64_t producers = 0;
+    uint64_t submitted = 0; // handed to the store by the pollers
+    uint64_t completed = 0; // pushed back onto completion rings
+    uint64_t wakeups = 0;   // eventfd writes to sleeping producers
+};
+
+class PageSubmitQueue {
+    struct Poller;
+
+public:
+    // Keyed submissions need a store with PutPage/GetPage/DeletePage
+    // (SpdkPageStore, StripedPageStore); on other stores they complete with
+    // kIoError.
+    template <typename Store>
+    explicit PageSubmitQueue(Store& store, const PageSubmitQueueOptions& opts = {})
+        : PageSubmitQueue(store, KeyedOpsFor<Store>(), opts) {}
+    // Stop must have completed.
+    ~PageSubmitQueue();
+
+    PageSubmitQueue(const PageSubmitQueue&) = delete;
+    PageSubmitQueue& operator=(const PageSubmitQueue&) = delete;
+
+    // Starts one poller on each of threads; producers are spread over them
+    // round-robin. Call once, from any thread, after the store's Init.
+    bool Start(const std::vector<struct spdk_thread*>& threads);
+    // Rejects new submissions, lets the pollers finish everything already
+    // queued and in flight, and unregisters them. cb runs on the calling
+    // thread, which must be an SPDK thread.
+    void Stop(IoCallback cb);
+
+    // One producer's end of the queue. Every method must be called from the
+    // thread that registered it.
+    class Producer {
+    public:
+        // Returns how many leading entries were queued; fewer than asked once
+        // queue_depth submissions are outstanding or the queue is stopping.
+        size_t Submit(std::span<const PageSubmission> batch);
+        bool Submit(const PageSubmission& s) { return Submit(std::span(&s, 1)) == 1; }
+        // Non-blocking; returns the number of completions copied to out.
+        size_t Reap(std::span<PageCompletion> out);
+        // Like Reap, but sleeps on the eventfd until at least one completion
+        // is ready or timeoutMs passes (-1 waits forever).
+        size_t Wait(std::span<PageCompletion> out, int timeoutMs = -1);
+        // For epoll loops: ArmWakeup(), then Reap() once more before sleeping,
+        // since completions pushed before arming do not signal the fd.
+        int EventFd() const { return event_fd_; }
+        void ArmWakeup();
+        // Submitted and not yet reaped.
+        size_t Outstanding() const { return submitted_ - reaped_; }
+
+    private:
+        friend class PageSubmitQueue;
+
+        struct OpCtx {
+            Producer* producer;
+            uint64_t user_data;
+            IoStatus status;
+            OpCtx* next_free;
+        };
+
+        Producer(PageSubmitQueue* queue, Poller* poller, uint32_t depth);
+        ~Producer();
+
+        PageSubmitQueue* queue_;
+        Poller* poller_;
+        SpscRing<PageSubmission> sq_;
+        SpscRing<PageCompletion> cq_;
+        int event_fd_ = -1;
+        std::atomic<bool> wants_wakeup_{false};
+        std::atomic<bool> closed_{false};
+        std::atomic<bool> submitting_{false}; // inside Submit; see Stop
+        // Producer thread only.
+        uint64_t submitted_ = 0;
+        uint64_t reaped_ = 0;
+        // Poller thread only.
+        std::vector<OpCtx> ctxs_;
+        OpCtx* free_ctxs_ = nullptr;
+        size_t in_flight_ = 0;
+        bool wake_pending_ = false; // completions pushed since the last wakeup check
+        Producer* next_ = nullptr;
+    };
+
+    // Any thread. The producer is released by its poller once Unregister has
+    // been called and its in-flight submissions have completed; completions
+    // not yet reaped are dropped.
+    Producer* Register();
+    void Unregister(Producer* producer);
+
+    PageSubmitQueueStats GetStats() const;
+
+private:
+    struct KeyedOps {
+        void (*put)(PageStore* store, const PageKey& key, const void* data, IoCallback cb);
+        void (*get)(PageStore* store, const PageKey& key, void* buffer, IoCallback cb);
+        void (*del)(PageStore* store, const PageKey& key, IoCallback cb);
+    };
+
+    struct Poller {
+        PageSubmitQueue* queue;
+        struct spdk_thread* thread = nullptr;
+        struct spdk_poller* poller = nullptr;
+        Producer* producers = nullptr;                // poller thread only
+        std::atomic<Producer*> incoming{nullptr};     // registered, not yet adopted
+        bool stopping = false;
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> wakeups{0};
+    };
+
+    template <typename Store>
+    static const KeyedOps* KeyedOpsFor() {
+        if constexpr (requires(Store& s, const PageKey& k, void* b) {
+                          s.PutPage(k, b, IoCallback());
+                          s.GetPage(k, b, IoCallback());
+                          s.DeletePage(k, IoCallback());
+                      }) {
+            static constexpr KeyedOps ops = {
+                [](PageStore* s, const PageKey& k, const void* d, IoCallback cb) {
+                    static_cast<Store*>(s)->PutPage(k, d, std::move(cb));
+                },
+                [](PageStore* s, const PageKey& k, void* b, IoCallback cb) {
+                    static_cast<Store*>(s)->GetPage(k, b, std::move(cb));
+                },
+                [](PageStore* s, const PageKey& k, IoCallback cb) {
+                    static_cast<Store*>(s)->DeletePage(k, std::move(cb));
+                },
+            };
+            return &ops;
+        } else {
+            return nullptr;
+        }
+    }
+
+    PageSubmitQueue(PageStore& store, const KeyedOps* keyed, const PageSubmitQueueOptions& opts);
+
+    // Owner-only counter bump; readers may observe it from any thread.
+    static void Bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void Dispatch(Producer::OpCtx* ctx, const PageSubmission& s);
+    // Drains one producer; returns the number of submissions taken.
+    size_t ServeProducer(Producer* p);
+    void Release(Producer* p);
+    static void WakeProducer(Producer* p);
+    void StopPoller(Poller* poller);
+
+    static int Poll(void* arg);
+    static void StartPollerMsg(void* arg);
+    static void StopPollerMsg(void* arg);
+    static void StopDoneMsg(void* arg);
+    static void OnOpDone(void* arg, IoStatus status);
+    static void CompleteMsg(void* arg);
+
+    PageStore& store_;
+    const KeyedOps* keyed_;
+    PageSubmitQueueOptions opts_;
+    std::vector<std::unique_ptr<Poller>> pollers_;
+    std::atomic<size_t> next_poller_{0};
+    std::atomic<bool> stopping_{false};
+
+    mutable std::mutex mutex_; // guards producers_
+    std::unordered_set<Producer*> producers_;
+
+    IoCallback stop_cb_;
+    struct spdk_thread* stop_thread_ = nullptr;
+    std::atomic<size_t> pollers_running_{0};
+};
+
+// Usage Example (on an application thread):
+//
+// PageSubmitQueue queue(store);
+// queue.Start({spdk_thread_a, spdk_thread_b});   // once, after store.Init
+//
+// PageSubmitQueue::Producer* p = queue.Register();
+// p->Submit(PageSubmission{PageSubmitOp::kWrite, 7, {}, data, /*user_data=*/1});
+// PageCompletion done[16];
+// size_t n = p->Wait(done);                      // blocks on the eventfd
+// queue.Unregister(p);
@@ -0,0 +1,51 @@
+// page_task.cpp
+#include "page_task.h"
+#include <new>
+
+thread_local CoroFramePool::Cache CoroFramePool::cache_;
+
+CoroFramePool::Cache::~Cache() {
+    for (FreeNode*& head : heads) {
+        while (head) {
+            FreeNode* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+}
+
+void* CoroFramePool::Allocate(size_t size) {
+    if (size == 0 || size > kMaxFrameSize) {
+        cache_.stats.misses++;
+        return ::operator new(size);
+    }
+    size_t cls = (size - 1) / kClassSize;
+    if (FreeNode* node = cache_.heads[cls]) {
+        cache_.heads[cls] = node->next;
+        cache_.counts[cls]--;
+        cache_.stats.hits++;
+        cache_.stats.cached--;
+        return node;
+    }
+    // Round up to the class size so the frame can serve any size in its class.
+    cache_.stats.misses++;
+    return ::operator new((cls + 1) * kClassSize);
+}
+
+void CoroFramePool::Free(void* frame, size_t size) noexcept {
+    if (!frame) return;
+    size_t cls = (size - 1) / kClassSize;
+    if (size == 0 || size > kMaxFrameSize || cache_.counts[cls] >= kMaxCachedPerClass) {
+        ::operator delete(frame);
+        return;
+    }
+    auto node = static_cast<FreeNode*>(frame);
+    node->next = cache_.heads[cls];
+    cache_.heads[cls] = node;
+    cache_.counts[cls]++;
+    cache_.stats.cached++;
+}
+
+CoroFramePoolStats CoroFramePool::GetStats() {
+    return cache_.stats;
+}
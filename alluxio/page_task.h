@@ -0,0 +1,276 @@
+// page_task.h
+// C++20 coroutines over the PageStore callback API.
+//
+// A PageTask is a lazily started coroutine; co_await on a store operation
+// submits it with an allocation-free IoCallback and suspends until that
+// callback fires. The stores complete on the submitting SPDK thread, so the
+// coroutine is resumed right inside the completion with no message hop; a
+// completion that does arrive elsewhere is sent back to the submitting thread
+// first. Coroutine frames come from a per-thread free list, so a steady-state
+// pipeline does no heap allocation per operation.
+
+#pragma once
+
+#include <spdk/thread.h>
+#include "io_callback.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+struct CoroFramePoolStats {
+    uint64_t hits = 0;   // frames served from the thread's free list
+    uint64_t misses = 0; // frames taken from the heap
+    uint64_t cached = 0; // frames currently parked on the free list
+};
+
+// Size-classed free lists of coroutine frames, one set per thread. A frame
+// freed on another thread than the one that allocated it simply joins that
+// thread's lists. Frames above kMaxFrameSize always use the heap.
+class CoroFramePool {
+public:
+    static constexpr size_t kClassSize = 64;
+    static constexpr size_t kMaxFrameSize = 4096;
+    // Frames kept per size class before further frees go back to the heap.
+    static constexpr size_t kMaxCachedPerClass = 1024;
+
+    static void* Allocate(size_t size);
+    static void Free(void* frame, size_t size) noexcept;
+    // Counters of the calling thread.
+    static CoroFramePoolStats GetStats();
+
+private:
+    static constexpr size_t kNumClasses = kMaxFrameSize / kClassSize;
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct Cache {
+        ~Cache();
+        FreeNode* heads[kNumClasses] = {};
+        size_t counts[kNumClasses] = {};
+        CoroFramePoolStats stats;
+    };
+
+    static thread_local Cache cache_;
+};
+
+template <typename T>
+class PageTask;
+
+namespace page_task_detail {
+
+struct PromiseBase {
+    static void* operator new(size_t size) { return CoroFramePool::Allocate(size); }
+    static void operator delete(void* frame, size_t size) noexcept {
+        CoroFramePool::Free(frame, size);
+    }
+
+    // Hands control to whoever awaited the task, or frees a detached task.
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            PromiseBase& p = h.promise();
+            if (p.detached) {
+                h.destroy();
+                return std::noop_coroutine();
+            }
+            return p.continuation ? p.continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    // The store paths do not throw; an escaping exception is a bug.
+    void unhandled_exception() const noexcept { std::terminate(); }
+
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    PageTask<T> get_return_object();
+    template <typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+    std::optional<T> value;
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    PageTask<void> get_return_object();
+    void return_void() const noexcept {}
+};
+
+} // namespace page_task_detail
+
+// Move-only handle to a coroutine that has not run yet. co_await starts it
+// and resumes the awaiter, by symmetric transfer, once it returns; Spawn runs
+// it without an awaiter. The awaited value is moved out of the task.
+template <typename T = void>
+class [[nodiscard]] PageTask {
+public:
+    using promise_type = page_task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    PageTask() = default;
+    explicit PageTask(Handle h) : h_(h) {}
+    PageTask(PageTask&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    PageTask& operator=(PageTask&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    PageTask(const PageTask&) = delete;
+    PageTask& operator=(const PageTask&) = delete;
+    ~PageTask() {
+        if (h_) h_.destroy();
+    }
+
+    bool Done() const { return !h_ || h_.done(); }
+
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            Handle h;
+            bool await_ready() const noexcept { return !h || h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                h.promise().continuation = awaiting;
+                return h;
+            }
+            T await_resume() {
+                if constexpr (!std::is_void_v<T>) return std::move(*h.promise().value);
+            }
+        };
+        return Awaiter{h_};
+    }
+
+    // Starts the coroutine on the calling thread and lets it free itself when
+    // it returns. Used by Spawn.
+    void Detach() {
+        Handle h = std::exchange(h_, {});
+        h.promise().detached = true;
+        h.resume();
+    }
+
+private:
+    Handle h_;
+};
+
+namespace page_task_detail {
+
+template <typename T>
+PageTask<T> Promise<T>::get_return_object() {
+    return PageTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline PageTask<void> Promise<void>::get_return_object() {
+    return PageTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace page_task_detail
+
+// Awaitable for one store operation. Submit receives the IoCallback to pass to
+// the store and is called from await_suspend; co_await yields the IoStatus.
+// A completion reported before the submit call returns (e.g. a rejected
+// request) does not suspend at all.
+class IoAwaitable {
+public:
+    using Submit = InplaceCallback<void(IoCallback)>;
+
+    explicit IoAwaitable(Submit submit) : submit_(std::move(submit)) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        handle_ = h;
+        thread_ = spdk_get_thread();
+        submit_(IoCallback(OnComplete, this));
+        // If the completion already ran, carry on without suspending.
+        return state_.exchange(kSuspended, std::memory_order_acq_rel) != kCompleted;
+    }
+    IoStatus await_resume() const noexcept { return status_; }
+
+private:
+    enum State : uint8_t { kSubmitting, kSuspended, kCompleted };
+
+    static void OnComplete(void* arg, IoStatus status) {
+        auto self = static_cast<IoAwaitable*>(arg);
+        self->status_ = status;
+        if (self->state_.exchange(kCompleted, std::memory_order_acq_rel) == kSubmitting) return;
+        if (self->thread_ && spdk_get_thread() != self->thread_ &&
+            spdk_thread_send_msg(self->thread_, ResumeMsg, self) == 0) {
+            return;
+        }
+        self->handle_.resume();
+    }
+    static void ResumeMsg(void* arg) { static_cast<IoAwaitable*>(arg)->handle_.resume(); }
+
+    Submit submit_;
+    std::coroutine_handle<> handle_;
+    struct spdk_thread* thread_ = nullptr;
+    IoStatus status_;
+    std::atomic<uint8_t> state_{kSubmitting};
+};
+
+// Runs a task on the calling SPDK thread without awaiting it.
+inline void Spawn(PageTask<void> task) {
+    task.Detach();
+}
+
+namespace page_task_detail {
+
+template <typename T>
+PageTask<void> RunThen(PageTask<T> task, InplaceCallback<void(T)> done) {
+    done(co_await task);
+}
+
+} // namespace page_task_detail
+
+// Same, reporting the task's result to done, e.g. to hand a pipeline's
+// IoStatus back to callback-style code.
+template <typename T>
+void Spawn(PageTask<T> task, std::type_identity_t<InplaceCallback<void(T)>> done) {
+    page_task_detail::RunThen(std::move(task), std::move(done)).Detach();
+}
+
+// Starts every task at once and resumes the awaiter when all have returned,
+// with kOk only if all of them succeeded (else the first failure seen). The
+// tasks must be awaited from the thread they run on.
+class WhenAll {
+public:
+    explicit WhenAll(std::span<PageTask<IoStatus>> tasks) : tasks_(tasks) {}
+
+    bool await_ready() const noexcept { return tasks_.empty(); }
+    bool await_suspend(std::coroutine_handle<> h) {
+        handle_ = h;
+        // One extra share, dropped below, so a task that finishes inline
+        // cannot resume the awaiter before every task has started.
+        pending_ = tasks_.size() + 1;
+        for (auto& task : tasks_) Join(task, this).Detach();
+        return --pending_ != 0;
+    }
+    IoStatus await_resume() const noexcept { return status_; }
+
+private:
+    static PageTask<void> Join(PageTask<IoStatus>& task, WhenAll* all) {
+        IoStatus status = co_await task;
+        if (!status && all->status_) all->status_ = status;
+        if (--all->pending_ == 0) all->handle_.resume();
+    }
+
+    std::span<PageTask<IoStatus>> tasks_;
+    std::coroutine_handle<> handle_;
+    size_t pending_ = 0;
+    IoStatus status_;
+};
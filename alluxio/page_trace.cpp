@@ -0,0 +1,45 @@
+// page_trace.cpp
+#include "page_trace.h"
+
+#include <spdk/util.h>
+
+namespace {
+
+constexpr uint8_t kInt = SPDK_TRACE_ARG_TYPE_INT;
+
+} // namespace
+
+SPDK_TRACE_REGISTER_FN(RegisterPageStoreTracepoints, "pagestore", TRACE_GROUP_PAGESTORE)
+
+static void RegisterPageStoreTracepoints(void) {
+    using enum PageTraceOp;
+    using enum PageTraceStage;
+    // Trace ids are plain object ids, not SPDK trace objects.
+    struct spdk_trace_tpoint_opts opts[] = {
+        {"PS_READ_SUBMIT", PageTracepoint(kRead, kSubmit), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"page", kInt, 8}}},
+        {"PS_READ_BDEV_SUBMIT", PageTracepoint(kRead, kBdevSubmit), OWNER_TYPE_NONE, OBJECT_NONE,
+         0, {{"offset", kInt, 8}}},
+        {"PS_READ_BDEV_DONE", PageTracepoint(kRead, kBdevDone), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"success", kInt, 8}}},
+        {"PS_READ_CB_DONE", PageTracepoint(kRead, kCallbackDone), OWNER_TYPE_NONE, OBJECT_NONE,
+         0, {{"status", kInt, 8}}},
+        {"PS_WRITE_SUBMIT", PageTracepoint(kWrite, kSubmit), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"page", kInt, 8}}},
+        {"PS_WRITE_BDEV_SUBMIT", PageTracepoint(kWrite, kBdevSubmit), OWNER_TYPE_NONE,
+         OBJECT_NONE, 0, {{"offset", kInt, 8}}},
+        {"PS_WRITE_BDEV_DONE", PageTracepoint(kWrite, kBdevDone), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"success", kInt, 8}}},
+        {"PS_WRITE_CB_DONE", PageTracepoint(kWrite, kCallbackDone), OWNER_TYPE_NONE, OBJECT_NONE,
+         0, {{"status", kInt, 8}}},
+        {"PS_FLUSH_SUBMIT", PageTracepoint(kFlush, kSubmit), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"page", kInt, 8}}},
+        {"PS_FLUSH_BDEV_SUBMIT", PageTracepoint(kFlush, kBdevSubmit), OWNER_TYPE_NONE,
+         OBJECT_NONE, 0, {{"offset", kInt, 8}}},
+        {"PS_FLUSH_BDEV_DONE", PageTracepoint(kFlush, kBdevDone), OWNER_TYPE_NONE, OBJECT_NONE, 0,
+         {{"success", kInt, 8}}},
+        {"PS_FLUSH_CB_DONE", PageTracepoint(kFlush, kCallbackDone), OWNER_TYPE_NONE, OBJECT_NONE,
+         0, {{"status", kInt, 8}, {"round", kInt, 8}}},
+    };
+    spdk_trace_register_description_ext(opts, SPDK_COUNTOF(opts));
+}
@@ -0,0 +1,57 @@
+// page_trace.h
+// spdk_trace tracepoints of the PageStore I/O path.
+//
+// Every read, write and flush records up to four stages under one object id,
+// its trace id: submit, when the store takes it on; bdev submit, when it has
+// passed admission control and reached spdk_bdev; bdev done; and callback
+// done, once the caller's callback has returned. The gaps between them are
+// queueing, device time and completion work (journal commit, CRC check,
+// decompression and the callback itself). A batch run or a read-ahead window
+// is one traced I/O; flush callers are tied to the round that answered them.
+//
+// The group is off unless enabled, e.g. with `-e pagestore`. While it is off a
+// stage costs one test of the tracepoint mask and no trace id is allocated.
+// tools/pagestore_trace_hist turns a recorded trace into per-stage latency
+// histograms.
+
+#pragma once
+
+#include <spdk/trace.h>
+#include <cstddef>
+#include <cstdint>
+
+// Group ids below 0x20 are left to SPDK's own libraries.
+#define TRACE_GROUP_PAGESTORE 0x20
+static_assert(TRACE_GROUP_PAGESTORE < SPDK_TRACE_MAX_GROUP_ID, "no room for the PageStore group");
+
+enum class PageTraceOp : uint8_t { kRead, kWrite, kFlush };
+constexpr size_t kNumPageTraceOps = 3;
+
+// The argument each stage records besides the size.
+enum class PageTraceStage : uint8_t {
+    kSubmit,       // pageId, or UINT64_MAX if there is none yet (flush, keyed put)
+    kBdevSubmit,   // device byte offset
+    kBdevDone,     // 1 on success
+    kCallbackDone, // IoStatus code; flushes also record their round's trace id
+};
+constexpr size_t kNumPageTraceStages = 4;
+
+constexpr uint16_t PageTracepoint(PageTraceOp op, PageTraceStage stage) {
+    return SPDK_TPOINT_ID(TRACE_GROUP_PAGESTORE,
+                          static_cast<uint16_t>(op) * kNumPageTraceStages +
+                              static_cast<uint16_t>(stage));
+}
+
+inline bool PageTraceEnabled(PageTraceOp op) {
+    return spdk_trace_tpoint_enabled(PageTracepoint(op, PageTraceStage::kSubmit));
+}
+
+inline void PageTrace(PageTraceOp op, PageTraceStage stage, uint64_t traceId, uint64_t size,
+                      uint64_t arg) {
+    spdk_trace_record(PageTracepoint(op, stage), 0, size, traceId, 1, arg);
+}
+
+inline void PageTraceFlushDone(uint64_t traceId, uint64_t status, uint64_t roundId) {
+    spdk_trace_record(PageTracepoint(PageTraceOp::kFlush, PageTraceStage::kCallbackDone), 0, 0,
+                      traceId, 2, status, roundId);
+}
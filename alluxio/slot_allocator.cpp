@@ -0,0 +1,136 @@
+// slot_allocator.cpp
+#include "slot_allocator.h"
+
+#include <algorithm>
+
+SlotAllocator::SlotAllocator(uint64_t numSlots) : num_slots_(numSlots), free_(numSlots) {
+    // Build every level fully free, then clear the padding past the last slot.
+    uint64_t bits = numSlots;
+    do {
+        uint64_t words = (bits + 63) / 64;
+        std::vector<uint64_t> level(words, ~0ULL);
+        if (bits % 64) level.back() = (1ULL << (bits % 64)) - 1;
+        if (bits == 0) level.assign(1, 0);
+        levels_.push_back(std::move(level));
+        bits = words;
+    } while (levels_.back().size() > 1);
+}
+
+bool SlotAllocator::IsUsed(uint64_t slot) const {
+    return !(levels_[0][slot / 64] >> (slot % 64) & 1);
+}
+
+void SlotAllocator::SetFree(uint64_t slot) {
+    uint64_t idx = slot;
+    for (auto& level : levels_) {
+        uint64_t& word = level[idx / 64];
+        bool wasEmpty = word == 0;
+        word |= 1ULL << (idx % 64);
+        if (!wasEmpty) break;
+        idx /= 64;
+    }
+}
+
+void SlotAllocator::SetUsed(uint64_t slot) {
+    uint64_t idx = slot;
+    for (auto& level : levels_) {
+        uint64_t& word = level[idx / 64];
+        word &= ~(1ULL << (idx % 64));
+        if (word != 0) break;
+        idx /= 64;
+    }
+}
+
+bool SlotAllocator::MarkUsed(uint64_t slot) {
+    if (slot >= num_slots_ || IsUsed(slot)) return false;
+    SetUsed(slot);
+    free_--;
+    return true;
+}
+
+bool SlotAllocator::Free(uint64_t slot) {
+    if (slot >= num_slots_ || !IsUsed(slot)) return false;
+    SetFree(slot);
+    free_++;
+    no_fit_ = UINT64_MAX;
+    return true;
+}
+
+void SlotAllocator::FreeExtent(uint64_t first, uint64_t count) {
+    for (uint64_t slot = first; slot < first + count; slot++) Free(slot);
+}
+
+uint64_t SlotAllocator::FindFree(uint64_t pos) const {
+    if (pos >= num_slots_) return kNone;
+    // Climb until some word at or after pos has a free bit...
+    size_t lvl = 0;
+    uint64_t idx = pos;
+    for (; lvl < levels_.size(); lvl++) {
+        const auto& level = levels_[lvl];
+        uint64_t w = idx / 64;
+        if (w >= level.size()) return kNone;
+        uint64_t word = level[w] & (~0ULL << (idx % 64));
+        if (word) {
+            idx = w * 64 + __builtin_ctzll(word);
+            break;
+        }
+        idx = w + 1;
+    }
+    if (lvl == levels_.size()) return kNone;
+    // ...then follow the lowest free bit back down to the leaves.
+    while (lvl > 0) {
+        lvl--;
+        idx = idx * 64 + __builtin_ctzll(levels_[lvl][idx]);
+    }
+    return idx;
+}
+
+uint64_t SlotAllocator::Allocate() {
+    if (free_ == 0) return kNone;
+    uint64_t slot = FindFree(hint_);
+    if (slot == kNone) slot = FindFree(0);
+    SetUsed(slot);
+    free_--;
+    hint_ = slot + 1;
+    return slot;
+}
+
+uint64_t SlotAllocator::RunLength(uint64_t pos, uint64_t limit) const {
+    uint64_t run = 0;
+    while (run < limit && pos + run < num_slots_) {
+        uint64_t p = pos + run;
+        uint64_t bits = levels_[0][p / 64] >> (p % 64);
+        uint64_t ones = ~bits ? __builtin_ctzll(~bits) : 64 - p % 64;
+        run += ones;
+        if (ones < 64 - p % 64) break;
+    }
+    return run < limit ? run : limit;
+}
+
+uint64_t SlotAllocator::FindExtent(uint64_t from, uint64_t to, uint64_t count) const {
+    for (uint64_t pos = FindFree(from); pos != kNone && pos + count <= to;) {
+        uint64_t run = RunLength(pos, count);
+        if (run == count) return pos;
+        // pos + run is used (or past the end); resume after it.
+        pos = FindFree(pos + run);
+    }
+    return kNone;
+}
+
+uint64_t SlotAllocator::AllocateExtent(uint64_t count) {
+    if (count == 0 || count > free_ || count >= no_fit_) return kNone;
+    // Like Allocate(), start where the last extent ended, so a fragmented
+    // prefix is not rescanned on every call.
+    uint64_t pos = FindExtent(extent_hint_, num_slots_, count);
+    if (pos == kNone) {
+        pos = FindExtent(0, std::min(num_slots_, extent_hint_ + count - 1), count);
+    }
+    if (pos == kNone) {
+        no_fit_ = count;
+        return kNone;
+    }
+    for (uint64_t slot = pos; slot < pos + count; slot++) SetUsed(slot);
+    free_ -= count;
+    extent_hint_ = pos + count;
+    return pos;
+}
@@ -0,0 +1,58 @@
+// slot_allocator.h
+// Hierarchical free-slot bitmap sized for the device at runtime.
+//
+// Level 0 has one bit per slot (1 = free). Every level above has one bit per
+// 64-bit word of the level below, set while that word has any free bit, up to
+// a single top word. Finding a free slot is a ctz per level on the way down,
+// so 2^36 slots (256 TiB of 4 KiB pages) take at most six word lookups.
+// Memory is ~1/64 above the leaf bitmap: 32 MiB of leaves per TiB of pages.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SlotAllocator {
+public:
+    static constexpr uint64_t kNone = UINT64_MAX;
+
+    // Every slot starts out free.
+    explicit SlotAllocator(uint64_t numSlots);
+
+    // Lowest free slot at or after the previous allocation, wrapping around,
+    // marked used. kNone when full.
+    uint64_t Allocate();
+    // Next fit of count contiguous free slots, marked used: the first run at
+    // or after the end of the previous extent, wrapping around. kNone if no
+    // run is long enough; a length that did not fit fails at once until some
+    // slot is freed.
+    uint64_t AllocateExtent(uint64_t count);
+
+    // Return false if the slot was already in the requested state.
+    bool MarkUsed(uint64_t slot);
+    bool Free(uint64_t slot);
+    void FreeExtent(uint64_t first, uint64_t count);
+
+    bool IsUsed(uint64_t slot) const;
+    // First free slot at or after pos, without allocating it.
+    uint64_t FindFree(uint64_t pos) const;
+
+    uint64_t Size() const { return num_slots_; }
+    uint64_t FreeCount() const { return free_; }
+    uint64_t UsedCount() const { return num_slots_ - free_; }
+
+private:
+    void SetFree(uint64_t slot);
+    void SetUsed(uint64_t slot);
+    uint64_t RunLength(uint64_t pos, uint64_t limit) const;
+    // First run of count free slots starting in [from, to - count].
+    uint64_t FindExtent(uint64_t from, uint64_t to, uint64_t count) const;
+
+    std::vector<std::vector<uint64_t>> levels_; // levels_[0] is the leaf bitmap
+    uint64_t num_slots_;
+    uint64_t free_;
+    uint64_t hint_ = 0;
+    uint64_t extent_hint_ = 0;
+    uint64_t no_fit_ = UINT64_MAX; // shortest run length known not to fit
+};
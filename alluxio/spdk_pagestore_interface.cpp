@@ -1,120 +1,2342 @@
 // spdk_pagestore_interface.cpp
 #include "spdk_pagestore_interface.h"
+#include "page_store_rpc.h"
+
+#include <algorithm>
+
+namespace {
+
+// Owner-only counter bump; readers may observe it from any thread.
+void Bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Channels created so far by any store; numbers the trace ids of each.
+std::atomic<uint64_t> g_trace_channels{0};
+
+uint64_t NextTraceId(PageStoreChannel* ch) {
+    return ch->trace_base | ++ch->trace_seq;
+}
+
+// Records the submit stage of a new traced I/O and returns its trace id, or
+// 0 if op is not being traced.
+uint64_t TraceSubmit(PageStoreChannel* ch, PageTraceOp op, uint64_t pageId, uint64_t size) {
+    if (!PageTraceEnabled(op)) return 0;
+    uint64_t id = NextTraceId(ch);
+    PageTrace(op, PageTraceStage::kSubmit, id, size, pageId);
+    return id;
+}
+
+PageTraceOp TraceOpOf(PageOp op) {
+    return op == PageOp::kWrite || op == PageOp::kWriteLeased ? PageTraceOp::kWrite
+                                                              : PageTraceOp::kRead;
+}
+
+PageStatOp StatOpOf(PageOp op) {
+    switch (op) {
+    case PageOp::kWrite:
+    case PageOp::kWriteLeased:
+        return PageStatOp::kWrite;
+    case PageOp::kDelete:
+        return PageStatOp::kDelete;
+    default:
+        return PageStatOp::kRead;
+    }
+}
+
+PageTraceOp TraceOpOf(enum spdk_bdev_io_type type) {
+    switch (type) {
+    case SPDK_BDEV_IO_TYPE_WRITE:
+        return PageTraceOp::kWrite;
+    case SPDK_BDEV_IO_TYPE_FLUSH:
+        return PageTraceOp::kFlush;
+    default:
+        return PageTraceOp::kRead;
+    }
+}
+
+void PutChannelMsg(void* arg) {
+    auto* ch = static_cast<PageStoreChannel*>(arg);
+    if (ch->throttle_poller) spdk_poller_unregister(&ch->throttle_poller);
+    for (ReadAheadStream& s : ch->streams) {
+        for (ReadAheadSegment& seg : s.segs) {
+            if (seg.buf) spdk_free(seg.buf);
+        }
+    }
+    spdk_put_io_channel(ch->bdev_ch);
+    if (ch->accel_ch) spdk_put_io_channel(ch->accel_ch);
+    while (ch->free_reqs) {
+        PageIoRequest* req = ch->free_reqs;
+        ch->free_reqs = req->next_free;
+        delete req;
+    }
+    while (ch->free_calls) {
+        PageStoreChannel::RecordedCall* call = ch->free_calls;
+        ch->free_calls = call->next_free;
+        delete call;
+    }
+    while (ch->free_flush_waiters) {
+        PageStoreChannel::FlushWaiter* w = ch->free_flush_waiters;
+        ch->free_flush_waiters = w->next_free;
+        delete w;
+    }
+    while (ch->free_flush_rounds) {
+        PageStoreChannel::FlushRound* round = ch->free_flush_rounds;
+        ch->free_flush_rounds = round->next_free;
+        delete round;
+    }
+    delete ch;
+}
+
+} // namespace
+
+void PageStore::WritePages(std::span<const PageWrite> pages, IoCallback cb) {
+    if (pages.empty()) {
+        cb(true);
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(pages.size(), std::move(cb));
+    for (const PageWrite& page : pages) {
+        WritePage(page.pageId, page.data, [join](IoStatus status) { join->Done(status); });
+    }
+}
+
+void PageStore::ReadPages(std::span<const PageRead> pages, IoCallback cb) {
+    if (pages.empty()) {
+        cb(true);
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(pages.size(), std::move(cb));
+    for (const PageRead& page : pages) {
+        ReadPage(page.pageId, page.buffer, [join](IoStatus status) { join->Done(status); });
+    }
+}
 
 SpdkPageStore::~SpdkPageStore() {
-    if (channel_) spdk_put_io_channel(channel_);
+    UnregisterPageStoreStats(this);
+    // Close() is the orderly path; anything still held here is handed back to
+    // its owning thread so the channel is never put from a foreign thread.
+    struct spdk_thread* self = spdk_get_thread();
+    for (auto& slot : channels_) {
+        PageStoreChannel* ch = slot.exchange(nullptr, std::memory_order_acq_rel);
+        if (!ch) continue;
+        if (ch->thread == self) {
+            PutChannelMsg(ch);
+        } else if (spdk_thread_send_msg(ch->thread, PutChannelMsg, ch) != 0) {
+            std::cerr << "SPDK: Leaking I/O channel of exited thread" << std::endl;
+        }
+    }
     if (desc_) spdk_bdev_close(desc_);
-    if (metadata_buf_) spdk_free(metadata_buf_);
 }
 
 bool SpdkPageStore::Init(const std::string& bdevName) {
+    Init(bdevName, [](bool ok) {
+        if (!ok) std::cerr << "SPDK: PageStore metadata recovery failed" << std::endl;
+    });
+    return desc_ != nullptr;
+}
+
+void SpdkPageStore::Init(const std::string& bdevName, IoCallback done) {
+    ns_per_tick_ = 1e9 / static_cast<double>(spdk_get_ticks_hz());
     if (spdk_bdev_open_ext(bdevName.c_str(), true, nullptr, nullptr, &desc_) != 0) {
         std::cerr << "SPDK: Failed to open bdev " << bdevName << std::endl;
-        return false;
+        desc_ = nullptr;
+        done(false);
+        return;
     }
 
     bdev_ = spdk_bdev_desc_get_bdev(desc_);
-    channel_ = spdk_bdev_get_io_channel(desc_);
-    if (!channel_) {
+    if (spdk_bdev_is_zoned(bdev_)) {
+        std::cerr << "SPDK: bdev " << bdevName << " is zoned; use ZonedPageStore" << std::endl;
+        spdk_bdev_close(desc_);
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    bool compress = opts_.compression != PageCodec::kNone;
+    slot_size_ = compress ? opts_.compression_slot_size : kPageSize;
+    if (slot_size_ == 0 || kPageSize % slot_size_ != 0 || (compress && slot_size_ == kPageSize)) {
+        std::cerr << "SPDK: compression_slot_size " << slot_size_
+                  << " does not split a page into whole slots" << std::endl;
+        spdk_bdev_close(desc_);
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    slots_per_page_ = kPageSize / slot_size_;
+
+    uint32_t blockSize = spdk_bdev_get_block_size(bdev_);
+    uint64_t devBytes = spdk_bdev_get_num_blocks(bdev_) * blockSize;
+    uint64_t numSlots = std::min(devBytes / slot_size_, kMaxSlots);
+    if (opts_.max_pages) numSlots = std::min(numSlots, opts_.max_pages * slots_per_page_);
+    // The metadata region grows with the slot count, so shrink the data area
+    // until both fit; the slot count only ever decreases, so this settles.
+    MetadataLayout layout = ComputeMetadataLayout(numSlots, opts_.metadata_journal_blocks);
+    while (numSlots > 0 && layout.data_offset + numSlots * slot_size_ > devBytes) {
+        numSlots = devBytes > layout.data_offset ? (devBytes - layout.data_offset) / slot_size_ : 0;
+        layout = ComputeMetadataLayout(numSlots, opts_.metadata_journal_blocks);
+    }
+    if (slot_size_ % blockSize != 0 || numSlots < slots_per_page_) {
+        std::cerr << "SPDK: bdev " << bdevName << " (" << devBytes << " bytes, " << blockSize
+                  << "-byte blocks) cannot hold " << slot_size_ << "-byte slots" << std::endl;
+        spdk_bdev_close(desc_);
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    num_slots_ = numSlots;
+    num_pages_ = numSlots / slots_per_page_;
+
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) {
         std::cerr << "SPDK: Failed to get I/O channel" << std::endl;
         spdk_bdev_close(desc_);
         desc_ = nullptr;
-        return false;
+        done(false);
+        return;
     }
 
-    metadata_buf_ = spdk_zmalloc(kMetadataSize, kPageSize, nullptr,
-                                 SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA);
-    if (!metadata_buf_) {
-        std::cerr << "SPDK: Failed to allocate metadata buffer" << std::endl;
-        return false;
+    journal_.Recover(desc_, ch->bdev_ch, slot_size_, num_slots_, opts_.metadata_journal_blocks,
+                     [this, done = std::move(done)](bool ok) {
+                         OnRecovered(ok);
+                         done(ok);
+                     });
+}
+
+void SpdkPageStore::OnRecovered(bool success) {
+    if (!success) return;
+    {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        slots_ = std::make_unique<SlotAllocator>(num_slots_);
+        slot_keys_.assign(num_slots_, kUnkeyed);
+        extents_.assign(num_slots_, SlotExtent{});
+        slot_readers_ = std::make_unique<std::atomic<uint32_t>[]>(num_slots_);
+        policy_ = MakeEvictionPolicy(opts_.eviction, num_slots_);
+        dirty_.clear();
+        dirty_.reserve(kMaxDirtyExtents + 1);
+        // The index holds cached keys, not slots; size it for what survived
+        // and let it grow as the cache fills.
+        size_t keys = 0;
+        journal_.ForEachUsed([&keys](uint64_t, const PageMeta& meta) {
+            if (meta.file_id != kNoFileId) keys++;
+        });
+        index_.Clear();
+        index_.Reserve(keys);
+        journal_.ForEachUsed([this](uint64_t slot, const PageMeta& meta) {
+            SetExtentLocked(slot, std::min<uint32_t>(meta.stored_size, kPageSize));
+            if (meta.file_id == kNoFileId) return;
+            slot_keys_[slot] = PageKey{meta.file_id, meta.page_index};
+            index_.Insert(slot_keys_[slot], slot);
+            if (policy_) policy_->OnInsert(slot, PageIndex::Hash(slot_keys_[slot]));
+        });
+    }
+    data_offset_ = journal_.Layout().data_offset;
+    if (!opts_.record_path.empty()) {
+        // Records are handed over a chunk at a time; a few chunks per thread
+        // let the writer fall behind for a while before any is dropped.
+        auto recorder = std::make_shared<PageRecorder>();
+        if (recorder->Open(opts_.record_path, opts_.record_capacity,
+                           4 * spdk_env_get_core_count())) {
+            recorder_ = std::move(recorder);
+        } else {
+            std::cerr << "SPDK: Continuing without call capture" << std::endl;
+        }
+    }
+    ready_.store(true, std::memory_order_release);
+    RegisterPageStoreStats(spdk_bdev_get_name(bdev_), this);
+}
+
+void SpdkPageStore::EnableSharding(const std::vector<struct spdk_thread*>& owners) {
+    shard_threads_ = owners;
+}
+
+void SpdkPageStore::Close(IoCallback cb) {
+    // Close() is not expected to race with itself, so a single pending
+    // callback slot is enough.
+    close_cb_ = std::move(cb);
+    close_thread_ = spdk_get_thread();
+    ready_.store(false, std::memory_order_release);
+    // Before any channel, and the counters in it, is released.
+    UnregisterPageStoreStats(this);
+    journal_.Drain([this](bool) {
+        // Drain completes on whichever thread finished the last journal write.
+        if (spdk_get_thread() == close_thread_ ||
+            spdk_thread_send_msg(close_thread_, StartRelease, this) != 0) {
+            StartRelease(this);
+        }
+    });
+}
+
+void SpdkPageStore::StartRelease(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    if (self->readahead_in_flight_.load(std::memory_order_acquire) != 0) {
+        self->release_poller_ = spdk_poller_register(WaitReadAhead, self, 100);
+        if (self->release_poller_) return;
+        std::cerr << "SPDK: Closing with read-ahead still in flight" << std::endl;
     }
+    spdk_for_each_thread(ReleaseLocalChannel, arg, OnChannelsReleased);
+}
 
-    int rc = spdk_bdev_read(desc_, channel_, metadata_buf_, 0, kMetadataSize,
-                            OnMetadataRead, this);
-    if (rc != 0) {
-        std::cerr << "SPDK: Failed to submit metadata read" << std::endl;
-        return false;
+int SpdkPageStore::WaitReadAhead(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    if (self->readahead_in_flight_.load(std::memory_order_acquire) != 0) return SPDK_POLLER_IDLE;
+    spdk_poller_unregister(&self->release_poller_);
+    spdk_for_each_thread(ReleaseLocalChannel, arg, OnChannelsReleased);
+    return SPDK_POLLER_BUSY;
+}
+
+PageStoreChannel* SpdkPageStore::GetLocalChannel() {
+    struct spdk_thread* thread = spdk_get_thread();
+    if (!thread) {
+        std::cerr << "SPDK: PageStore I/O submitted from a non-SPDK thread" << std::endl;
+        return nullptr;
+    }
+    uint64_t id = spdk_thread_get_id(thread);
+    if (id >= kMaxThreads) {
+        std::cerr << "SPDK: Thread id " << id << " exceeds kMaxThreads" << std::endl;
+        return nullptr;
     }
 
-    page_used_.reset(); // Simplified
-    return true;
+    PageStoreChannel* ch = channels_[id].load(std::memory_order_acquire);
+    if (ch) return ch;
+
+    struct spdk_io_channel* bdev_ch = spdk_bdev_get_io_channel(desc_);
+    if (!bdev_ch) return nullptr;
+    ch = new PageStoreChannel();
+    ch->thread = thread;
+    ch->bdev_ch = bdev_ch;
+    ch->store = this;
+    ch->trace_base = (g_trace_channels.fetch_add(1, std::memory_order_relaxed) + 1) << 40;
+    if (opts_.readahead_max_pages) ch->streams.resize(opts_.readahead_streams);
+    ch->buf_pool = std::make_unique<PageBufferPool>(kPageSize, opts_.buffer_pool_size,
+                                                    opts_.buffer_pool_fallback);
+    if (!ch->buf_pool->Init()) {
+        PutChannelMsg(ch);
+        return nullptr;
+    }
+    if (opts_.compression != PageCodec::kNone) {
+        ch->accel_ch = spdk_accel_get_io_channel();
+        if (!ch->accel_ch) {
+            std::cerr << "SPDK: Failed to get accel channel" << std::endl;
+            PutChannelMsg(ch);
+            return nullptr;
+        }
+    }
+    channels_[id].store(ch, std::memory_order_release);
+    return ch;
+}
+
+PageIoRequest* SpdkPageStore::AllocRequest(PageStoreChannel* ch, PageOp op, uint64_t slot) {
+    PageIoRequest* req = ch ? ch->free_reqs : nullptr;
+    if (req) {
+        ch->free_reqs = req->next_free;
+        ch->free_req_count--;
+    } else {
+        req = new PageIoRequest();
+        if (ch) {
+            ch->req_heap_allocs.store(ch->req_heap_allocs.load(std::memory_order_relaxed) + 1,
+                                      std::memory_order_relaxed);
+        }
+    }
+    req->store = this;
+    req->ch = ch;
+    req->op = op;
+    req->verify = false;
+    req->keyed = false;
+    req->status = IoStatus();
+    req->slot = slot;
+    req->stored_size = kPageSize;
+    req->buf = nullptr;
+    req->user_buf = nullptr;
+    req->pool = nullptr;
+    req->origin = nullptr;
+    req->start = 0;
+    req->trace_id = 0;
+    req->next_free = nullptr;
+    return req;
+}
+
+void SpdkPageStore::FreeRequest(PageIoRequest* req) {
+    req->cb.Reset();
+    req->lease_cb.Reset();
+    PageStoreChannel* ch = req->ch;
+    if (ch && ch->free_req_count < kMaxCachedRequests) {
+        req->next_free = ch->free_reqs;
+        ch->free_reqs = req;
+        ch->free_req_count++;
+    } else {
+        delete req;
+    }
+}
+
+void SpdkPageStore::CompleteRequest(PageIoRequest* req, IoStatus status) {
+    if (req->start) {
+        PageStatOp op = StatOpOf(req->op);
+        req->store->RecordOp(req->ch, op, req->start, 1,
+                             op == PageStatOp::kDelete ? 0 : kPageSize, status);
+    }
+    // Recycle first so the callback can reuse the request for its next I/O.
+    IoCallback cb = std::move(req->cb);
+    uint64_t traceId = req->trace_id;
+    PageTraceOp op = TraceOpOf(req->op);
+    FreeRequest(req);
+    cb(status);
+    if (traceId) PageTrace(op, PageTraceStage::kCallbackDone, traceId, 0, status.code());
+}
+
+void SpdkPageStore::StartRequest(PageStoreChannel* ch, PageIoRequest* req, PageTraceOp op,
+                                 uint64_t pageId) {
+    req->start = spdk_get_ticks();
+    req->trace_id = TraceSubmit(ch, op, pageId, kPageSize);
+}
+
+void SpdkPageStore::RecordOp(PageStoreChannel* ch, PageStatOp op, uint64_t start, uint64_t pages,
+                             uint64_t bytes, IoStatus status) {
+    auto ns = static_cast<uint64_t>(static_cast<double>(spdk_get_ticks() - start) * ns_per_tick_);
+    ch->op_stats[static_cast<size_t>(op)].Record(ns, pages, bytes, status);
+}
+
+void SpdkPageStore::RecordCall(PageRecordOp op, uint64_t page, uint32_t size, uint16_t flags,
+                               IoCallback& cb) {
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) return;
+    PageStoreChannel::RecordedCall* call = ch->free_calls;
+    if (call) {
+        ch->free_calls = call->next_free;
+        ch->free_call_count--;
+    } else {
+        call = new PageStoreChannel::RecordedCall();
+    }
+    call->store = this;
+    call->ch = ch;
+    call->cb = std::move(cb);
+    call->start = spdk_get_ticks();
+    call->page = page;
+    call->size = size;
+    call->op = op;
+    call->flags = flags;
+    cb = IoCallback(OnRecordedCallDone, call);
+}
+
+void SpdkPageStore::OnRecordedCallDone(void* arg, IoStatus status) {
+    auto* call = static_cast<PageStoreChannel::RecordedCall*>(arg);
+    SpdkPageStore* self = call->store;
+    PageStoreChannel* ch = call->ch;
+    uint64_t now = spdk_get_ticks();
+    if (self->recorder_) {
+        PageRecord rec;
+        rec.time_ns = static_cast<uint64_t>(
+            static_cast<double>(call->start - self->recorder_->start_ticks()) * self->ns_per_tick_);
+        rec.page = call->page;
+        auto ns = static_cast<uint64_t>(static_cast<double>(now - call->start) * self->ns_per_tick_);
+        rec.latency_ns = static_cast<uint32_t>(std::min<uint64_t>(ns, UINT32_MAX));
+        rec.size = call->size;
+        rec.op = call->op;
+        rec.status = static_cast<uint8_t>(status.code());
+        rec.flags = call->flags;
+        rec.thread = static_cast<uint32_t>(spdk_thread_get_id(ch->thread));
+        ch->records.Append(self->recorder_, rec);
+    }
+    // Recycle first so the callback can reuse the call for its next I/O.
+    IoCallback cb = std::move(call->cb);
+    if (ch->free_call_count < kMaxCachedRequests) {
+        call->next_free = ch->free_calls;
+        ch->free_calls = call;
+        ch->free_call_count++;
+    } else {
+        delete call;
+    }
+    cb(status);
+}
+
+PageOpStats SpdkPageStore::GetOpStats(PageStatOp op) const {
+    PageOpStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (ch) ch->op_stats[static_cast<size_t>(op)].AddTo(total);
+    }
+    return total;
+}
+
+PageLookupStats SpdkPageStore::GetLookupStats() const {
+    PageLookupStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (!ch) continue;
+        total.hits += ch->key_hits.load(std::memory_order_relaxed);
+        total.misses += ch->key_misses.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t SpdkPageStore::GetRequestAllocations() const {
+    uint64_t total = 0;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (ch) total += ch->req_heap_allocs.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+PageBufferPoolStats SpdkPageStore::GetBufferPoolStats() const {
+    PageBufferPoolStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (ch) total += ch->buf_pool->GetStats();
+    }
+    return total;
+}
+
+PageIntegrityStats SpdkPageStore::GetIntegrityStats() const {
+    PageIntegrityStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (!ch) continue;
+        total.verified += ch->crc_verified.load(std::memory_order_relaxed);
+        total.mismatches += ch->crc_mismatches.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+PageQueueStats SpdkPageStore::GetQueueStats() const {
+    PageQueueStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (!ch) continue;
+        PageQueueStats stats;
+        stats.in_flight = ch->in_flight.load(std::memory_order_relaxed);
+        stats.queued = ch->queued.load(std::memory_order_relaxed);
+        stats.peak_in_flight = ch->peak_in_flight.load(std::memory_order_relaxed);
+        stats.peak_queued = ch->peak_queued.load(std::memory_order_relaxed);
+        stats.enomem = ch->enomem.load(std::memory_order_relaxed);
+        for (size_t c = 0; c < kNumPageIoClasses; c++) {
+            const PageStoreChannel::IoClassQueue& q = ch->classes[c];
+            PageIoClassStats& cs = stats.classes[c];
+            cs.in_flight = q.in_flight.load(std::memory_order_relaxed);
+            cs.queued = q.queued.load(std::memory_order_relaxed);
+            cs.dispatched = q.dispatched.load(std::memory_order_relaxed);
+            cs.waited = q.waited.load(std::memory_order_relaxed);
+            cs.throttled = q.throttled.load(std::memory_order_relaxed);
+            cs.wait_us = q.wait_us.load(std::memory_order_relaxed);
+            cs.max_wait_us = q.max_wait_us.load(std::memory_order_relaxed);
+            stats.waited += cs.waited;
+            stats.wait_us += cs.wait_us;
+            stats.max_wait_us = std::max(stats.max_wait_us, cs.max_wait_us);
+        }
+        total += stats;
+    }
+    return total;
+}
+
+PageReadAheadStats SpdkPageStore::GetReadAheadStats() const {
+    PageReadAheadStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (!ch) continue;
+        total.reads += ch->ra_reads.load(std::memory_order_relaxed);
+        total.pages += ch->ra_pages.load(std::memory_order_relaxed);
+        total.hits += ch->ra_hits.load(std::memory_order_relaxed);
+        total.waits += ch->ra_waits.load(std::memory_order_relaxed);
+        total.stale += ch->ra_stale.load(std::memory_order_relaxed);
+        total.wasted += ch->ra_wasted.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+PageCompressionStats SpdkPageStore::GetCompressionStats() const {
+    PageCompressionStats total;
+    for (const auto& slot : channels_) {
+        PageStoreChannel* ch = slot.load(std::memory_order_acquire);
+        if (!ch) continue;
+        total.compressed += ch->compressed.load(std::memory_order_relaxed);
+        total.incompressible += ch->incompressible.load(std::memory_order_relaxed);
+        total.bytes_saved += ch->bytes_saved.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+struct spdk_thread* SpdkPageStore::OwnerOf(uint64_t slot) const {
+    if (shard_threads_.empty()) return nullptr;
+    return shard_threads_[slot / slots_per_page_ % shard_threads_.size()];
+}
+
+void SpdkPageStore::Forward(struct spdk_thread* owner, PageOp op, uint64_t slot,
+                            void* buf, PageBufferPool* pool, bool keyed, IoCallback cb) {
+    struct spdk_thread* origin = spdk_get_thread();
+    PageIoRequest* req = AllocRequest(origin ? GetLocalChannel() : nullptr, op, slot);
+    req->buf = buf;
+    req->pool = pool;
+    req->origin = origin;
+    req->keyed = keyed;
+    req->cb = std::move(cb);
+    if (spdk_thread_send_msg(owner, RunShardMsg, req) != 0) {
+        if (op == PageOp::kWriteLeased) PutForwardedBuffer(pool, buf);
+        CompleteRequest(req, false);
+    }
+}
+
+void SpdkPageStore::PutForwardedBuffer(PageBufferPool* pool, void* buf) {
+    if (pool) {
+        pool->Put(buf);
+    } else {
+        spdk_free(buf);
+    }
+}
+
+void SpdkPageStore::RunShardMsg(void* arg) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    SpdkPageStore* self = req->store;
+    PageStoreChannel* ch = self->GetLocalChannel();
+    if (!ch) {
+        if (req->op == PageOp::kWriteLeased) PutForwardedBuffer(req->pool, req->buf);
+        OnShardDone(req, false);
+        return;
+    }
+    IoCallback done(OnShardDone, req);
+    switch (req->op) {
+    case PageOp::kWriteLeased:
+        // Copies made off any SPDK thread have no pool; Put() hands buffers
+        // from outside its slab to spdk_free.
+        self->IssueWrite(ch, req->slot, req->buf, req->pool ? req->pool : ch->buf_pool.get(),
+                         req->keyed, std::move(done));
+        break;
+    default:
+        self->IssueRead(ch, req->slot, req->buf, std::move(done));
+        break;
+    }
+}
+
+void SpdkPageStore::OnShardDone(void* arg, IoStatus status) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    req->status = status;
+    // Complete on the submitting thread, not on the shard owner.
+    if (req->origin && spdk_thread_send_msg(req->origin, RunShardCallback, req) == 0) {
+        return;
+    }
+    // The origin's free list may only be touched from the origin thread.
+    req->ch = nullptr;
+    RunShardCallback(req);
+}
+
+void SpdkPageStore::RunShardCallback(void* arg) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    CompleteRequest(req, req->status);
 }
 
+void SpdkPageStore::ReleaseLocalChannel(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    uint64_t id = spdk_thread_get_id(spdk_get_thread());
+    if (id >= kMaxThreads) return;
+    PageStoreChannel* ch = self->channels_[id].exchange(nullptr, std::memory_order_acq_rel);
+    if (ch) PutChannelMsg(ch);
+}
+
+void SpdkPageStore::OnChannelsReleased(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    if (self->desc_) {
+        spdk_bdev_close(self->desc_);
+        self->desc_ = nullptr;
+    }
+    // Every channel has handed in its records, so this closes the capture.
+    self->recorder_.reset();
+    IoCallback cb = std::move(self->close_cb_);
+    if (cb) cb(true);
+}
 
 void SpdkPageStore::WritePage(uint64_t pageId, const void* data, IoCallback cb) {
-    if (pageId >= kMaxPages) {
+    if (!Ready() || pageId >= num_pages_) {
         cb(false);
         return;
     }
-    uint64_t offset = kMetadataSize + pageId * kPageSize;
-    void* buf = spdk_zmalloc(kPageSize, kPageSize, nullptr,
-                             SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA);
-    memcpy(buf, data, kPageSize);
+    if (recorder_) RecordCall(PageRecordOp::kWrite, pageId, kPageSize, 0, cb);
+    WriteSlot(SlotOf(pageId), data, false, std::move(cb));
+}
 
-    {
-        std::lock_guard<std::mutex> lock(meta_mutex_);
-        page_used_.set(pageId);
+void SpdkPageStore::WriteSlot(uint64_t slot, const void* data, bool keyed, IoCallback cb) {
+    struct spdk_thread* owner = OwnerOf(slot);
+    if (owner && owner != spdk_get_thread()) {
+        // The caller may reuse data as soon as WritePage returns, long before
+        // the owner runs, so the copy is made here and forwarded like a lease.
+        PageStoreChannel* ch = spdk_get_thread() ? GetLocalChannel() : nullptr;
+        PageBufferPool* pool = ch ? ch->buf_pool.get() : nullptr;
+        void* buf = pool ? pool->Get() : nullptr;
+        if (!buf) {
+            buf = spdk_malloc(kPageSize, kPageSize, nullptr, SPDK_ENV_SOCKET_ID_ANY,
+                              SPDK_MALLOC_DMA);
+        }
+        if (!buf) {
+            cb(false);
+            return;
+        }
+        memcpy(buf, data, kPageSize);
+        Forward(owner, PageOp::kWriteLeased, slot, buf, pool, keyed, std::move(cb));
+        return;
     }
-
-    int rc = spdk_bdev_write(desc_, channel_, buf, offset, kPageSize,
-                             OnWriteComplete, new std::pair<IoCallback, void*>(cb, buf));
-    if (rc != 0) {
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) {
         cb(false);
-        spdk_free(buf);
+        return;
     }
+    CopyAndWrite(ch, slot, data, keyed, std::move(cb));
 }
 
-void SpdkPageStore::ReadPage(uint64_t pageId, void* buffer, IoCallback cb) {
-    if (pageId >= kMaxPages) {
+PageLease SpdkPageStore::AcquirePageBuffer() {
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) return {};
+    void* buf = ch->buf_pool->Get();
+    if (!buf) return {};
+    return PageLease(ch->buf_pool.get(), buf);
+}
+
+void SpdkPageStore::SubmitWrite(uint64_t pageId, PageLease lease, IoCallback cb) {
+    if (!Ready() || pageId >= num_pages_ || !lease) {
         cb(false);
         return;
     }
-    uint64_t offset = kMetadataSize + pageId * kPageSize;
-    int rc = spdk_bdev_read(desc_, channel_, buffer, offset, kPageSize,
-                            OnReadComplete, new IoCallback(cb));
-    if (rc != 0) {
+    if (recorder_) RecordCall(PageRecordOp::kWrite, pageId, kPageSize, 0, cb);
+    PageBufferPool* pool = lease.pool();
+    void* buf = lease.Detach();
+    uint64_t slot = SlotOf(pageId);
+    struct spdk_thread* owner = OwnerOf(slot);
+    if (owner && owner != spdk_get_thread()) {
+        Forward(owner, PageOp::kWriteLeased, slot, buf, pool, false, std::move(cb));
+        return;
+    }
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) {
+        pool->Put(buf);
         cb(false);
+        return;
     }
+    IssueWrite(ch, slot, buf, pool, false, std::move(cb));
 }
 
-void SpdkPageStore::Flush(IoCallback cb) {
-    int rc = spdk_bdev_flush(desc_, channel_, 0,
-                             spdk_bdev_get_num_blocks(bdev_) * spdk_bdev_get_block_size(bdev_),
-                             OnFlushComplete, new IoCallback(cb));
-    if (rc != 0) {
+void SpdkPageStore::PutPage(const PageKey& key, const void* data, IoCallback cb) {
+    if (!Ready() || key.file_id == kNoFileId) {
         cb(false);
+        return;
+    }
+    if (recorder_) RecordCall(PageRecordOp::kPut, PageIndex::Hash(key), kPageSize, 0, cb);
+    if (opts_.compression != PageCodec::kNone) {
+        PageStoreChannel* ch = GetLocalChannel();
+        if (!ch) {
+            cb(false);
+            return;
+        }
+        CompressAndPut(ch, key, data, std::move(cb));
+        return;
+    }
+    uint64_t slot;
+    std::vector<JournalRecord> evicted;
+    {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        // Every page takes one slot here, so nothing moves and only victims
+        // still being read are not taken over.
+        slot = PlaceKeyLocked(key, kPageSize, nullptr, &evicted);
+    }
+    if (!evicted.empty()) CommitDirectEvictions(GetLocalChannel(), std::move(evicted));
+    if (slot == SlotAllocator::kNone) {
+        cb(IoStatus::kNoSpace);
+        return;
     }
+    MaybeStartEviction();
+    WriteSlot(slot, data, true, std::move(cb));
 }
 
-void SpdkPageStore::OnWriteComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
-    auto* pair = static_cast<std::pair<IoCallback, void*>*>(cb_arg);
-    pair->first(success);
-    spdk_free(pair->second);
-    delete pair;
-    spdk_bdev_free_io(bdev_io);
+uint64_t SpdkPageStore::PlaceKeyLocked(const PageKey& key, uint32_t storedSize, uint64_t* moved,
+                                       std::vector<JournalRecord>* evicted) {
+    uint32_t count = SlotsFor(storedSize);
+    uint64_t slot = index_.Find(key);
+    if (slot != PageIndex::kNotFound) {
+        if (extents_[slot].slots == count) {
+            // Overwrites count as hits.
+            if (policy_) policy_->OnAccess(slot);
+            SetExtentLocked(slot, storedSize);
+            return slot;
+        }
+        if (policy_) policy_->OnRemove(slot);
+        DropKeyLocked(slot);
+        *moved = slot;
+    }
+
+    slot = count == 1 ? slots_->Allocate() : slots_->AllocateExtent(count);
+    for (size_t i = 0; slot == SlotAllocator::kNone && policy_ && i < kMaxDirectVictims; i++) {
+        // Background eviction fell behind: take over a victim's slots. The
+        // new page's journal record supersedes the victim's.
+        uint64_t victim = policy_->Evict();
+        if (victim == EvictionPolicy::kNoVictim) break;
+        DropKeyLocked(victim);
+        direct_evictions_.fetch_add(1, std::memory_order_relaxed);
+        uint32_t have = extents_[victim].slots;
+        // Readers only join under the shared lock, so none can appear now.
+        bool read = slot_readers_[victim].load(std::memory_order_acquire) != 0;
+        if (have >= count && !read) {
+            // Only a page's first slot carries a record, so the rest of the
+            // victim's run is free to hand out at once.
+            slots_->FreeExtent(victim + count, have - count);
+            slot = victim;
+        } else {
+            evicted->push_back(JournalRecord{victim, 0, 0, kNoFileId, 0, 0, 0, {}});
+        }
+    }
+    if (slot == SlotAllocator::kNone) return slot;
+    // Both a fresh run and a victim's are already marked used.
+    SetExtentLocked(slot, storedSize);
+    slot_keys_[slot] = key;
+    index_.Insert(key, slot);
+    if (policy_) policy_->OnInsert(slot, PageIndex::Hash(key));
+    return slot;
 }
 
-void SpdkPageStore::OnReadComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
-    auto* cb = static_cast<IoCallback*>(cb_arg);
-    (*cb)(success);
-    delete cb;
-    spdk_bdev_free_io(bdev_io);
+void SpdkPageStore::SetExtentLocked(uint64_t slot, uint32_t storedSize) {
+    uint32_t count = std::max<uint32_t>(1, SlotsFor(storedSize));
+    for (uint32_t i = 0; i < count; i++) slots_->MarkUsed(slot + i);
+    PageCodec codec = storedSize < kPageSize ? opts_.compression : PageCodec::kNone;
+    extents_[slot] = SlotExtent{static_cast<uint16_t>(storedSize), static_cast<uint8_t>(count),
+                                codec};
 }
 
-void SpdkPageStore::OnFlushComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
-    auto* cb = static_cast<IoCallback*>(cb_arg);
-    (*cb)(success);
-    delete cb;
-    spdk_bdev_free_io(bdev_io);
+void SpdkPageStore::CompressAndPut(PageStoreChannel* ch, const PageKey& key, const void* data,
+                                   IoCallback cb) {
+    // Unlike raw writes, puts are not parked until a buffer comes back.
+    void* buf = ch->buf_pool->Get();
+    if (!buf) {
+        cb(false);
+        return;
+    }
+    PageIoRequest* req = AllocRequest(ch, PageOp::kWrite, SlotAllocator::kNone);
+    StartRequest(ch, req, PageTraceOp::kWrite, UINT64_MAX);
+    req->keyed = true;
+    req->buf = buf;
+    req->pool = ch->buf_pool.get();
+    req->user_buf = const_cast<void*>(data);
+    req->cb = std::move(cb);
+    // The key rides in the record until the page has a slot.
+    req->record.file_id = key.file_id;
+    req->record.page_index = key.page_index;
+    req->iovs[0] = {req->user_buf, kPageSize};
+    // Output that does not save a slot is stored raw anyway, so the codec may
+    // give up as soon as it outgrows that.
+    int rc = spdk_accel_submit_compress(ch->accel_ch, buf, kPageSize - slot_size_, &req->iovs[0],
+                                        1, &req->stored_size, OnCompressed, req);
+    if (rc != 0) OnCompressed(req, rc);
 }
 
-void SpdkPageStore::OnMetadataRead(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
-    auto* self = static_cast<SpdkPageStore*>(cb_arg);
-    if (!success) {
-        std::cerr << "SPDK: Metadata read failed" << std::endl;
+void SpdkPageStore::OnCompressed(void* arg, int status) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    SpdkPageStore* self = req->store;
+    PageStoreChannel* ch = req->ch;
+    uint32_t count = status == 0 ? self->SlotsFor(req->stored_size) : self->slots_per_page_;
+    if (count > 0 && count < self->slots_per_page_) {
+        // Zero the tail of the last slot so the CRC covers known bytes.
+        memset(static_cast<char*>(req->buf) + req->stored_size, 0,
+               count * self->slot_size_ - req->stored_size);
+        ch->compressed.store(ch->compressed.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+        ch->bytes_saved.store(ch->bytes_saved.load(std::memory_order_relaxed) + kPageSize -
+                                  count * self->slot_size_,
+                              std::memory_order_relaxed);
     } else {
-        // TODO: parse metadata_buf_ to fill page_used_
-        self->page_used_.reset(); // simplified
+        memcpy(req->buf, req->user_buf, kPageSize);
+        req->stored_size = kPageSize;
+        ch->incompressible.store(ch->incompressible.load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
     }
-    spdk_bdev_free_io(bdev_io);
+    req->user_buf = nullptr;
+
+    PageKey key{req->record.file_id, req->record.page_index};
+    uint64_t moved = SlotAllocator::kNone;
+    std::vector<JournalRecord> evicted;
+    uint64_t slot;
+    {
+        std::lock_guard<std::shared_mutex> lock(self->meta_mutex_);
+        slot = self->PlaceKeyLocked(key, req->stored_size, &moved, &evicted);
+    }
+    if (!evicted.empty()) self->CommitDirectEvictions(ch, std::move(evicted));
+    if (slot == SlotAllocator::kNone) {
+        self->ReleaseBuffer(ch, req->pool, req->buf);
+        CompleteRequest(req, IoStatus::kNoSpace);
+        req = nullptr;
+    } else {
+        self->MaybeStartEviction();
+        req->slot = slot;
+    }
+    if (moved == SlotAllocator::kNone) {
+        if (req) self->StartWrite(req);
+        return;
+    }
+    // The old copy's removal must be durable before the new copy is
+    // journaled, or replay could find the key in both places.
+    PageIoRequest* del = self->AllocRequest(ch, PageOp::kDelete, moved);
+    del->record = JournalRecord{moved, 0, 0, kNoFileId, 0, 0, 0, {}};
+    del->cb = [self, req](IoStatus status) {
+        if (!req) return;
+        if (status) {
+            self->StartWrite(req);
+            return;
+        }
+        self->ReleaseBuffer(req->ch, req->pool, req->buf);
+        self->AbortSlot(req->slot, {req->record.file_id, req->record.page_index});
+        CompleteRequest(req, status);
+    };
+    self->CommitRecord(del);
+}
+
+void SpdkPageStore::GetPage(const PageKey& key, void* buffer, IoCallback cb) {
+    PageStoreChannel* ch = Ready() ? GetLocalChannel() : nullptr;
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    if (recorder_) RecordCall(PageRecordOp::kGet, PageIndex::Hash(key), kPageSize, 0, cb);
+    uint64_t slot;
+    SlotExtent extent;
+    if (ch->access_count == PageStoreChannel::kAccessBufferSize) {
+        // Hits reach the policy in batches, one exclusive section per
+        // kAccessBufferSize of them.
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        DrainAccessesLocked(ch);
+    }
+    {
+        // Lookups only read, so concurrent GetPage calls do not serialize.
+        std::shared_lock<std::shared_mutex> lock(meta_mutex_);
+        slot = index_.Find(key);
+        if (slot != PageIndex::kNotFound) {
+            extent = extents_[slot];
+            slot_readers_[slot].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (slot == PageIndex::kNotFound) {
+        Bump(ch->key_misses);
+        cb(IoStatus::kNotFound);
+        return;
+    }
+    Bump(ch->key_hits);
+    if (policy_) ch->access_buf[ch->access_count++] = {static_cast<uint32_t>(slot), key};
+    PageIoRequest* get = AllocRequest(ch, PageOp::kGet, slot);
+    get->record.file_id = key.file_id;
+    get->record.page_index = key.page_index;
+    get->cb = std::move(cb);
+    if (extent.codec != PageCodec::kNone) {
+        ReadCompressed(ch, slot, extent, buffer, IoCallback(OnGetDone, get));
+        return;
+    }
+    ReadSlot(slot, buffer, IoCallback(OnGetDone, get));
+}
+
+void SpdkPageStore::OnGetDone(void* arg, IoStatus status) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    PageKey key{req->record.file_id, req->record.page_index};
+    status = req->store->EndKeyedRead(req->slot, key, status);
+    IoCallback cb = std::move(req->cb);
+    FreeRequest(req);
+    cb(status);
+}
+
+IoStatus SpdkPageStore::EndKeyedRead(uint64_t slot, const PageKey& key, IoStatus status) {
+    bool current;
+    {
+        // Checked before the read lets go, so the slot cannot have been
+        // handed to another key yet; a key that was dropped or moved meanwhile
+        // may have had its bytes overwritten under the read.
+        std::shared_lock<std::shared_mutex> lock(meta_mutex_);
+        current = slot_keys_[slot] == key;
+    }
+    if (slot_readers_[slot].fetch_sub(1, std::memory_order_acq_rel) == (kFreePending | 1)) {
+        // The slot was freed while it was read; this was the last reader.
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        slot_readers_[slot].store(0, std::memory_order_relaxed);
+        FreeExtentLocked(slot);
+    }
+    return current ? status : IoStatus::kNotFound;
+}
+
+void SpdkPageStore::ReadCompressed(PageStoreChannel* ch, uint64_t slot, const SlotExtent& extent,
+                                   void* buffer, IoCallback cb) {
+    PageIoRequest* req = AllocRequest(ch, PageOp::kReadCompressed, slot);
+    StartRequest(ch, req, PageTraceOp::kRead, slot / slots_per_page_);
+    req->stored_size = extent.stored_size;
+    req->pool = ch->buf_pool.get();
+    req->user_buf = buffer;
+    req->cb = std::move(cb);
+    req->verify = ShouldVerify(ch);
+    // The stored bytes always land in a pooled page, which the codec then
+    // expands into the caller's buffer.
+    req->buf = ch->buf_pool->Get();
+    if (!req->buf) {
+        CompleteRequest(req, false);
+        return;
+    }
+    req->io = BdevIo{this, ch, SPDK_BDEV_IO_TYPE_READ, PageIoClass::kRead, req->buf, nullptr, 0,
+                     data_offset_ + slot * slot_size_,
+                     static_cast<uint64_t>(extent.slots) * slot_size_, OnReadComplete, req, 0,
+                     nullptr, req->trace_id};
+    if (SubmitBdevIo(&req->io) != 0) {
+        req->pool->Put(req->buf);
+        CompleteRequest(req, false);
+    }
+}
+
+void SpdkPageStore::DeletePage(const PageKey& key, IoCallback cb) {
+    PageStoreChannel* ch = Ready() ? GetLocalChannel() : nullptr;
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    if (recorder_) RecordCall(PageRecordOp::kDelete, PageIndex::Hash(key), 0, 0, cb);
+    uint64_t slot;
+    {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        slot = index_.Find(key);
+        if (slot != PageIndex::kNotFound) {
+            DropKeyLocked(slot);
+            if (policy_) policy_->OnRemove(slot);
+        }
+    }
+    if (slot == PageIndex::kNotFound) {
+        cb(IoStatus::kNotFound);
+        return;
+    }
+    PageIoRequest* req = AllocRequest(ch, PageOp::kDelete, slot);
+    req->start = spdk_get_ticks();
+    req->cb = std::move(cb);
+    req->record = JournalRecord{slot, 0, 0, kNoFileId, 0, 0, 0, {}};
+    CommitRecord(req);
+}
+
+bool SpdkPageStore::HasPage(const PageKey& key) {
+    if (!Ready()) return false;
+    std::shared_lock<std::shared_mutex> lock(meta_mutex_);
+    return index_.Find(key) != PageIndex::kNotFound;
+}
+
+void SpdkPageStore::DropKeyLocked(uint64_t slot) {
+    const PageKey key = slot_keys_[slot];
+    if (key.file_id == kNoFileId) return;
+    index_.Erase(key);
+    slot_keys_[slot] = kUnkeyed;
+}
+
+void SpdkPageStore::FreeExtentLocked(uint64_t slot) {
+    if (slot_readers_[slot].fetch_or(kFreePending, std::memory_order_acq_rel) != 0) return;
+    slot_readers_[slot].store(0, std::memory_order_relaxed);
+    slots_->FreeExtent(slot, std::max<uint32_t>(1, extents_[slot].slots));
+    extents_[slot] = SlotExtent{};
+}
+
+void SpdkPageStore::DrainAccessesLocked(PageStoreChannel* ch) {
+    if (policy_) {
+        for (size_t i = 0; i < ch->access_count; i++) {
+            const PageStoreChannel::Access& a = ch->access_buf[i];
+            if (slot_keys_[a.slot] == a.key) policy_->OnAccess(a.slot);
+        }
+    }
+    ch->access_count = 0;
+}
+
+void SpdkPageStore::AbortSlot(uint64_t slot, const PageKey& key) {
+    // Unless the slot durably holds its current key, the failed write left
+    // nothing usable behind; hand the slot back.
+    PageMeta meta = journal_.Get(slot);
+    std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+    // The key was evicted, deleted or moved while the write was in flight,
+    // and whoever did that owns the slot now.
+    if (slot_keys_[slot] != key) return;
+    if (meta.version != 0 && meta.file_id == key.file_id && meta.page_index == key.page_index) {
+        // Reads go by what the device still holds.
+        SetExtentLocked(slot, std::min<uint32_t>(meta.stored_size, kPageSize));
+        return;
+    }
+    if (policy_) policy_->OnRemove(slot);
+    DropKeyLocked(slot);
+    FreeExtentLocked(slot);
+}
+
+bool SpdkPageStore::OverlapsKeyLocked(uint64_t slot) const {
+    // No extent is longer than a page, so only runs starting less than a page
+    // before slot can reach into it.
+    uint64_t from = slot >= slots_per_page_ ? slot - (slots_per_page_ - 1) : 0;
+    for (uint64_t s = from; s < slot + slots_per_page_; s++) {
+        if (extents_[s].slots != 0 && s + extents_[s].slots > slot && slot_keys_[s] != kUnkeyed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpdkPageStore::ReleaseSlot(uint64_t slot) {
+    std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+    FreeExtentLocked(slot);
+}
+
+void SpdkPageStore::MaybeStartEviction() {
+    if (!policy_) return;
+    {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        if (evicting_ || slots_->FreeCount() >= opts_.evict_free_target) return;
+        evicting_ = true;
+    }
+    // Run after the current call returns so the caller's write goes first.
+    if (spdk_thread_send_msg(spdk_get_thread(), RunEviction, this) != 0) {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        evicting_ = false;
+    }
+}
+
+void SpdkPageStore::RunEviction(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    PageStoreChannel* ch = self->Ready() ? self->GetLocalChannel() : nullptr;
+    auto* ctx = new EvictCtx;
+    ctx->store = self;
+    {
+        std::lock_guard<std::shared_mutex> lock(self->meta_mutex_);
+        uint64_t freeSlots = self->slots_->FreeCount();
+        while (ch && ctx->records.size() < kEvictBatch &&
+               freeSlots < self->opts_.evict_free_target) {
+            uint64_t slot = self->policy_->Evict();
+            if (slot == EvictionPolicy::kNoVictim) break;
+            self->DropKeyLocked(slot);
+            freeSlots += std::max<uint32_t>(1, self->extents_[slot].slots);
+            ctx->records.push_back(JournalRecord{slot, 0, 0, kNoFileId, 0, 0, 0, {}});
+        }
+        if (ctx->records.empty()) {
+            self->evicting_ = false;
+            delete ctx;
+            return;
+        }
+    }
+    // Victims stay allocated until their removal is durable.
+    self->CommitEvictions(ch, ctx);
+}
+
+void SpdkPageStore::CommitDirectEvictions(PageStoreChannel* ch,
+                                          std::vector<JournalRecord> records) {
+    if (!ch) {
+        // Like a failed commit: the victims stay allocated, unkeyed, until
+        // the next Init.
+        std::cerr << "SPDK: Failed to journal " << records.size() << " evictions" << std::endl;
+        return;
+    }
+    auto* ctx = new EvictCtx;
+    ctx->store = this;
+    ctx->background = false;
+    ctx->records = std::move(records);
+    CommitEvictions(ch, ctx);
+}
+
+void SpdkPageStore::CommitEvictions(PageStoreChannel* ch, EvictCtx* ctx) {
+    ctx->waiter.records = ctx->records.data();
+    ctx->waiter.count = static_cast<uint32_t>(ctx->records.size());
+    ctx->waiter.done = OnEvictionCommitted;
+    ctx->waiter.ctx = ctx;
+    journal_.Commit(&ctx->waiter, ch->bdev_ch);
+}
+
+void SpdkPageStore::OnEvictionCommitted(JournalWaiter* w, bool success) {
+    auto* ctx = static_cast<EvictCtx*>(w->ctx);
+    SpdkPageStore* self = ctx->store;
+    {
+        std::lock_guard<std::shared_mutex> lock(self->meta_mutex_);
+        // On failure the victims stay allocated, unkeyed, until the next Init.
+        if (success) {
+            for (const JournalRecord& rec : ctx->records) self->FreeExtentLocked(rec.slot);
+        }
+        if (ctx->background) self->evicting_ = false;
+    }
+    if (success) self->MarkDirty(0, 0);
+    if (!success) {
+        std::cerr << "SPDK: Failed to journal " << ctx->records.size() << " evictions"
+                  << std::endl;
+    } else if (ctx->background) {
+        self->evicted_.fetch_add(ctx->records.size(), std::memory_order_relaxed);
+    }
+    delete ctx;
+    if (success) self->MaybeStartEviction();
+}
+
+PageEvictionStats SpdkPageStore::GetEvictionStats() const {
+    PageEvictionStats stats;
+    stats.evicted = evicted_.load(std::memory_order_relaxed);
+    stats.direct = direct_evictions_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SpdkPageStore::CopyAndWrite(PageStoreChannel* ch, uint64_t slot, const void* data,
+                                 bool keyed, IoCallback cb) {
+    // Nothing overtakes a parked write or run.
+    void* buf = ch->buf_waiters.empty() ? ch->buf_pool->Get() : nullptr;
+    if (!buf) {
+        if (opts_.buffer_pool_fallback) {
+            std::cerr << "SPDK: Failed to allocate write buffer" << std::endl;
+            cb(false);
+        } else {
+            ch->buf_waiters.push_back({slot, data, keyed, std::move(cb)});
+        }
+        return;
+    }
+    memcpy(buf, data, kPageSize);
+    IssueWrite(ch, slot, buf, ch->buf_pool.get(), keyed, std::move(cb));
+}
+
+void SpdkPageStore::IssueWrite(PageStoreChannel* ch, uint64_t slot, void* buf,
+                               PageBufferPool* pool, bool keyed, IoCallback cb) {
+    PageIoRequest* req = AllocRequest(ch, PageOp::kWrite, slot);
+    StartRequest(ch, req, PageTraceOp::kWrite, slot / slots_per_page_);
+    req->keyed = keyed;
+    req->buf = buf;
+    req->pool = pool;
+    req->cb = std::move(cb);
+    StartWrite(req);
+}
+
+void SpdkPageStore::StartWrite(PageIoRequest* req) {
+    PageStoreChannel* ch = req->ch;
+    req->record = JournalRecord{};
+    bool rejected;
+    {
+        std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+        // Checked where the slots are claimed, so that a PutPage cannot take
+        // them between the check and the write.
+        rejected = !req->keyed && OverlapsKeyLocked(req->slot);
+        if (!rejected) {
+            SetExtentLocked(req->slot, req->stored_size);
+            const SlotExtent& extent = extents_[req->slot];
+            const PageKey& key = slot_keys_[req->slot];
+            req->record.file_id = key.file_id;
+            req->record.page_index = key.page_index;
+            req->record.codec = static_cast<uint8_t>(extent.codec);
+        }
+    }
+    if (rejected) {
+        ReleaseBuffer(ch, req->pool, req->buf);
+        CompleteRequest(req, IoStatus::kIoError);
+        return;
+    }
+    req->record.stored_size = req->stored_size;
+    uint64_t len = static_cast<uint64_t>(SlotsFor(req->stored_size)) * slot_size_;
+    // Checksum the exact bytes handed to the device.
+    req->record.crc32 = Crc32c(req->buf, len);
+    req->io = BdevIo{this, ch, SPDK_BDEV_IO_TYPE_WRITE, PageIoClass::kFill, req->buf, nullptr, 0,
+                     data_offset_ + req->slot * slot_size_, len, OnWriteComplete, req, 0,
+                     nullptr, req->trace_id};
+    if (SubmitBdevIo(&req->io) != 0) {
+        ReleaseBuffer(ch, req->pool, req->buf);
+        AbortSlot(req->slot, {req->record.file_id, req->record.page_index});
+        CompleteRequest(req, false);
+    }
+}
+
+void SpdkPageStore::ReleaseBuffer(PageStoreChannel* ch, PageBufferPool* pool, void* buf) {
+    // Leased buffers may belong to another thread's pool; Put() handles that.
+    pool->Put(buf);
+    if (!ch->buf_waiters.empty()) ResumeBufferWaiters(ch);
+}
+
+void SpdkPageStore::ResumeBufferWaiters(PageStoreChannel* ch) {
+    // Each waiter leaves the list before it is issued, so one that completes
+    // at once and lands back here only sees those behind it.
+    while (!ch->buf_waiters.empty()) {
+        PageStoreChannel::PendingWrite& front = ch->buf_waiters.front();
+        if (front.run) {
+            auto* run = static_cast<RunCtx*>(front.run);
+            if (!TakeRunBuffers(run)) return;
+            ch->buf_waiters.pop_front();
+            IssueRun(run);
+            continue;
+        }
+        void* buf = ch->buf_pool->Get();
+        if (!buf) return;
+        PageStoreChannel::PendingWrite w = std::move(front);
+        ch->buf_waiters.pop_front();
+        memcpy(buf, w.data, kPageSize);
+        IssueWrite(ch, w.slot, buf, ch->buf_pool.get(), w.keyed, std::move(w.cb));
+    }
+}
+
+void SpdkPageStore::ReadPage(uint64_t pageId, void* buffer, IoCallback cb) {
+    if (!Ready() || pageId >= num_pages_) {
+        cb(false);
+        return;
+    }
+    if (recorder_) RecordCall(PageRecordOp::kRead, pageId, kPageSize, 0, cb);
+    if (opts_.readahead_max_pages && ReadAhead(pageId, buffer, cb)) return;
+    ReadSlot(SlotOf(pageId), buffer, std::move(cb));
+}
+
+bool SpdkPageStore::ReadAhead(uint64_t pageId, void* buffer, IoCallback& cb) {
+    if (!spdk_get_thread()) return false;
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) return false;
+    ReadAheadStream* s = FindStream(ch, pageId);
+    if (!s) return false;
+    ReadAheadSegment* seg = nullptr;
+    for (ReadAheadSegment& sg : s->segs) {
+        if (sg.state != ReadAheadSegment::State::kEmpty && pageId - sg.first < sg.count) seg = &sg;
+    }
+    // Skipping ahead within the staged pages still continues the run.
+    if (pageId == s->next || (seg && pageId > s->next)) {
+        s->run++;
+        s->next = pageId + 1;
+    }
+    if (s->run >= 2) PumpReadAhead(ch, s, pageId);
+    if (!seg) return false;
+
+    if (seg->state == ReadAheadSegment::State::kLoading) {
+        PageIoRequest* req = AllocRequest(ch, PageOp::kRead, SlotOf(pageId));
+        StartRequest(ch, req, PageTraceOp::kRead, pageId);
+        req->user_buf = buffer;
+        req->cb = std::move(cb);
+        if (seg->waiters_tail) {
+            seg->waiters_tail->next_free = req;
+        } else {
+            seg->waiters = req;
+        }
+        seg->waiters_tail = req;
+        Bump(ch->ra_waits);
+        return true;
+    }
+    // A hit never reaches the bdev; a stale page is traced again as a plain read.
+    uint64_t start = spdk_get_ticks();
+    uint64_t traceId = TraceSubmit(ch, PageTraceOp::kRead, pageId, kPageSize);
+    IoStatus status;
+    if (!CopyStaged(ch, seg, pageId, buffer, &status)) return false;
+    RecordOp(ch, PageStatOp::kRead, start, 1, kPageSize, status);
+    IoCallback done = std::move(cb);
+    done(status);
+    if (traceId) {
+        PageTrace(PageTraceOp::kRead, PageTraceStage::kCallbackDone, traceId, 0, status.code());
+    }
+    return true;
+}
+
+ReadAheadStream* SpdkPageStore::FindStream(PageStoreChannel* ch, uint64_t pageId) {
+    ReadAheadStream* victim = nullptr;
+    for (ReadAheadStream& s : ch->streams) {
+        bool match = s.next == pageId;
+        bool loading = false;
+        for (const ReadAheadSegment& seg : s.segs) {
+            if (seg.state == ReadAheadSegment::State::kEmpty) continue;
+            match = match || pageId - seg.first < seg.count;
+            loading = loading || seg.state == ReadAheadSegment::State::kLoading;
+        }
+        if (match) {
+            s.last_use = ++ch->stream_clock;
+            return &s;
+        }
+        // A stream is never replaced under a window in flight.
+        if (!loading && (!victim || s.last_use < victim->last_use)) victim = &s;
+    }
+    // Not part of any run: it may start one.
+    if (victim) {
+        for (ReadAheadSegment& seg : victim->segs) {
+            if (seg.state == ReadAheadSegment::State::kReady) RetireSegment(ch, victim, &seg);
+        }
+        victim->next = pageId + 1;
+        victim->run = 1;
+        victim->window = std::min(std::max(opts_.readahead_min_pages, 1u), opts_.readahead_max_pages);
+        victim->last_use = ++ch->stream_clock;
+    }
+    return nullptr;
+}
+
+void SpdkPageStore::PumpReadAhead(PageStoreChannel* ch, ReadAheadStream* s, uint64_t pageId) {
+    uint64_t end = pageId + 1; // first page not staged or loading
+    ReadAheadSegment* spare = nullptr;
+    for (ReadAheadSegment& seg : s->segs) {
+        if (seg.state == ReadAheadSegment::State::kEmpty) {
+            spare = &seg;
+        } else if (seg.first + seg.count <= pageId) {
+            // Already passed; reusable once loaded.
+            if (!spare && seg.state == ReadAheadSegment::State::kReady) spare = &seg;
+        } else {
+            end = std::max(end, seg.first + seg.count);
+        }
+    }
+    if (end - pageId - 1 > s->window / 2 || !spare || end >= num_pages_) return;
+    if (spare->state == ReadAheadSegment::State::kReady) RetireSegment(ch, s, spare);
+
+    if (!spare->buf) {
+        spare->buf = static_cast<char*>(spdk_malloc(
+            static_cast<size_t>(opts_.readahead_max_pages) * kPageSize, kPageSize, nullptr,
+            SPDK_ENV_SOCKET_ID_ANY, SPDK_MALLOC_DMA));
+        if (!spare->buf) return;
+        spare->versions.resize(opts_.readahead_max_pages);
+    }
+    uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(s->window, num_pages_ - end));
+    for (uint32_t i = 0; i < count; i++) spare->versions[i] = journal_.Get(SlotOf(end + i)).version;
+    spare->first = end;
+    spare->count = count;
+    spare->served = 0;
+    spare->state = ReadAheadSegment::State::kLoading;
+    spare->io = BdevIo{this, ch, SPDK_BDEV_IO_TYPE_READ, PageIoClass::kRead, spare->buf, nullptr, 0,
+                       data_offset_ + SlotOf(end) * slot_size_,
+                       static_cast<uint64_t>(count) * kPageSize, OnReadAheadDone, spare, 0,
+                       nullptr,
+                       TraceSubmit(ch, PageTraceOp::kRead, end,
+                                   static_cast<uint64_t>(count) * kPageSize)};
+    readahead_in_flight_.fetch_add(1, std::memory_order_relaxed);
+    if (SubmitBdevIo(&spare->io) != 0) {
+        spare->state = ReadAheadSegment::State::kEmpty;
+        readahead_in_flight_.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    Bump(ch->ra_reads);
+    Bump(ch->ra_pages, count);
+}
+
+void SpdkPageStore::RetireSegment(PageStoreChannel* ch, ReadAheadStream* s,
+                                  ReadAheadSegment* seg) {
+    uint32_t unread = seg->count - std::min(seg->served, seg->count);
+    Bump(ch->ra_wasted, unread);
+    if (unread == 0) {
+        s->window = std::min(s->window * 2, opts_.readahead_max_pages);
+    } else if (unread > seg->count / 2) {
+        s->window = std::max({s->window / 2, opts_.readahead_min_pages, 1u});
+    }
+    seg->state = ReadAheadSegment::State::kEmpty;
+}
+
+bool SpdkPageStore::CopyStaged(PageStoreChannel* ch, ReadAheadSegment* seg, uint64_t pageId,
+                               void* buffer, IoStatus* status) {
+    uint64_t slot = SlotOf(pageId);
+    uint64_t i = pageId - seg->first;
+    if (journal_.Get(slot).version != seg->versions[i]) {
+        Bump(ch->ra_stale);
+        return false;
+    }
+    const char* page = seg->buf + i * kPageSize;
+    *status = ShouldVerify(ch) ? VerifyPage(ch, slot, page) : IoStatus();
+    if (*status) memcpy(buffer, page, kPageSize);
+    seg->served++;
+    Bump(ch->ra_hits);
+    return true;
+}
+
+void SpdkPageStore::OnReadAheadDone(void* arg, bool success) {
+    auto* seg = static_cast<ReadAheadSegment*>(arg);
+    SpdkPageStore* self = seg->io.store;
+    PageStoreChannel* ch = seg->io.ch;
+    uint64_t traceId = seg->io.trace_id;
+    seg->state = success ? ReadAheadSegment::State::kReady : ReadAheadSegment::State::kEmpty;
+    PageIoRequest* waiters = seg->waiters;
+    seg->waiters = seg->waiters_tail = nullptr;
+    // Copy every parked page out before running callbacks, which may reuse
+    // the segment for the stream's next window.
+    for (PageIoRequest* req = waiters; req; req = req->next_free) {
+        if (success &&
+            self->CopyStaged(ch, seg, req->slot / self->slots_per_page_, req->user_buf, &req->status)) {
+            req->user_buf = nullptr;
+        }
+    }
+    while (waiters) {
+        PageIoRequest* req = waiters;
+        waiters = req->next_free;
+        if (!req->user_buf) {
+            CompleteRequest(req, req->status);
+            continue;
+        }
+        // Failed or rewritten since: read the page on its own.
+        uint64_t slot = req->slot;
+        void* buffer = req->user_buf;
+        IoCallback cb = std::move(req->cb);
+        FreeRequest(req);
+        self->ReadSlot(slot, buffer, std::move(cb));
+    }
+    // Ends once every parked read has been answered or reissued.
+    if (traceId) {
+        PageTrace(PageTraceOp::kRead, PageTraceStage::kCallbackDone, traceId, 0,
+                  IoStatus(success).code());
+    }
+    self->readahead_in_flight_.fetch_sub(1, std::memory_order_release);
+}
+
+void SpdkPageStore::ReadSlot(uint64_t slot, void* buffer, IoCallback cb) {
+    struct spdk_thread* owner = OwnerOf(slot);
+    if (owner && owner != spdk_get_thread()) {
+        Forward(owner, PageOp::kRead, slot, buffer, nullptr, false, std::move(cb));
+        return;
+    }
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    IssueRead(ch, slot, buffer, std::move(cb));
+}
+
+void SpdkPageStore::ReadPageLeased(uint64_t pageId, LeaseCallback cb) {
+    PageStoreChannel* ch = GetLocalChannel();
+    void* buf = ch ? ch->buf_pool->Get() : nullptr;
+    if (!buf) {
+        cb(false, PageLease());
+        return;
+    }
+    PageIoRequest* req = AllocRequest(ch, PageOp::kReadLeased, pageId);
+    req->buf = buf;
+    req->pool = ch->buf_pool.get();
+    req->lease_cb = std::move(cb);
+    ReadPage(pageId, buf, IoCallback(OnLeasedReadDone, req));
+}
+
+void SpdkPageStore::OnLeasedReadDone(void* arg, IoStatus status) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    LeaseCallback cb = std::move(req->lease_cb);
+    PageLease lease(req->pool, req->buf);
+    FreeRequest(req);
+    cb(status, std::move(lease));
+}
+
+bool SpdkPageStore::IsDmaSafe(const void* buf) {
+    auto p = static_cast<const char*>(buf);
+    uint64_t len = kPageSize;
+    if (spdk_vtophys(p, &len) == SPDK_VTOPHYS_ERROR) return false;
+    len = 1;
+    return spdk_vtophys(p + kPageSize - 1, &len) != SPDK_VTOPHYS_ERROR;
+}
+
+bool SpdkPageStore::ShouldVerify(PageStoreChannel* ch) {
+    switch (opts_.read_verify) {
+    case SpdkPageStoreOptions::ReadVerify::kAlways:
+        return true;
+    case SpdkPageStoreOptions::ReadVerify::kSampled:
+        return ch->verify_tick++ % std::max<uint32_t>(1, opts_.read_verify_interval) == 0;
+    default:
+        return false;
+    }
+}
+
+IoStatus SpdkPageStore::VerifyPage(PageStoreChannel* ch, uint64_t slot, const void* buf) {
+    PageMeta meta = journal_.Get(slot);
+    // Never-written pages have nothing to check against.
+    if (meta.version == 0) return IoStatus::kOk;
+    ch->crc_verified.store(ch->crc_verified.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+    // Compressed pages are checked as stored, before they are expanded.
+    size_t len = std::min<size_t>(SlotsFor(meta.stored_size) * slot_size_, kPageSize);
+    if (Crc32c(buf, len) == meta.crc32) return IoStatus::kOk;
+    ch->crc_mismatches.store(ch->crc_mismatches.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+    std::cerr << "SPDK: CRC32C mismatch on page at slot " << slot << std::endl;
+    return IoStatus::kChecksumMismatch;
+}
+
+void SpdkPageStore::IssueRead(PageStoreChannel* ch, uint64_t slot, void* buffer,
+                              IoCallback cb) {
+    uint64_t offset = data_offset_ + slot * slot_size_;
+    PageIoRequest* req = AllocRequest(ch, PageOp::kRead, slot);
+    StartRequest(ch, req, PageTraceOp::kRead, slot / slots_per_page_);
+    req->buf = buffer;
+    req->pool = ch->buf_pool.get();
+    req->cb = std::move(cb);
+    req->verify = ShouldVerify(ch);
+    if (!ch->buf_pool->Owns(buffer) && !IsDmaSafe(buffer)) {
+        // Never hand unpinned memory to the bdev layer: read into a pooled
+        // page and copy out on completion.
+        req->buf = ch->buf_pool->Get();
+        if (!req->buf) {
+            CompleteRequest(req, false);
+            return;
+        }
+        req->user_buf = buffer;
+    }
+
+    req->io = BdevIo{this, ch, SPDK_BDEV_IO_TYPE_READ, PageIoClass::kRead, req->buf, nullptr, 0,
+                     offset, kPageSize, OnReadComplete, req, 0, nullptr, req->trace_id};
+    if (SubmitBdevIo(&req->io) != 0) {
+        if (req->user_buf) req->pool->Put(req->buf);
+        CompleteRequest(req, false);
+    }
+}
+
+void SpdkPageStore::WritePages(std::span<const PageWrite> pages, IoCallback cb) {
+    if (!shard_threads_.empty()) {
+        // Pages of one batch may live on different owners. Per-page writes
+        // to one slot would race, so a repeated pageId keeps its last entry.
+        std::vector<PageWrite> last(pages.begin(), pages.end());
+        std::stable_sort(last.begin(), last.end(), [](const PageWrite& a, const PageWrite& b) {
+            return a.pageId < b.pageId;
+        });
+        auto kept = std::unique(last.rbegin(), last.rend(),
+                                [](const PageWrite& a, const PageWrite& b) {
+                                    return a.pageId == b.pageId;
+                                });
+        last.erase(last.begin(), kept.base());
+        PageStore::WritePages(last, std::move(cb));
+        return;
+    }
+    if (recorder_ && Ready() && !pages.empty()) {
+        RecordCall(PageRecordOp::kWrite, pages[0].pageId,
+                   static_cast<uint32_t>(pages.size() * kPageSize), kPageRecordBatch, cb);
+    }
+    std::vector<std::pair<uint64_t, void*>> entries;
+    entries.reserve(pages.size());
+    for (const PageWrite& page : pages) {
+        entries.emplace_back(page.pageId, const_cast<void*>(page.data));
+    }
+    SubmitBatch(true, std::move(entries), std::move(cb));
+}
+
+void SpdkPageStore::ReadPages(std::span<const PageRead> pages, IoCallback cb) {
+    if (!shard_threads_.empty()) {
+        PageStore::ReadPages(pages, std::move(cb));
+        return;
+    }
+    if (recorder_ && Ready() && !pages.empty()) {
+        RecordCall(PageRecordOp::kRead, pages[0].pageId,
+                   static_cast<uint32_t>(pages.size() * kPageSize), kPageRecordBatch, cb);
+    }
+    std::vector<std::pair<uint64_t, void*>> entries;
+    entries.reserve(pages.size());
+    for (const PageRead& page : pages) {
+        entries.emplace_back(page.pageId, page.buffer);
+    }
+    SubmitBatch(false, std::move(entries), std::move(cb));
+}
+
+uint64_t SpdkPageStore::BoundaryOf(uint64_t slot) const {
+    uint32_t boundary = spdk_bdev_get_optimal_io_boundary(bdev_);
+    if (boundary == 0) return 0;
+    uint64_t block = (data_offset_ + slot * slot_size_) / spdk_bdev_get_block_size(bdev_);
+    return block / boundary;
+}
+
+void SpdkPageStore::SubmitBatch(bool write, std::vector<std::pair<uint64_t, void*>> entries,
+                                IoCallback cb) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    for (auto& entry : entries) {
+        if (entry.first >= num_pages_) {
+            cb(false);
+            return;
+        }
+        entry.first = SlotOf(entry.first);
+    }
+    if (entries.empty()) {
+        cb(true);
+        return;
+    }
+    PageStoreChannel* ch = GetLocalChannel();
+    if (!ch) {
+        cb(false);
+        return;
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    if (write) {
+        // Two runs to one slot would race on the device and in the journal;
+        // a page written twice keeps its last copy, as if issued in order.
+        auto kept = std::unique(entries.rbegin(), entries.rend(),
+                                [](const auto& a, const auto& b) { return a.first == b.first; });
+        entries.erase(entries.begin(), kept.base());
+    }
+    if (write) {
+        // Raw writes may not touch keyed pages; the batch is all or nothing.
+        bool overlaps = false;
+        {
+            std::lock_guard<std::shared_mutex> lock(meta_mutex_);
+            for (const auto& entry : entries) overlaps = overlaps || OverlapsKeyLocked(entry.first);
+            if (!overlaps) {
+                for (const auto& entry : entries) SetExtentLocked(entry.first, kPageSize);
+            }
+        }
+        if (overlaps) {
+            cb(IoStatus::kIoError);
+            return;
+        }
+    }
+
+    size_t maxRunPages = std::min(kMaxBatchIovs,
+                                  std::max<size_t>(1, opts_.max_batch_io_size / kPageSize));
+    // A run waits for all of its buffers at once, so it must fit the pool.
+    if (!opts_.buffer_pool_fallback) {
+        maxRunPages = std::min(maxRunPages, std::max<size_t>(1, opts_.buffer_pool_size));
+    }
+    // The extra reference keeps runs that fail synchronously from completing
+    // the batch before every run has been submitted.
+    auto* batch = new BatchCtx{1, true, std::move(cb)};
+    RunCtx* run = nullptr;
+    uint64_t first = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto [slot, buf] = entries[i];
+        bool extend = run && slot == prev + slots_per_page_ && run->iovs.size() < maxRunPages &&
+                      BoundaryOf(slot) == BoundaryOf(first);
+        if (!extend) {
+            if (run) SubmitRun(ch, write, first, run);
+            run = new RunCtx;
+            run->store = this;
+            run->batch = batch;
+            run->pool = ch->buf_pool.get();
+            run->ch = ch;
+            run->write = write;
+            run->first_slot = slot;
+            batch->pending++;
+            first = slot;
+        }
+        prev = slot;
+        if (write) {
+            run->records.push_back(JournalRecord{slot, 1, 0, kNoFileId, 0, kPageSize, 0, {}});
+        }
+
+        if (write || (!ch->buf_pool->Owns(buf) && !IsDmaSafe(buf))) {
+            run->bounces.push_back({static_cast<uint32_t>(run->iovs.size()), buf});
+        }
+        run->iovs.push_back({buf, kPageSize});
+    }
+    SubmitRun(ch, write, first, run);
+    ReleaseBatch(batch, true);
+}
+
+void SpdkPageStore::SubmitRun(PageStoreChannel* ch, bool write, uint64_t firstSlot,
+                              RunCtx* run) {
+    if (ch->buf_waiters.empty() && TakeRunBuffers(run)) {
+        IssueRun(run);
+        return;
+    }
+    if (opts_.buffer_pool_fallback) {
+        // Only a failed one-off allocation gets here.
+        std::cerr << "SPDK: Failed to allocate " << (write ? "write" : "read")
+                  << " buffers for " << run->iovs.size() << " pages at slot " << firstSlot
+                  << std::endl;
+        FinishRun(run, false);
+        return;
+    }
+    // Parked like a single WritePage; its slots stay claimed meanwhile.
+    ch->buf_waiters.push_back({firstSlot, nullptr, false, IoCallback(), run});
+}
+
+bool SpdkPageStore::TakeRunBuffers(RunCtx* run) {
+    for (size_t i = 0; i < run->bounces.size(); i++) {
+        run->bounces[i].pooled = run->pool->Get();
+        if (run->bounces[i].pooled) continue;
+        for (size_t j = 0; j < i; j++) {
+            run->pool->Put(run->bounces[j].pooled);
+            run->bounces[j].pooled = nullptr;
+        }
+        return false;
+    }
+    for (const Bounce& b : run->bounces) {
+        run->iovs[b.iov].iov_base = b.pooled;
+        if (run->write) {
+            memcpy(b.pooled, b.caller, kPageSize);
+            run->records[b.iov].crc32 = Crc32c(b.pooled, kPageSize);
+        }
+    }
+    return true;
+}
+
+void SpdkPageStore::IssueRun(RunCtx* run) {
+    PageStoreChannel* ch = run->ch;
+    bool write = run->write;
+    uint64_t firstSlot = run->first_slot;
+    uint64_t offset = data_offset_ + firstSlot * slot_size_;
+    uint64_t len = run->iovs.size() * kPageSize;
+    int iovcnt = static_cast<int>(run->iovs.size());
+    run->start = spdk_get_ticks();
+    uint64_t traceId = TraceSubmit(ch, write ? PageTraceOp::kWrite : PageTraceOp::kRead,
+                                   firstSlot / slots_per_page_, len);
+    run->io = BdevIo{this, ch, write ? SPDK_BDEV_IO_TYPE_WRITE : SPDK_BDEV_IO_TYPE_READ,
+                     write ? PageIoClass::kFill : PageIoClass::kRead, nullptr, run->iovs.data(),
+                     iovcnt, offset, len, OnRunComplete, run, 0, nullptr, traceId};
+    if (SubmitBdevIo(&run->io) != 0) {
+        FinishRun(run, false);
+    }
+}
+
+void SpdkPageStore::FinishRun(RunCtx* run, bool success) {
+    IoStatus status = success;
+    if (success && !run->write) {
+        // iovs[i] holds page i of the run, bounced or not.
+        SpdkPageStore* self = run->store;
+        for (size_t i = 0; i < run->iovs.size() && status; i++) {
+            if (self->ShouldVerify(run->ch)) {
+                status = self->VerifyPage(run->ch, run->first_slot + i * self->slots_per_page_,
+                                          run->iovs[i].iov_base);
+            }
+        }
+    }
+    for (const Bounce& b : run->bounces) {
+        if (!b.pooled) continue;
+        if (status && !run->write) memcpy(b.caller, b.pooled, kPageSize);
+        run->pool->Put(b.pooled);
+    }
+    if (!run->bounces.empty() && !run->ch->buf_waiters.empty()) {
+        run->store->ResumeBufferWaiters(run->ch);
+    }
+    run->bounces.clear();
+    if (!status && run->write) {
+        for (const JournalRecord& rec : run->records) run->store->AbortSlot(rec.slot, kUnkeyed);
+    }
+    if (!status || !run->write) {
+        ReleaseRun(run, status);
+        return;
+    }
+    run->store->MarkDirty(run->first_slot, run->iovs.size() * run->store->slots_per_page_);
+    // One waiter covers every page of the run.
+    run->waiter.records = run->records.data();
+    run->waiter.count = static_cast<uint32_t>(run->records.size());
+    run->waiter.done = OnRunCommitted;
+    run->waiter.ctx = run;
+    run->store->journal_.Commit(&run->waiter, run->ch->bdev_ch);
+}
+
+void SpdkPageStore::OnRunCommitted(JournalWaiter* w, bool success) {
+    auto* run = static_cast<RunCtx*>(w->ctx);
+    run->status = success;
+    if (success) {
+        run->store->MarkDirty(run->first_slot, 0);
+    } else {
+        for (const JournalRecord& rec : run->records) run->store->AbortSlot(rec.slot, kUnkeyed);
+    }
+    if (run->ch->thread == spdk_get_thread() ||
+        spdk_thread_send_msg(run->ch->thread, RunDeferredRunRelease, run) != 0) {
+        ReleaseRun(run, run->status);
+    }
+}
+
+void SpdkPageStore::RunDeferredRunRelease(void* arg) {
+    auto* run = static_cast<RunCtx*>(arg);
+    ReleaseRun(run, run->status);
+}
+
+void SpdkPageStore::ReleaseRun(RunCtx* run, IoStatus status) {
+    BatchCtx* batch = run->batch;
+    if (run->start) {
+        run->store->RecordOp(run->ch, run->write ? PageStatOp::kWrite : PageStatOp::kRead,
+                             run->start, run->iovs.size(), run->iovs.size() * kPageSize, status);
+    }
+    uint64_t traceId = run->io.trace_id;
+    PageTraceOp op = run->write ? PageTraceOp::kWrite : PageTraceOp::kRead;
+    delete run;
+    // Only the batch's last run actually calls back.
+    ReleaseBatch(batch, status);
+    if (traceId) PageTrace(op, PageTraceStage::kCallbackDone, traceId, 0, status.code());
+}
+
+void SpdkPageStore::ReleaseBatch(BatchCtx* batch, IoStatus status) {
+    if (batch->status && !status) batch->status = status;
+    if (--batch->pending > 0) return;
+    IoCallback cb = std::move(batch->cb);
+    IoStatus result = batch->status;
+    delete batch;
+    cb(result);
+}
+
+void SpdkPageStore::Flush(IoCallback cb) {
+    PageStoreChannel* ch = Ready() ? GetLocalChannel() : nullptr;
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    if (recorder_) RecordCall(PageRecordOp::kFlush, 0, 0, 0, cb);
+    FlushWaiter* waiter = ch->free_flush_waiters;
+    if (waiter) {
+        ch->free_flush_waiters = waiter->next_free;
+        ch->free_flush_waiter_count--;
+    } else {
+        waiter = new FlushWaiter();
+    }
+    waiter->cb = std::move(cb);
+    waiter->origin = spdk_get_thread();
+    waiter->status = IoStatus::kOk;
+    waiter->ch = ch;
+    waiter->start = spdk_get_ticks();
+    waiter->trace_id = TraceSubmit(ch, PageTraceOp::kFlush, UINT64_MAX, 0);
+    waiter->round_trace_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        flush_waiters_.push_back(waiter);
+        // Whoever runs the current round starts the next one when it ends.
+        if (flush_active_) return;
+        flush_active_ = true;
+    }
+    if (opts_.flush_group_window_us != 0) {
+        flush_poller_ = spdk_poller_register(OnFlushWindow, this, opts_.flush_group_window_us);
+        if (flush_poller_) return;
+    }
+    StartFlushRound(this);
+}
+
+int SpdkPageStore::OnFlushWindow(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    spdk_poller_unregister(&self->flush_poller_);
+    StartFlushRound(self);
+    return SPDK_POLLER_BUSY;
+}
+
+void SpdkPageStore::StartFlushRound(void* arg) {
+    auto* self = static_cast<SpdkPageStore*>(arg);
+    PageStoreChannel* ch = self->GetLocalChannel();
+    FlushRound* round = ch ? ch->free_flush_rounds : nullptr;
+    if (round) {
+        ch->free_flush_rounds = round->next_free;
+    } else {
+        round = new FlushRound();
+        // Swapped into dirty_, which must never reallocate on the write path.
+        round->extents.reserve(kMaxDirtyExtents + 1);
+        round->ios.reserve(kMaxDirtyExtents + 1);
+    }
+    round->store = self;
+    round->ch = ch;
+    round->status = IoStatus::kOk;
+    round->trace_id = 0;
+    uint64_t checkpoints = self->journal_.GetStats().checkpoints;
+    {
+        std::lock_guard<std::mutex> lock(self->flush_mutex_);
+        round->waiters.swap(self->flush_waiters_);
+        round->extents.swap(self->dirty_);
+        // A checkpoint rewrites metadata without any record marking it.
+        round->meta = self->meta_dirty_ || checkpoints != self->flushed_checkpoints_;
+        self->meta_dirty_ = false;
+        self->flushed_checkpoints_ = checkpoints;
+    }
+    if (!ch) {
+        round->status = false;
+        FinishFlushRound(round);
+        return;
+    }
+    // Flushes are background work: they queue behind reads and fills rather
+    // than stalling them. The extra reference keeps the round alive until
+    // every range is issued.
+    if (PageTraceEnabled(PageTraceOp::kFlush)) round->trace_id = NextTraceId(ch);
+    size_t count = round->extents.size() + (round->meta ? 1 : 0);
+    round->ios.resize(count);
+    round->pending = count + 1;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t offset = 0;
+        uint64_t len = self->data_offset_;
+        if (i < round->extents.size()) {
+            const auto& [first, end] = round->extents[i];
+            offset = self->data_offset_ + first * self->slot_size_;
+            len = (end - first) * self->slot_size_;
+        }
+        BdevIo* io = &round->ios[i];
+        *io = BdevIo{self, ch, SPDK_BDEV_IO_TYPE_FLUSH, PageIoClass::kBackground, nullptr, nullptr,
+                     0, offset, len, OnRangeFlushed, round, 0, nullptr, round->trace_id};
+        if (self->SubmitBdevIo(io) != 0) {
+            round->status = false;
+            round->pending--;
+        }
+    }
+    if (--round->pending == 0) FinishFlushRound(round);
+}
+
+void SpdkPageStore::OnRangeFlushed(void* arg, bool success) {
+    auto* round = static_cast<FlushRound*>(arg);
+    if (!success) round->status = false;
+    if (--round->pending == 0) FinishFlushRound(round);
+}
+
+void SpdkPageStore::FinishFlushRound(FlushRound* round) {
+    SpdkPageStore* self = round->store;
+    if (!round->status) {
+        // Keep the ranges dirty so the next flush retries them.
+        for (const auto& [first, end] : round->extents) self->MarkDirty(first, end - first);
+        if (round->meta) self->MarkDirty(0, 0);
+    }
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(self->flush_mutex_);
+        more = !self->flush_waiters_.empty();
+        if (!more) self->flush_active_ = false;
+    }
+    struct spdk_thread* thread = spdk_get_thread();
+    for (FlushWaiter* w : round->waiters) {
+        w->status = round->status;
+        w->round_trace_id = round->trace_id;
+        if (w->origin == thread || spdk_thread_send_msg(w->origin, RunFlushWaiter, w) != 0) {
+            RunFlushWaiter(w);
+        }
+    }
+    round->waiters.clear();
+    round->extents.clear();
+    if (round->ch) {
+        round->next_free = round->ch->free_flush_rounds;
+        round->ch->free_flush_rounds = round;
+    } else {
+        delete round;
+    }
+    // Callers that arrived during this round have waited long enough.
+    if (more) StartFlushRound(self);
+}
+
+void SpdkPageStore::RunFlushWaiter(void* arg) {
+    auto* w = static_cast<FlushWaiter*>(arg);
+    w->ch->store->RecordOp(w->ch, PageStatOp::kFlush, w->start, 1, 0, w->status);
+    // Recycle first so the callback can reuse the waiter for its next Flush,
+    // unless the message to origin failed and this is another thread.
+    IoCallback cb = std::move(w->cb);
+    IoStatus status = w->status;
+    uint64_t traceId = w->trace_id;
+    uint64_t roundTraceId = w->round_trace_id;
+    PageStoreChannel* ch = w->ch;
+    if (w->origin == spdk_get_thread() && ch->free_flush_waiter_count < kMaxCachedRequests) {
+        w->next_free = ch->free_flush_waiters;
+        ch->free_flush_waiters = w;
+        ch->free_flush_waiter_count++;
+    } else {
+        delete w;
+    }
+    cb(status);
+    if (traceId) PageTraceFlushDone(traceId, status.code(), roundTraceId);
+}
+
+void SpdkPageStore::MarkDirty(uint64_t firstSlot, uint64_t count) {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    if (count == 0) {
+        meta_dirty_ = true;
+        return;
+    }
+    uint64_t end = firstSlot + count;
+    // Every extent from the first one ending at or after firstSlot up to the
+    // last one starting at or before end overlaps or touches the new range.
+    auto it = std::lower_bound(dirty_.begin(), dirty_.end(), firstSlot,
+                               [](const auto& extent, uint64_t slot) { return extent.second < slot; });
+    auto last = it;
+    while (last != dirty_.end() && last->first <= end) {
+        firstSlot = std::min(firstSlot, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+    if (it == last) {
+        dirty_.insert(it, {firstSlot, end});
+    } else {
+        *it = {firstSlot, end};
+        dirty_.erase(it + 1, last);
+    }
+    if (dirty_.size() > kMaxDirtyExtents) {
+        // Merge the two closest neighbours; the flush then also covers the gap.
+        size_t best = 0;
+        for (size_t i = 1; i + 1 < dirty_.size(); i++) {
+            if (dirty_[i + 1].first - dirty_[i].second <
+                dirty_[best + 1].first - dirty_[best].second) {
+                best = i;
+            }
+        }
+        dirty_[best].second = dirty_[best + 1].second;
+        dirty_.erase(dirty_.begin() + best + 1);
+    }
+}
+
+void SpdkPageStore::OnWriteComplete(void* arg, bool success) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    SpdkPageStore* self = req->store;
+    self->ReleaseBuffer(req->ch, req->pool, req->buf);
+    PageKey key{req->record.file_id, req->record.page_index};
+    if (!success) {
+        self->AbortSlot(req->slot, key);
+        CompleteRequest(req, false);
+        return;
+    }
+    bool current;
+    {
+        std::shared_lock<std::shared_mutex> lock(self->meta_mutex_);
+        current = self->slot_keys_[req->slot] == key;
+    }
+    if (!current) {
+        // The key was evicted or deleted while the write was in flight. Its
+        // removal is already queued in the journal, so a record now would
+        // land after it and bring the key back in a slot it no longer owns.
+        CompleteRequest(req, true);
+        return;
+    }
+    self->MarkDirty(req->slot, self->SlotsFor(req->stored_size));
+    // The write is acknowledged once its metadata record is durable; records
+    // of concurrent writes share one journal write.
+    req->record.slot = req->slot;
+    req->record.version = 1;
+    self->CommitRecord(req);
+}
+
+void SpdkPageStore::CommitRecord(PageIoRequest* req) {
+    req->waiter.records = &req->record;
+    req->waiter.count = 1;
+    req->waiter.done = OnJournalCommitted;
+    req->waiter.ctx = req;
+    journal_.Commit(&req->waiter, req->ch->bdev_ch);
+}
+
+void SpdkPageStore::OnJournalCommitted(JournalWaiter* w, bool success) {
+    auto* req = static_cast<PageIoRequest*>(w->ctx);
+    req->status = success;
+    if (success) req->store->MarkDirty(req->slot, 0);
+    // A deleted slot is only reused once the delete is durable.
+    if (success && req->op == PageOp::kDelete) req->store->ReleaseSlot(req->slot);
+    // The journal rolled the record back; the slot goes back to what it
+    // durably holds, like after a failed device write.
+    if (!success && req->op != PageOp::kDelete) {
+        req->store->AbortSlot(req->slot, {req->record.file_id, req->record.page_index});
+    }
+    struct spdk_thread* owner = req->ch->thread;
+    if (owner == spdk_get_thread()) {
+        CompleteRequest(req, success);
+    } else if (spdk_thread_send_msg(owner, RunDeferredCompletion, req) != 0) {
+        // Cannot reach the owner; never touch its free list from here.
+        req->ch = nullptr;
+        CompleteRequest(req, success);
+    }
+}
+
+void SpdkPageStore::RunDeferredCompletion(void* arg) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    CompleteRequest(req, req->status);
+}
+
+void SpdkPageStore::OnReadComplete(void* arg, bool success) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    IoStatus status = success;
+    if (success && req->verify) {
+        status = req->store->VerifyPage(req->ch, req->slot, req->buf);
+    }
+    if (req->op == PageOp::kReadCompressed) {
+        if (status) {
+            req->iovs[0] = {req->buf, req->stored_size};
+            req->iovs[1] = {req->user_buf, kPageSize};
+            int rc = spdk_accel_submit_decompress(req->ch->accel_ch, &req->iovs[1], 1,
+                                                  &req->iovs[0], 1, &req->stored_size,
+                                                  OnDecompressed, req);
+            if (rc == 0) return;
+            status = false;
+        }
+        req->store->ReleaseBuffer(req->ch, req->pool, req->buf);
+        CompleteRequest(req, status);
+        return;
+    }
+    if (req->user_buf) {
+        if (status) memcpy(req->user_buf, req->buf, kPageSize);
+        req->store->ReleaseBuffer(req->ch, req->pool, req->buf);
+    }
+    CompleteRequest(req, status);
+}
+
+void SpdkPageStore::OnDecompressed(void* arg, int status) {
+    auto* req = static_cast<PageIoRequest*>(arg);
+    req->store->ReleaseBuffer(req->ch, req->pool, req->buf);
+    // stored_size now holds the expanded length.
+    if (status != 0 || req->stored_size != kPageSize) {
+        std::cerr << "SPDK: Failed to decompress page at slot " << req->slot << std::endl;
+        CompleteRequest(req, false);
+        return;
+    }
+    CompleteRequest(req, true);
+}
+
+void SpdkPageStore::OnRunComplete(void* arg, bool success) {
+    FinishRun(static_cast<RunCtx*>(arg), success);
+}
+
+int SpdkPageStore::SubmitBdevIo(BdevIo* io) {
+    PageStoreChannel* ch = io->ch;
+    size_t c = static_cast<size_t>(io->cls);
+    PageStoreChannel::IoClassQueue& q = ch->classes[c];
+    uint64_t delay = 0;
+    // I/Os of its class go in order, and none go while the bdev is out of
+    // bdev_ios; other classes do not hold it back.
+    if (q.head || ch->io_wait_armed || !CanDispatch(ch, c, &delay)) {
+        EnqueueBdevIo(ch, io, false);
+        if (delay) {
+            q.throttled_io = io;
+            Bump(q.throttled);
+            ArmThrottle(ch, delay);
+        }
+        return 0;
+    }
+    int rc = IssueBdevIo(io);
+    if (rc != -ENOMEM) return rc;
+    EnqueueBdevIo(ch, io, false);
+    ArmIoWait(ch);
+    return 0;
+}
+
+int SpdkPageStore::IssueBdevIo(BdevIo* io) {
+    PageStoreChannel* ch = io->ch;
+    bool write = io->type == SPDK_BDEV_IO_TYPE_WRITE;
+    int rc;
+    if (io->type == SPDK_BDEV_IO_TYPE_FLUSH) {
+        rc = spdk_bdev_flush(desc_, ch->bdev_ch, io->offset, io->len, OnBdevIoDone, io);
+    } else if (io->iovs) {
+        rc = write
+            ? spdk_bdev_writev(desc_, ch->bdev_ch, io->iovs, io->iovcnt, io->offset, io->len,
+                               OnBdevIoDone, io)
+            : spdk_bdev_readv(desc_, ch->bdev_ch, io->iovs, io->iovcnt, io->offset, io->len,
+                              OnBdevIoDone, io);
+    } else {
+        rc = write
+            ? spdk_bdev_write(desc_, ch->bdev_ch, io->buf, io->offset, io->len, OnBdevIoDone, io)
+            : spdk_bdev_read(desc_, ch->bdev_ch, io->buf, io->offset, io->len, OnBdevIoDone, io);
+    }
+    if (rc == 0) {
+        if (io->trace_id) {
+            PageTrace(TraceOpOf(io->type), PageTraceStage::kBdevSubmit, io->trace_id, io->len,
+                      io->offset);
+        }
+        size_t c = static_cast<size_t>(io->cls);
+        PageStoreChannel::IoClassQueue& q = ch->classes[c];
+        TakeToken(ch, c);
+        Bump(q.in_flight);
+        Bump(q.dispatched);
+        uint64_t depth = ch->in_flight.load(std::memory_order_relaxed) + 1;
+        ch->in_flight.store(depth, std::memory_order_relaxed);
+        if (depth > ch->peak_in_flight.load(std::memory_order_relaxed)) {
+            ch->peak_in_flight.store(depth, std::memory_order_relaxed);
+        }
+    } else if (rc == -ENOMEM) {
+        Bump(ch->enomem);
+    }
+    return rc;
+}
+
+bool SpdkPageStore::CanDispatch(PageStoreChannel* ch, size_t c, uint64_t* delay) const {
+    const PageIoClassLimits& limits = opts_.io_classes[c];
+    const PageStoreChannel::IoClassQueue& q = ch->classes[c];
+    uint64_t in_flight = q.in_flight.load(std::memory_order_relaxed);
+    *delay = 0;
+    if (limits.max_in_flight && in_flight >= limits.max_in_flight) return false;
+    // The thread-wide cap never holds a class at zero, so a saturating class
+    // cannot starve the ones after it.
+    if (in_flight && opts_.max_in_flight &&
+        ch->in_flight.load(std::memory_order_relaxed) >= opts_.max_in_flight) {
+        return false;
+    }
+    if (limits.iops) {
+        // GCRA form of the token bucket: one I/O is due every interval, and up
+        // to burst - 1 of them may go ahead of schedule.
+        uint64_t interval = spdk_get_ticks_hz() / limits.iops;
+        uint64_t allowance = interval * (std::max<uint32_t>(limits.burst, 1) - 1);
+        uint64_t now = spdk_get_ticks();
+        if (q.tat > now + allowance) {
+            *delay = q.tat - now - allowance;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SpdkPageStore::TakeToken(PageStoreChannel* ch, size_t c) {
+    const PageIoClassLimits& limits = opts_.io_classes[c];
+    if (!limits.iops) return;
+    uint64_t& tat = ch->classes[c].tat;
+    tat = std::max(tat, spdk_get_ticks()) + spdk_get_ticks_hz() / limits.iops;
+}
+
+void SpdkPageStore::EnqueueBdevIo(PageStoreChannel* ch, BdevIo* io, bool front) {
+    PageStoreChannel::IoClassQueue& q = ch->classes[static_cast<size_t>(io->cls)];
+    if (front) {
+        // A retried I/O keeps its place and its original wait start.
+        io->next = q.head;
+        q.head = io;
+        if (!q.tail) q.tail = io;
+    } else {
+        io->queued_at = spdk_get_ticks();
+        io->next = nullptr;
+        if (q.tail) {
+            q.tail->next = io;
+        } else {
+            q.head = io;
+        }
+        q.tail = io;
+        Bump(q.waited);
+    }
+    Bump(q.queued);
+    uint64_t queued = ch->queued.load(std::memory_order_relaxed) + 1;
+    ch->queued.store(queued, std::memory_order_relaxed);
+    if (queued > ch->peak_queued.load(std::memory_order_relaxed)) {
+        ch->peak_queued.store(queued, std::memory_order_relaxed);
+    }
+}
+
+void SpdkPageStore::DrainBdevIos(PageStoreChannel* ch) {
+    uint64_t throttle = 0; // soonest token bucket refill among waiting classes
+    for (size_t c = 0; c < kNumPageIoClasses; c++) {
+        PageStoreChannel::IoClassQueue& q = ch->classes[c];
+        uint64_t delay = 0;
+        while (q.head && CanDispatch(ch, c, &delay)) {
+            BdevIo* io = q.head;
+            q.head = io->next;
+            if (!q.head) q.tail = nullptr;
+            q.queued.store(q.queued.load(std::memory_order_relaxed) - 1,
+                           std::memory_order_relaxed);
+            ch->queued.store(ch->queued.load(std::memory_order_relaxed) - 1,
+                             std::memory_order_relaxed);
+            int rc = IssueBdevIo(io);
+            if (rc == -ENOMEM) {
+                EnqueueBdevIo(ch, io, true);
+                ArmIoWait(ch);
+                return;
+            }
+            uint64_t us = (spdk_get_ticks() - io->queued_at) * 1000000 / spdk_get_ticks_hz();
+            Bump(q.wait_us, us);
+            if (us > q.max_wait_us.load(std::memory_order_relaxed)) {
+                q.max_wait_us.store(us, std::memory_order_relaxed);
+            }
+            if (rc != 0) io->done(io->ctx, false);
+        }
+        if (!delay) continue;
+        if (q.throttled_io != q.head) {
+            q.throttled_io = q.head;
+            Bump(q.throttled);
+        }
+        throttle = throttle ? std::min(throttle, delay) : delay;
+    }
+    if (throttle) ArmThrottle(ch, throttle);
+}
+
+void SpdkPageStore::ArmIoWait(PageStoreChannel* ch) {
+    if (ch->io_wait_armed) return;
+    ch->io_wait.bdev = bdev_;
+    ch->io_wait.cb_fn = OnIoWait;
+    ch->io_wait.cb_arg = ch;
+    if (spdk_bdev_queue_io_wait(bdev_, ch->bdev_ch, &ch->io_wait) == 0) {
+        ch->io_wait_armed = true;
+        return;
+    }
+    // Refused because this thread's bdev_io cache is not empty after all:
+    // retry on the next message pass instead.
+    ch->io_wait_armed = spdk_thread_send_msg(ch->thread, OnIoWait, ch) == 0;
+}
+
+void SpdkPageStore::OnIoWait(void* arg) {
+    auto* ch = static_cast<PageStoreChannel*>(arg);
+    ch->io_wait_armed = false;
+    ch->store->DrainBdevIos(ch);
+}
+
+void SpdkPageStore::ArmThrottle(PageStoreChannel* ch, uint64_t delay) {
+    uint64_t at = spdk_get_ticks() + delay;
+    if (ch->throttle_poller) {
+        if (at >= ch->throttle_at) return;
+        spdk_poller_unregister(&ch->throttle_poller);
+    }
+    ch->throttle_at = at;
+    uint64_t us = delay * 1000000 / spdk_get_ticks_hz() + 1;
+    ch->throttle_poller = spdk_poller_register(OnThrottleExpired, ch, us);
+    if (!ch->throttle_poller) {
+        std::cerr << "SPDK: Failed to register I/O throttle poller" << std::endl;
+    }
+}
+
+int SpdkPageStore::OnThrottleExpired(void* arg) {
+    auto* ch = static_cast<PageStoreChannel*>(arg);
+    spdk_poller_unregister(&ch->throttle_poller);
+    ch->store->DrainBdevIos(ch);
+    return SPDK_POLLER_BUSY;
+}
+
+void SpdkPageStore::OnBdevIoDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* io = static_cast<BdevIo*>(cb_arg);
+    PageStoreChannel* ch = io->ch;
+    PageStoreChannel::IoClassQueue& q = ch->classes[static_cast<size_t>(io->cls)];
+    spdk_bdev_free_io(bdev_io);
+    if (io->trace_id) {
+        PageTrace(TraceOpOf(io->type), PageTraceStage::kBdevDone, io->trace_id, io->len, success);
+    }
+    q.in_flight.store(q.in_flight.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    ch->in_flight.store(ch->in_flight.load(std::memory_order_relaxed) - 1,
+                        std::memory_order_relaxed);
+    // Waiting I/Os take the freed slot before anything the completion submits.
+    io->store->DrainBdevIos(ch);
+    io->done(io->ctx, success);
 }
@@ -4,28 +4,48 @@
 
 #pragma once
 
+#include <spdk/accel.h>
 #include <spdk/bdev.h>
 #include <spdk/env.h>
 #include <spdk/thread.h>
 #include <spdk/log.h>
+#include "io_callback.h"
+#include "page_buffer_pool.h"
+#include "page_eviction.h"
+#include "page_index.h"
+#include "page_meta_journal.h"
+#include "page_recorder.h"
+#include "page_stats.h"
+#include "page_task.h"
+#include "page_trace.h"
+#include "slot_allocator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
-#include <functional>
-#include <bitset>
 #include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
 #include <iostream>
 #include <cstring>
 
 constexpr size_t kPageSize = 4096;
-constexpr size_t kMetadataSize = 1024 * 1024;
-constexpr size_t kMaxPages = (1024 * 1024 * 1024) / kPageSize; // 1GB space
 
-struct PageMeta {
-    uint32_t version;
-    uint32_t crc32;
+// Completion of a leased read: on success the lease holds the page data.
+using LeaseCallback = InplaceCallback<void(IoStatus, PageLease)>;
+
+struct PageWrite {
+    uint64_t pageId;
+    const void* data;
 };
 
-using IoCallback = std::function<void(bool)>;
+struct PageRead {
+    uint64_t pageId;
+    void* buffer;
+};
 
 class PageStore {
 public:
@@ -34,36 +54,813 @@ public:
     virtual void WritePage(uint64_t pageId, const void* data, IoCallback cb) = 0;
     virtual void ReadPage(uint64_t pageId, void* buffer, IoCallback cb) = 0;
     virtual void Flush(IoCallback cb) = 0;
+
+    // Batch variants: cb fires once, after every page in the batch completed,
+    // with kOk only if all of them succeeded (else the first failure seen).
+    // The defaults issue one single-page request per entry.
+    virtual void WritePages(std::span<const PageWrite> pages, IoCallback cb);
+    virtual void ReadPages(std::span<const PageRead> pages, IoCallback cb);
+
+    // Awaitable forms for PageTask coroutines, e.g.
+    // IoStatus status = co_await store.Read(pageId, buf). Buffers and spans
+    // must stay valid until the co_await returns.
+    IoAwaitable Read(uint64_t pageId, void* buffer) {
+        return IoAwaitable([this, pageId, buffer](IoCallback cb) {
+            ReadPage(pageId, buffer, std::move(cb));
+        });
+    }
+    IoAwaitable Write(uint64_t pageId, const void* data) {
+        return IoAwaitable([this, pageId, data](IoCallback cb) {
+            WritePage(pageId, data, std::move(cb));
+        });
+    }
+    IoAwaitable Read(std::span<const PageRead> pages) {
+        return IoAwaitable([this, pages](IoCallback cb) { ReadPages(pages, std::move(cb)); });
+    }
+    IoAwaitable Write(std::span<const PageWrite> pages) {
+        return IoAwaitable([this, pages](IoCallback cb) { WritePages(pages, std::move(cb)); });
+    }
+    IoAwaitable Sync() {
+        return IoAwaitable([this](IoCallback cb) { Flush(std::move(cb)); });
+    }
+};
+
+// Scheduling class of a data I/O. Waiting I/Os are dispatched in this order.
+enum class PageIoClass : uint8_t {
+    kRead,       // foreground reads: ReadPage, GetPage, ReadPages, read-ahead
+    kFill,       // cache fills: WritePage, PutPage, WritePages
+    kBackground, // maintenance such as the range flushes behind Flush
+};
+constexpr size_t kNumPageIoClasses = 3;
+
+struct PageIoClassLimits {
+    // I/Os of the class a thread keeps at the bdev at once; 0 = bounded only
+    // by max_in_flight.
+    uint32_t max_in_flight = 0;
+    // Token bucket per thread: sustained I/Os per second, and how many may go
+    // back to back after an idle spell. iops = 0 disables it.
+    uint32_t iops = 0;
+    uint32_t burst = 1;
+};
+
+struct SpdkPageStoreOptions {
+    // Pinned page buffers pre-allocated per SPDK thread for the write path.
+    size_t buffer_pool_size = 256;
+    // When the pool runs dry, allocate a one-off DMA buffer (true) or park the
+    // write until a pooled buffer is returned (false). With backpressure the
+    // caller's data must stay valid until the write callback fires.
+    bool buffer_pool_fallback = true;
+    // Upper bound on a single coalesced WritePages/ReadPages request. Runs are
+    // also cut at the bdev's optimal I/O boundary.
+    size_t max_batch_io_size = 128 * 1024;
+    // 4 KiB blocks in the on-device metadata journal ring. A checkpoint is
+    // taken whenever half of the ring is in use.
+    uint64_t metadata_journal_blocks = 1024;
+    // Data reads and writes (a coalesced batch run counts as one) a thread
+    // keeps at the bdev at once; further ones wait in a per-thread FIFO and
+    // are issued as earlier ones complete. A submission the bdev refuses with
+    // -ENOMEM (its bdev_io pool is momentarily empty) waits there too and is
+    // retried through spdk_bdev_queue_io_wait instead of failing. 0 = no cap.
+    uint32_t max_in_flight = 128;
+    // Per-class limits, indexed by PageIoClass. Each class waits in its own
+    // FIFO, and a freed slot always goes to the first class in PageIoClass
+    // order that is within its limits, so reads never queue behind a burst
+    // of fills and fills never take the slots held back for reads. Every class
+    // may still keep one I/O at the bdev when max_in_flight is reached, which
+    // keeps background work moving under a saturating read load.
+    std::array<PageIoClassLimits, kNumPageIoClasses> io_classes = {{
+        {0, 0, 1},  // kRead
+        {64, 0, 1}, // kFill
+        {8, 0, 1},  // kBackground
+    }};
+    // Cap on the pages carved out of the bdev; 0 uses the whole device. Host
+    // memory for metadata is about 135 bytes per slot once the cache is full
+    // (table, allocator, eviction state and index) and each of the two
+    // on-device checkpoints takes 32 bytes per slot. The default, 2^26 pages
+    // (256 GiB of 4 KiB pages), keeps that near 9 GiB; a 7.68 TB drive used
+    // whole needs roughly 240 GB, four times that with compression slots.
+    uint64_t max_pages = uint64_t{1} << 26;
+    // Compress keyed pages (PutPage) through the SPDK accel framework, which
+    // runs the codec in its software module unless an accel_assign_opc RPC
+    // moves it to hardware. The device is then split into
+    // compression_slot_size slots and a page takes as many consecutive slots
+    // as its compressed length needs; pages that would not save a slot are
+    // stored raw. Raw pageIds always take a whole page. Metadata is sized per
+    // slot, so host memory grows with kPageSize / compression_slot_size.
+    // Changing either setting reformats the store.
+    PageCodec compression = PageCodec::kNone;
+    uint32_t compression_slot_size = 1024;
+    // Check pages read back against the CRC32C recorded when they were
+    // written. kSampled verifies one in read_verify_interval reads per thread.
+    // A mismatch completes the read with IoStatus::kChecksumMismatch.
+    enum class ReadVerify : uint8_t { kOff, kSampled, kAlways };
+    ReadVerify read_verify = ReadVerify::kAlways;
+    uint32_t read_verify_interval = 16;
+    // Replacement policy for keyed pages. Background eviction keeps at least
+    // evict_free_target slots free, so PutPage only picks a victim inline
+    // when writes outrun it.
+    EvictionPolicyType eviction = EvictionPolicyType::kS3Fifo;
+    uint64_t evict_free_target = 1024;
+    // Flush only covers pages written, and metadata changed, since the last
+    // flush. Calls arriving while a device flush is in flight share the next
+    // one; a non-zero window also holds an idle flush back this long so that
+    // concurrent callers can join it.
+    uint32_t flush_group_window_us = 0;
+    // Sequential read-ahead for ReadPage. Each thread follows up to
+    // readahead_streams runs of consecutive pageIds; once a run is two pages
+    // long, the pages after it are read in one request of readahead window
+    // pages into a staging buffer, and the next window is requested when the
+    // reader is half way through the current one. The window starts at
+    // readahead_min_pages, doubles each time a staged window was read in
+    // full, and halves when most of one was dropped unread. Staged pages are
+    // only served while their metadata version is unchanged, so a page
+    // rewritten after it was staged is read from the device again. Each
+    // stream pins two windows of readahead_max_pages pages; 0 disables it.
+    uint32_t readahead_max_pages = 32;
+    uint32_t readahead_min_pages = 4;
+    uint32_t readahead_streams = 8;
+    // Capture of every API call (issue time, op, pageId or key hash, size,
+    // latency, status) into record_path for tools/pagestore_replay; empty
+    // disables it. The file is a ring of the last record_capacity 32-byte
+    // records, rewritten from the start each time the store is opened.
+    std::string record_path;
+    uint64_t record_capacity = 1 << 20;
+};
+
+struct PageEvictionStats {
+    uint64_t evicted = 0; // freed ahead of time by background eviction
+    uint64_t direct = 0;  // victims PutPage had to evict inline
+};
+
+struct PageLookupStats {
+    uint64_t hits = 0;   // GetPage calls that found their key
+    uint64_t misses = 0; // GetPage calls answered kNotFound
+};
+
+struct PageIntegrityStats {
+    uint64_t verified = 0;   // reads whose CRC32C was checked
+    uint64_t mismatches = 0;
+};
+
+struct PageReadAheadStats {
+    uint64_t reads = 0;   // read-ahead requests issued
+    uint64_t pages = 0;   // pages they covered
+    uint64_t hits = 0;    // ReadPage calls served from staged pages
+    uint64_t waits = 0;   // of those, ones that waited for their read-ahead
+    uint64_t stale = 0;   // staged pages rewritten since, read again instead
+    uint64_t wasted = 0;  // staged pages dropped unread
+};
+
+struct PageCompressionStats {
+    uint64_t compressed = 0;     // keyed pages stored compressed
+    uint64_t incompressible = 0; // keyed pages stored raw to save nothing
+    uint64_t bytes_saved = 0;    // device bytes compressed pages did not take
+};
+
+struct PageIoClassStats {
+    uint64_t in_flight = 0;   // at the bdev now
+    uint64_t queued = 0;      // waiting for admission now
+    uint64_t dispatched = 0;  // issued to the bdev
+    uint64_t waited = 0;      // had to wait at all
+    uint64_t throttled = 0;   // dispatches held back by the token bucket
+    uint64_t wait_us = 0;     // total time spent waiting
+    uint64_t max_wait_us = 0;
+
+    PageIoClassStats& operator+=(const PageIoClassStats& o) {
+        in_flight += o.in_flight;
+        queued += o.queued;
+        dispatched += o.dispatched;
+        waited += o.waited;
+        throttled += o.throttled;
+        wait_us += o.wait_us;
+        max_wait_us = std::max(max_wait_us, o.max_wait_us);
+        return *this;
+    }
+};
+
+// Admission counters summed over all threads; use them to size
+// max_in_flight, io_classes and the bdev_io / iobuf pools.
+struct PageQueueStats {
+    uint64_t in_flight = 0;      // data I/Os at the bdev now
+    uint64_t queued = 0;         // data I/Os waiting for admission now
+    uint64_t peak_in_flight = 0; // highest per-thread in_flight seen
+    uint64_t peak_queued = 0;    // longest per-thread wait queue seen
+    uint64_t waited = 0;         // I/Os that had to wait at all
+    uint64_t enomem = 0;         // submissions refused with -ENOMEM
+    uint64_t wait_us = 0;        // total time spent waiting
+    uint64_t max_wait_us = 0;
+    std::array<PageIoClassStats, kNumPageIoClasses> classes; // by PageIoClass
+
+    PageQueueStats& operator+=(const PageQueueStats& o) {
+        in_flight += o.in_flight;
+        queued += o.queued;
+        peak_in_flight = std::max(peak_in_flight, o.peak_in_flight);
+        peak_queued = std::max(peak_queued, o.peak_queued);
+        waited += o.waited;
+        enomem += o.enomem;
+        wait_us += o.wait_us;
+        max_wait_us = std::max(max_wait_us, o.max_wait_us);
+        for (size_t c = 0; c < kNumPageIoClasses; c++) classes[c] += o.classes[c];
+        return *this;
+    }
+};
+
+class SpdkPageStore;
+struct PageStoreChannel;
+
+// One data read, write or flush on its way to the bdev: a single buffer, or
+// iovcnt iovs. Embedded in the request, batch run or flush round it belongs
+// to, so waiting for admission costs no allocation. done runs once the bdev
+// completed it or it could not be submitted after waiting.
+struct BdevIo {
+    SpdkPageStore* store;
+    PageStoreChannel* ch;
+    enum spdk_bdev_io_type type; // READ, WRITE or FLUSH
+    PageIoClass cls;
+    void* buf;
+    struct iovec* iovs;
+    int iovcnt;
+    uint64_t offset;
+    uint64_t len;
+    void (*done)(void* ctx, bool success);
+    void* ctx;
+    uint64_t queued_at;     // spdk_get_ticks() when it started waiting
+    BdevIo* next;
+    uint64_t trace_id;      // 0 while tracing is off; see page_trace.h
+};
+
+enum class PageOp : uint8_t {
+    kWrite,
+    kWriteLeased,
+    kRead,
+    kReadLeased,
+    kReadCompressed,
+    kDelete,
+    kGet, // holds a keyed read's slot; the key rides in record
+};
+
+// Context of one in-flight single-page operation (or one shard hop). Recycled
+// through the owning channel's intrusive free list, so the steady-state
+// WritePage/ReadPage/Flush path performs no heap allocation.
+struct PageIoRequest {
+    SpdkPageStore* store;
+    PageStoreChannel* ch;   // free list this request returns to; nullptr = heap
+    PageOp op;
+    bool verify;            // check the read against the stored CRC32C
+    bool keyed;             // a PutPage write; raw writes may not touch keyed slots
+    IoStatus status;
+    uint64_t slot;          // first device slot of the page
+    uint32_t stored_size;   // bytes of page data at slot, compressed or not
+    void* buf;              // DMA buffer handed to the bdev
+    void* user_buf;         // caller buffer when buf is a bounce page
+    PageBufferPool* pool;   // owner of buf, if pooled
+    struct spdk_thread* origin;
+    IoCallback cb;
+    LeaseCallback lease_cb;
+    JournalRecord record;   // metadata update of a completed write or delete
+    JournalWaiter waiter;
+    struct iovec iovs[2];   // accel source and destination
+    BdevIo io;
+    uint64_t start;         // spdk_get_ticks() when issued; 0 if not measured
+    uint64_t trace_id;
+    PageIoRequest* next_free;
+};
+
+// One read-ahead window of a sequential stream, staged in a DMA buffer of
+// readahead_max_pages pages.
+struct ReadAheadSegment {
+    enum class State : uint8_t { kEmpty, kLoading, kReady };
+
+    State state = State::kEmpty;
+    uint64_t first = 0;    // pageId of the first staged page
+    uint32_t count = 0;
+    uint32_t served = 0;   // ReadPage calls it satisfied
+    char* buf = nullptr;
+    std::vector<uint32_t> versions;  // metadata versions when it was issued
+    PageIoRequest* waiters = nullptr; // reads parked until it lands, FIFO
+    PageIoRequest* waiters_tail = nullptr;
+    BdevIo io;
+};
+
+struct ReadAheadStream {
+    uint64_t next = UINT64_MAX; // pageId that continues the run
+    uint32_t run = 0;           // consecutive pages seen
+    uint32_t window = 0;        // pages per read-ahead
+    uint64_t last_use = 0;      // for replacing the least recently used stream
+    std::array<ReadAheadSegment, 2> segs;
+};
+
+// Per-SPDK-thread state of a store. Created lazily the first time a thread
+// submits I/O and only ever touched from that thread afterwards.
+struct PageStoreChannel {
+    // A call being captured for SpdkPageStoreOptions::record_path; wraps the
+    // caller's callback until the call completes.
+    struct RecordedCall {
+        SpdkPageStore* store = nullptr;
+        PageStoreChannel* ch = nullptr;
+        IoCallback cb;
+        uint64_t start = 0;
+        uint64_t page = 0;
+        uint32_t size = 0;
+        PageRecordOp op = PageRecordOp::kRead;
+        uint16_t flags = 0;
+        RecordedCall* next_free = nullptr;
+    };
+
+    // A Flush caller, completed on its own thread.
+    struct FlushWaiter {
+        IoCallback cb;
+        struct spdk_thread* origin = nullptr;
+        IoStatus status;
+        PageStoreChannel* ch = nullptr; // of origin
+        uint64_t start = 0;
+        uint64_t trace_id = 0;
+        uint64_t round_trace_id = 0; // of the round that answered it
+        FlushWaiter* next_free = nullptr;
+    };
+
+    // One device flush and the callers it answers. Recycled with its vectors,
+    // whose capacity then stays put, so a steady Flush loop does not allocate.
+    struct FlushRound {
+        SpdkPageStore* store = nullptr;
+        PageStoreChannel* ch = nullptr; // free list it returns to; nullptr = heap
+        std::vector<FlushWaiter*> waiters;
+        std::vector<std::pair<uint64_t, uint64_t>> extents;
+        bool meta = false;
+        std::vector<BdevIo> ios; // one device flush per dirty range
+        size_t pending = 0;
+        IoStatus status;
+        uint64_t trace_id = 0;
+        FlushRound* next_free = nullptr;
+    };
+
+    // A write parked until the pool has a buffer for it: one page, or a
+    // whole WritePages/ReadPages run (an SpdkPageStore::RunCtx) that waits
+    // until the pool holds every buffer it needs.
+    struct PendingWrite {
+        uint64_t slot;
+        const void* data;
+        bool keyed;
+        IoCallback cb;
+        void* run = nullptr;
+    };
+
+    struct spdk_thread* thread = nullptr;
+    struct spdk_io_channel* bdev_ch = nullptr;
+    struct spdk_io_channel* accel_ch = nullptr; // only with compression
+    std::unique_ptr<PageBufferPool> buf_pool;
+    std::deque<PendingWrite> buf_waiters;
+    PageIoRequest* free_reqs = nullptr;
+    size_t free_req_count = 0;
+    std::atomic<uint64_t> req_heap_allocs{0};
+    uint32_t verify_tick = 0;
+    // Keyed read hits not yet applied to the eviction policy. The key is kept
+    // so that a hit on a slot since given to another page is dropped.
+    struct Access {
+        uint32_t slot;
+        PageKey key;
+    };
+    static constexpr size_t kAccessBufferSize = 64;
+    std::array<Access, kAccessBufferSize> access_buf;
+    size_t access_count = 0;
+    std::atomic<uint64_t> crc_verified{0};
+    std::atomic<uint64_t> crc_mismatches{0};
+    std::atomic<uint64_t> compressed{0};
+    std::atomic<uint64_t> incompressible{0};
+    std::atomic<uint64_t> bytes_saved{0};
+    // Sequential read-ahead; see SpdkPageStoreOptions::readahead_max_pages.
+    std::vector<ReadAheadStream> streams;
+    uint64_t stream_clock = 0;
+    std::atomic<uint64_t> ra_reads{0};
+    std::atomic<uint64_t> ra_pages{0};
+    std::atomic<uint64_t> ra_hits{0};
+    std::atomic<uint64_t> ra_waits{0};
+    std::atomic<uint64_t> ra_stale{0};
+    std::atomic<uint64_t> ra_wasted{0};
+    // Operation counters of this thread, by PageStatOp.
+    std::array<PageOpCounters, kNumPageStatOps> op_stats;
+    std::atomic<uint64_t> key_hits{0};
+    std::atomic<uint64_t> key_misses{0};
+    // Trace ids: a number unique to the channel in the top bits, then a counter.
+    uint64_t trace_base = 0;
+    uint64_t trace_seq = 0;
+    // Admission control; see SpdkPageStoreOptions::max_in_flight and
+    // io_classes. Each class waits in a FIFO of BdevIo linked through next.
+    struct IoClassQueue {
+        BdevIo* head = nullptr;
+        BdevIo* tail = nullptr;
+        uint64_t tat = 0; // token bucket: when the next I/O is due, in ticks
+        const BdevIo* throttled_io = nullptr; // last I/O counted in throttled
+        std::atomic<uint64_t> in_flight{0};
+        std::atomic<uint64_t> queued{0};
+        std::atomic<uint64_t> dispatched{0};
+        std::atomic<uint64_t> waited{0};
+        std::atomic<uint64_t> throttled{0};
+        std::atomic<uint64_t> wait_us{0};
+        std::atomic<uint64_t> max_wait_us{0};
+    };
+    SpdkPageStore* store = nullptr;
+    std::array<IoClassQueue, kNumPageIoClasses> classes;
+    bool io_wait_armed = false;  // io_wait is queued with the bdev
+    struct spdk_bdev_io_wait_entry io_wait;
+    struct spdk_poller* throttle_poller = nullptr; // a token bucket is empty
+    uint64_t throttle_at = 0;                      // when throttle_poller fires
+    // Totals over the classes; waits are only counted per class.
+    std::atomic<uint64_t> in_flight{0};
+    std::atomic<uint64_t> queued{0};
+    std::atomic<uint64_t> peak_in_flight{0};
+    std::atomic<uint64_t> peak_queued{0};
+    std::atomic<uint64_t> enomem{0};
+    // Call capture; see SpdkPageStoreOptions::record_path.
+    PageRecordBuffer records;
+    RecordedCall* free_calls = nullptr;
+    size_t free_call_count = 0;
+    FlushWaiter* free_flush_waiters = nullptr;
+    size_t free_flush_waiter_count = 0;
+    FlushRound* free_flush_rounds = nullptr;
 };
 
 class SpdkPageStore : public PageStore {
 public:
-    SpdkPageStore() = default;
+    // Upper bound on spdk_thread ids that may submit I/O to one store.
+    static constexpr size_t kMaxThreads = 1024;
+    // Eviction policies address slots with 32 bits (16 TiB of 4 KiB slots).
+    static constexpr uint64_t kMaxSlots = UINT32_MAX - 1;
+
+    explicit SpdkPageStore(const SpdkPageStoreOptions& opts = {}) : opts_(opts) {}
     ~SpdkPageStore() override;
 
+    // Opens the bdev, sizes the store to it and starts recovering page
+    // metadata; returns
+    // false if that could not be started. I/O is rejected until recovery has
+    // finished, so prefer the overload below, whose done runs at that point.
     bool Init(const std::string& bdevName) override;
+    void Init(const std::string& bdevName, IoCallback done);
     void WritePage(uint64_t pageId, const void* data, IoCallback cb) override;
     void ReadPage(uint64_t pageId, void* buffer, IoCallback cb) override;
     void Flush(IoCallback cb) override;
 
+    // Runs of adjacent pageIds are merged into single spdk_bdev_writev /
+    // spdk_bdev_readv requests. A pageId listed more than once in WritePages
+    // is written once, with its last entry's data.
+    void WritePages(std::span<const PageWrite> pages, IoCallback cb) override;
+    void ReadPages(std::span<const PageRead> pages, IoCallback cb) override;
+
+    // Keyed pages. The store picks a free slot for a new key and keeps the
+    // key -> slot mapping in an in-memory index that is persisted with the
+    // page metadata and rebuilt at Init. GetPage/DeletePage complete with
+    // IoStatus::kNotFound for unknown keys. When the store fills up, keyed
+    // pages are evicted per SpdkPageStoreOptions::eviction; with kNone PutPage
+    // fails with kNoSpace instead. Raw pageIds and keys may share a store, but
+    // not slots: a raw write (WritePage, SubmitWrite, WritePages) to a page
+    // whose slots hold any keyed page fails with kIoError and leaves the
+    // keyed pages intact, and slots written raw are never handed to keys.
+    // With compression, keyed pages are compressed and decompressed on the
+    // calling thread and their I/O is not forwarded to shard owners, and
+    // PutPage's data must stay valid until cb runs.
+    void PutPage(const PageKey& key, const void* data, IoCallback cb);
+    void GetPage(const PageKey& key, void* buffer, IoCallback cb);
+    void DeletePage(const PageKey& key, IoCallback cb);
+    // Awaitable forms of the three above.
+    IoAwaitable Put(const PageKey& key, const void* data) {
+        return IoAwaitable([this, key, data](IoCallback cb) { PutPage(key, data, std::move(cb)); });
+    }
+    IoAwaitable Get(const PageKey& key, void* buffer) {
+        return IoAwaitable([this, key, buffer](IoCallback cb) { GetPage(key, buffer, std::move(cb)); });
+    }
+    IoAwaitable Delete(const PageKey& key) {
+        return IoAwaitable([this, key](IoCallback cb) { DeletePage(key, std::move(cb)); });
+    }
+    // True if key currently maps to a slot; an index lookup, no I/O.
+    bool HasPage(const PageKey& key);
+
+    // Pin every page to an owner thread (pageId % owners.size()). Requests
+    // issued elsewhere are forwarded with spdk_thread_send_msg and their
+    // callbacks bounced back to the submitting thread. A forwarded WritePage
+    // copies data into a pooled buffer before it returns, as an unsharded
+    // one does, so the caller may reuse its buffer at once; a forwarded read
+    // fills the caller's buffer on the owner thread. Call before any I/O.
+    void EnableSharding(const std::vector<struct spdk_thread*>& owners);
+
+    // Wait for pending metadata writes, release the per-thread channels on
+    // their owning threads, then close the bdev. Must be called from an SPDK
+    // thread once all I/O has completed; cb runs on that same thread.
+    void Close(IoCallback cb);
+
+    // Zero-copy path. AcquirePageBuffer() hands out a pinned, page-aligned
+    // buffer from the calling thread's pool (empty lease if none is free and
+    // fallback is disabled). The caller fills it in place and gives it to
+    // SubmitWrite(), which returns it to the pool once the write completes.
+    PageLease AcquirePageBuffer();
+    void SubmitWrite(uint64_t pageId, PageLease lease, IoCallback cb);
+    // Read a page into a freshly leased DMA buffer handed to cb; the caller
+    // drops the lease when done with the data.
+    void ReadPageLeased(uint64_t pageId, LeaseCallback cb);
+
+    // True if buf (one page) can be handed to the bdev without a bounce.
+    static bool IsDmaSafe(const void* buf);
+
+    // Whether Init has the bdev open; recovery may still be running.
+    bool IsOpen() const { return desc_ != nullptr; }
+    // Raw pageIds on the device, known once Init has opened the bdev.
+    uint64_t NumPages() const { return num_pages_; }
+    // Allocation slots: kPageSize / compression_slot_size per page with
+    // compression, one per page otherwise.
+    uint64_t NumSlots() const { return num_slots_; }
+
+    // Write buffer pool counters summed over all threads.
+    PageBufferPoolStats GetBufferPoolStats() const;
+    // Request contexts that had to be heap-allocated because a channel's free
+    // list was empty; flat in steady state.
+    uint64_t GetRequestAllocations() const;
+    // Read verification counters summed over all threads.
+    PageIntegrityStats GetIntegrityStats() const;
+    PageEvictionStats GetEvictionStats() const;
+    // Compression counters summed over all threads.
+    PageCompressionStats GetCompressionStats() const;
+    PageQueueStats GetQueueStats() const;
+    // Read-ahead counters summed over all threads.
+    PageReadAheadStats GetReadAheadStats() const;
+    // Counts, bytes and latency histogram of op, merged over all threads.
+    // Latency runs from when the store issues the operation (after any wait
+    // for a write buffer or a shard hop) until its callback is called.
+    PageOpStats GetOpStats(PageStatOp op) const;
+    PageLookupStats GetLookupStats() const;
+    PageMetaJournalStats GetJournalStats() const { return journal_.GetStats(); }
+
 private:
+    // Recycled requests kept per channel beyond which frees go to the heap.
+    static constexpr size_t kMaxCachedRequests = 4096;
+
+    struct BatchCtx {
+        size_t pending;
+        IoStatus status;
+        IoCallback cb;
+    };
+
+    // A page of a run staged in a pooled buffer.
+    struct Bounce {
+        uint32_t iov;          // page of the run
+        void* caller;          // the caller's buffer
+        void* pooled = nullptr;
+    };
+
+    // One coalesced vectored request of a batch. For writes every iov is a
+    // pooled copy; for reads only the bounced entries are. The pooled buffers
+    // are taken all at once when the run is issued.
+    struct RunCtx {
+        SpdkPageStore* store = nullptr;
+        BatchCtx* batch = nullptr;
+        PageBufferPool* pool = nullptr;
+        PageStoreChannel* ch = nullptr;
+        bool write = false;
+        IoStatus status;
+        uint64_t first_slot = 0;
+        uint64_t start = 0;
+        std::vector<struct iovec> iovs;
+        std::vector<Bounce> bounces;
+        std::vector<JournalRecord> records;
+        JournalWaiter waiter;
+        BdevIo io;
+    };
+
+    // Journal records of one eviction pass: a background one, or victims
+    // PutPage evicted inline but could not reuse.
+    struct EvictCtx {
+        SpdkPageStore* store = nullptr;
+        bool background = true;
+        std::vector<JournalRecord> records;
+        JournalWaiter waiter;
+    };
+
+    // In-memory copy of a page's placement, kept for every first slot.
+    struct SlotExtent {
+        uint16_t stored_size = 0;
+        uint8_t slots = 0;  // 0 = not the first slot of a page
+        PageCodec codec = PageCodec::kNone;
+    };
+
+    static constexpr size_t kMaxBatchIovs = 32;
+    static constexpr size_t kEvictBatch = 128;
+    // Victims PutPage looks at before giving up on a compressed page whose
+    // extent none of them can hold.
+    static constexpr size_t kMaxDirectVictims = 8;
+    static constexpr PageKey kUnkeyed{kNoFileId, 0};
+    // Set in slot_readers_ once a slot with reads in flight has been freed.
+    static constexpr uint32_t kFreePending = 1u << 31;
+    // Dirty extents tracked exactly; beyond this the closest ones are merged.
+    static constexpr size_t kMaxDirtyExtents = 64;
+
+    using FlushWaiter = PageStoreChannel::FlushWaiter;
+    using FlushRound = PageStoreChannel::FlushRound;
+
+    bool Ready() const { return ready_.load(std::memory_order_acquire); }
+    void OnRecovered(bool success);
+    uint64_t SlotOf(uint64_t pageId) const { return pageId * slots_per_page_; }
+    uint32_t SlotsFor(uint32_t storedSize) const {
+        return (storedSize + slot_size_ - 1) / slot_size_;
+    }
+    PageStoreChannel* GetLocalChannel();
+    PageIoRequest* AllocRequest(PageStoreChannel* ch, PageOp op, uint64_t slot);
+    static void FreeRequest(PageIoRequest* req);
+    static void CompleteRequest(PageIoRequest* req, IoStatus status);
+    // Stamps a request about to be issued for the op counters and tracing.
+    void StartRequest(PageStoreChannel* ch, PageIoRequest* req, PageTraceOp op, uint64_t pageId);
+    void RecordOp(PageStoreChannel* ch, PageStatOp op, uint64_t start, uint64_t pages,
+                  uint64_t bytes, IoStatus status);
+    // Wraps cb so that the call is captured when it completes; a no-op
+    // without a channel.
+    void RecordCall(PageRecordOp op, uint64_t page, uint32_t size, uint16_t flags,
+                    IoCallback& cb);
+    struct spdk_thread* OwnerOf(uint64_t slot) const;
+    void Forward(struct spdk_thread* owner, PageOp op, uint64_t slot, void* buf,
+                 PageBufferPool* pool, bool keyed, IoCallback cb);
+    // Returns a forwarded write copy; without a pool it came from spdk_malloc.
+    static void PutForwardedBuffer(PageBufferPool* pool, void* buf);
+    // keyed is set for PutPage, whose slot was picked for its key; a raw
+    // write instead fails if the page's slots hold any keyed page.
+    void WriteSlot(uint64_t slot, const void* data, bool keyed, IoCallback cb);
+    void ReadSlot(uint64_t slot, void* buffer, IoCallback cb);
+    // Serves the read from a staged window, or parks it on one being loaded,
+    // and keeps the stream's read-ahead going. False if the read must go to
+    // the device, in which case cb is left untouched.
+    bool ReadAhead(uint64_t pageId, void* buffer, IoCallback& cb);
+    ReadAheadStream* FindStream(PageStoreChannel* ch, uint64_t pageId);
+    void PumpReadAhead(PageStoreChannel* ch, ReadAheadStream* s, uint64_t pageId);
+    // Drops a staged window, adapting the stream's window to how much of it
+    // was used.
+    void RetireSegment(PageStoreChannel* ch, ReadAheadStream* s, ReadAheadSegment* seg);
+    // Copies a staged page out and sets *status; false if the page was
+    // rewritten since it was staged.
+    bool CopyStaged(PageStoreChannel* ch, ReadAheadSegment* seg, uint64_t pageId, void* buffer,
+                    IoStatus* status);
+    void CopyAndWrite(PageStoreChannel* ch, uint64_t slot, const void* data, bool keyed,
+                      IoCallback cb);
+    void IssueWrite(PageStoreChannel* ch, uint64_t slot, void* buf, PageBufferPool* pool,
+                    bool keyed, IoCallback cb);
+    // Writes req->buf to req->slot; req->stored_size below kPageSize means the
+    // buffer holds opts_.compression output, zero-padded to whole slots.
+    void StartWrite(PageIoRequest* req);
+    // Whether any of the slots of the raw page at slot belong to a keyed page.
+    bool OverlapsKeyLocked(uint64_t slot) const;
+    void IssueRead(PageStoreChannel* ch, uint64_t slot, void* buffer, IoCallback cb);
+    // Returns buf to pool and resumes what is parked on ch for a buffer.
+    void ReleaseBuffer(PageStoreChannel* ch, PageBufferPool* pool, void* buf);
+    // Issues parked writes and runs in arrival order while the pool can
+    // serve the first of them.
+    void ResumeBufferWaiters(PageStoreChannel* ch);
+    // Finds or makes room for key in a run of slots holding storedSize bytes
+    // and indexes it there; SlotAllocator::kNone if full. A key whose run has
+    // another length moves: *moved is set to its old slot, which the caller
+    // journals as deleted. Victims too short to take over, or still being
+    // read, are added to evicted for the caller to journal.
+    uint64_t PlaceKeyLocked(const PageKey& key, uint32_t storedSize, uint64_t* moved,
+                            std::vector<JournalRecord>* evicted);
+    // Marks the slots storedSize bytes at slot take as used and records the
+    // extent; below kPageSize the bytes are opts_.compression output.
+    void SetExtentLocked(uint64_t slot, uint32_t storedSize);
+    void CompressAndPut(PageStoreChannel* ch, const PageKey& key, const void* data,
+                        IoCallback cb);
+    void ReadCompressed(PageStoreChannel* ch, uint64_t slot, const SlotExtent& extent,
+                        void* buffer, IoCallback cb);
+    // Journals victims PlaceKeyLocked could not take over.
+    void CommitDirectEvictions(PageStoreChannel* ch, std::vector<JournalRecord> records);
+    void DropKeyLocked(uint64_t slot);
+    // Returns the page's slots to the allocator, or leaves that to the last
+    // GetPage still reading them.
+    void FreeExtentLocked(uint64_t slot);
+    // Ends a GetPage of key at slot: kNotFound if the key left the slot while
+    // it was read, else status.
+    IoStatus EndKeyedRead(uint64_t slot, const PageKey& key, IoStatus status);
+    void DrainAccessesLocked(PageStoreChannel* ch);
+    void MaybeStartEviction();
+    void CommitEvictions(PageStoreChannel* ch, EvictCtx* ctx);
+    // Undoes a failed write of key to slot.
+    void AbortSlot(uint64_t slot, const PageKey& key);
+    void ReleaseSlot(uint64_t slot);
+    void CommitRecord(PageIoRequest* req);
+    // Records slots [firstSlot, firstSlot + count) as needing a flush; count 0
+    // marks the metadata region instead. Data is marked when its write
+    // completes and metadata once the journal record is durable, so a round
+    // that starts in between can never clear a record not yet written.
+    void MarkDirty(uint64_t firstSlot, uint64_t count);
+    bool ShouldVerify(PageStoreChannel* ch);
+    IoStatus VerifyPage(PageStoreChannel* ch, uint64_t slot, const void* buf);
+    void SubmitBatch(bool write, std::vector<std::pair<uint64_t, void*>> entries, IoCallback cb);
+    // Issues run once its buffers are in hand; without them it is parked
+    // behind ch->buf_waiters, or fails if the pool falls back to one-off
+    // buffers.
+    void SubmitRun(PageStoreChannel* ch, bool write, uint64_t firstSlot, RunCtx* run);
+    // Takes every pooled buffer run needs, or none of them.
+    bool TakeRunBuffers(RunCtx* run);
+    void IssueRun(RunCtx* run);
+    uint64_t BoundaryOf(uint64_t slot) const;
+    static void FinishRun(RunCtx* run, bool success);
+    static void ReleaseRun(RunCtx* run, IoStatus status);
+    static void ReleaseBatch(BatchCtx* batch, IoStatus status);
+    // Issues io if its class may dispatch now and has nothing waiting, else
+    // it joins the class FIFO. Returns the bdev's error only for an immediate
+    // failure other than -ENOMEM; a waiting I/O that later fails reports
+    // through io->done.
+    int SubmitBdevIo(BdevIo* io);
+    int IssueBdevIo(BdevIo* io);
+    // Whether class c may issue another I/O now. When only its token bucket
+    // says no, *delay is set to the ticks until it refills, else to 0.
+    bool CanDispatch(PageStoreChannel* ch, size_t c, uint64_t* delay) const;
+    void TakeToken(PageStoreChannel* ch, size_t c);
+    void EnqueueBdevIo(PageStoreChannel* ch, BdevIo* io, bool front);
+    void DrainBdevIos(PageStoreChannel* ch);
+    void ArmIoWait(PageStoreChannel* ch);
+    void ArmThrottle(PageStoreChannel* ch, uint64_t delay);
+
+    SpdkPageStoreOptions opts_;
     struct spdk_bdev* bdev_ = nullptr;
     struct spdk_bdev_desc* desc_ = nullptr;
-    struct spdk_io_channel* channel_ = nullptr;
-    void* metadata_buf_ = nullptr;
-    std::bitset<kMaxPages> page_used_;
-    std::mutex meta_mutex_;
+    std::array<std::atomic<PageStoreChannel*>, kMaxThreads> channels_{};
+    std::vector<struct spdk_thread*> shard_threads_;
+    IoCallback close_cb_;
+    struct spdk_thread* close_thread_ = nullptr;
+    PageMetaJournal journal_;
+    uint64_t data_offset_ = 0;
+    std::atomic<bool> ready_{false};
+    uint64_t num_pages_ = 0;
+    uint64_t num_slots_ = 0;
+    uint32_t slot_size_ = kPageSize;
+    uint32_t slots_per_page_ = 1;
+    double ns_per_tick_ = 0;
+    // Set while recording; channels keep it alive until their last records
+    // are handed over.
+    std::shared_ptr<PageRecorder> recorder_;
+    // Guards the slot allocation state below. Key lookups (GetPage, HasPage)
+    // take it shared; everything that changes the state takes it exclusively.
+    std::shared_mutex meta_mutex_;
+    std::unique_ptr<SlotAllocator> slots_;
+    std::vector<PageKey> slot_keys_; // reverse of index_; kUnkeyed if none
+    std::vector<SlotExtent> extents_;
+    // GetPage reads in flight per first slot, taken under the shared lock, so
+    // a slot is never handed to another key while a read of it is running.
+    std::unique_ptr<std::atomic<uint32_t>[]> slot_readers_;
+    PageIndex index_;
+    std::unique_ptr<EvictionPolicy> policy_;
+    bool evicting_ = false;          // a background pass is in flight
+    std::atomic<uint64_t> evicted_{0};
+    std::atomic<uint64_t> direct_evictions_{0};
+    // Guards the flush state below.
+    std::mutex flush_mutex_;
+    // Sorted, disjoint [first, end) slot extents written since the last flush.
+    std::vector<std::pair<uint64_t, uint64_t>> dirty_;
+    bool meta_dirty_ = false;
+    uint64_t flushed_checkpoints_ = 0; // journal checkpoints a round has covered
+    std::vector<FlushWaiter*> flush_waiters_; // callers of the next round
+    bool flush_active_ = false;               // a round is scheduled or in flight
+    struct spdk_poller* flush_poller_ = nullptr;
+    // Read-ahead is not the caller's I/O, so Close waits for it on its own.
+    std::atomic<uint64_t> readahead_in_flight_{0};
+    struct spdk_poller* release_poller_ = nullptr;
 
-    static void OnWriteComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
-    static void OnReadComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
-    static void OnFlushComplete(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
-    static void OnMetadataRead(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void RunShardMsg(void* arg);
+    static void OnShardDone(void* arg, IoStatus status);
+    static void RunShardCallback(void* arg);
+    static void OnLeasedReadDone(void* arg, IoStatus status);
+    static void OnGetDone(void* arg, IoStatus status);
+    static void OnRecordedCallDone(void* arg, IoStatus status);
+    static void ReleaseLocalChannel(void* arg);
+    static void OnChannelsReleased(void* arg);
+    static void OnBdevIoDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnIoWait(void* arg);
+    static int OnThrottleExpired(void* arg);
+    static void OnWriteComplete(void* arg, bool success);
+    static void OnReadComplete(void* arg, bool success);
+    static void OnCompressed(void* arg, int status);
+    static void OnDecompressed(void* arg, int status);
+    static void OnRunComplete(void* arg, bool success);
+    static int OnFlushWindow(void* arg);
+    static void StartFlushRound(void* arg);
+    static void OnRangeFlushed(void* arg, bool success);
+    static void FinishFlushRound(FlushRound* round);
+    static void RunFlushWaiter(void* arg);
+    static void StartRelease(void* arg);
+    static int WaitReadAhead(void* arg);
+    static void OnReadAheadDone(void* arg, bool success);
+    static void OnJournalCommitted(JournalWaiter* w, bool success);
+    static void OnRunCommitted(JournalWaiter* w, bool success);
+    static void RunDeferredCompletion(void* arg);
+    static void RunDeferredRunRelease(void* arg);
+    static void RunEviction(void* arg);
+    static void OnEvictionCommitted(JournalWaiter* w, bool success);
 };
 
 // Usage Example (demo.cpp):
 //
+// PageTask<IoStatus> CopyPage(SpdkPageStore& store, uint64_t from, uint64_t to) {
+//   PageLease page = store.AcquirePageBuffer();
+//   if (IoStatus status = co_await store.Read(from, page.data()); !status) co_return status;
+//   co_return co_await store.Write(to, page.data());
+// }
+//
 // auto store = std::make_unique<SpdkPageStore>();
-// if (store->Init("Nvme0n1")) {
+// store->Init("Nvme0n1", [&](bool ready) {
+//   if (!ready) return;
 //   char data[kPageSize] = "hello page";
 //   store->WritePage(0, data, [](bool ok) {
 //     if (ok) std::cout << "Write OK" << std::endl;
@@ -72,4 +869,25 @@ private:
 //   store->ReadPage(0, buffer, [](bool ok) {
 //     if (ok) std::cout << "Read OK" << std::endl;
 //   });
-// }
+//
+//   // Zero-copy: fill a pinned page in place instead of copying it.
+//   PageLease page = store->AcquirePageBuffer();
+//   snprintf(static_cast<char*>(page.data()), page.size(), "hello page");
+//   store->SubmitWrite(1, std::move(page), [](bool ok) {});
+//   store->ReadPageLeased(1, [](IoStatus status, PageLease page) {
+//     if (status) std::cout << static_cast<char*>(page.data()) << std::endl;
+//     else if (status.code() == IoStatus::kChecksumMismatch) std::cout << "Corrupt" << std::endl;
+//   });
+//
+//   // Keyed: the store picks the slot.
+//   PageKey key{fileIdHash, 7};
+//   store->PutPage(key, data, [](bool ok) {});
+//   store->GetPage(key, buffer, [](IoStatus status) {
+//     if (status.code() == IoStatus::kNotFound) std::cout << "Miss" << std::endl;
+//   });
+//
+//   // Coroutines: each co_await resumes on this thread once the I/O is done.
+//   Spawn(CopyPage(*store, 0, 2), [](IoStatus status) {
+//     if (!status) std::cout << "Copy failed" << std::endl;
+//   });
+// });
@@ -0,0 +1,324 @@
+// striped_page_store.cpp
+#include "striped_page_store.h"
+
+#include <algorithm>
+
+namespace {
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// FNV-1a, so a device's rank for a key only depends on its bdev name and
+// stays the same across restarts and device list orderings.
+uint64_t NameSeed(const std::string& name) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return Mix(h);
+}
+
+} // namespace
+
+thread_local StripedPageStore::CtxCache StripedPageStore::ctx_cache_;
+
+StripedPageStore::CtxCache::~CtxCache() {
+    while (head) {
+        IoCtx* ctx = head;
+        head = ctx->next_free;
+        delete ctx;
+    }
+}
+
+StripedPageStore::StripedPageStore(const StripedPageStoreOptions& opts) : opts_(opts) {
+    opts_.stripe_pages = std::max<uint64_t>(1, opts_.stripe_pages);
+}
+
+bool StripedPageStore::Init(const std::string& bdevNames) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= bdevNames.size()) {
+        size_t end = std::min(bdevNames.find(',', start), bdevNames.size());
+        if (end > start) names.push_back(bdevNames.substr(start, end - start));
+        start = end + 1;
+    }
+    // Only a bad device list fails the whole Init inline. The join reports
+    // once every device has, so a device that failed to open while another
+    // is still recovering shows in its store, not in the callback.
+    auto failed = std::make_shared<std::atomic<bool>>(false);
+    Init(names, [failed](bool ok) {
+        if (ok) return;
+        failed->store(true, std::memory_order_relaxed);
+        std::cerr << "SPDK: Striped PageStore initialization failed" << std::endl;
+    });
+    if (failed->load(std::memory_order_relaxed)) return false;
+    return std::all_of(devices_.begin(), devices_.end(),
+                       [](const auto& dev) { return dev->store->IsOpen(); });
+}
+
+void StripedPageStore::Init(const std::vector<std::string>& bdevNames, IoCallback done) {
+    if (bdevNames.empty() || !devices_.empty()) {
+        std::cerr << "SPDK: Striped PageStore needs a non-empty bdev list and a single Init"
+                  << std::endl;
+        done(false);
+        return;
+    }
+    for (const std::string& name : bdevNames) {
+        auto dev = std::make_unique<Device>();
+        dev->bdev = name;
+        dev->seed = NameSeed(name);
+        dev->store = std::make_unique<SpdkPageStore>(opts_.device);
+        devices_.push_back(std::move(dev));
+    }
+    auto join = std::make_shared<IoJoin>(devices_.size(),
+                                         [this, done = std::move(done)](IoStatus status) {
+                                             OnDevicesReady(status);
+                                             done(status);
+                                         });
+    for (auto& dev : devices_) {
+        dev->store->Init(dev->bdev, [join](IoStatus status) { join->Done(status); });
+    }
+}
+
+void StripedPageStore::OnDevicesReady(bool success) {
+    if (!success) return;
+    uint64_t minPages = UINT64_MAX;
+    for (const auto& dev : devices_) minPages = std::min(minPages, dev->store->NumPages());
+    // Only whole stripes, and as many on every device as the smallest holds;
+    // keyed pages can still use the remainder.
+    num_pages_ = minPages / opts_.stripe_pages * opts_.stripe_pages * devices_.size();
+    ready_.store(true, std::memory_order_release);
+}
+
+size_t StripedPageStore::Locate(uint64_t pageId, uint64_t* local) const {
+    uint64_t unit = opts_.stripe_pages;
+    uint64_t stripe = pageId / unit;
+    *local = stripe / devices_.size() * unit + pageId % unit;
+    return stripe % devices_.size();
+}
+
+void StripedPageStore::Candidates(const PageKey& key, Device** first, Device** second) const {
+    uint64_t hash = PageIndex::Hash(key);
+    size_t best = 0, next = 0;
+    uint64_t bestScore = 0, nextScore = 0;
+    for (size_t i = 0; i < devices_.size(); i++) {
+        uint64_t score = Mix(hash ^ devices_[i]->seed);
+        if (i == 0 || score > bestScore) {
+            next = best;
+            nextScore = bestScore;
+            best = i;
+            bestScore = score;
+        } else if (next == best || score > nextScore) {
+            next = i;
+            nextScore = score;
+        }
+    }
+    *first = devices_[best].get();
+    *second = devices_[next].get();
+}
+
+IoCallback StripedPageStore::Track(Device& dev, uint64_t pages, IoCallback cb) {
+    CtxCache& cache = ctx_cache_;
+    IoCtx* ctx = cache.head;
+    if (ctx) {
+        cache.head = ctx->next_free;
+        cache.count--;
+    } else {
+        ctx = new IoCtx();
+    }
+    ctx->dev = &dev;
+    ctx->pages = pages;
+    ctx->cb = std::move(cb);
+    ctx->next_free = nullptr;
+    dev.in_flight.fetch_add(pages, std::memory_order_relaxed);
+    dev.submitted.fetch_add(pages, std::memory_order_relaxed);
+    return IoCallback(OnDeviceDone, ctx);
+}
+
+void StripedPageStore::OnDeviceDone(void* arg, IoStatus status) {
+    auto* ctx = static_cast<IoCtx*>(arg);
+    ctx->dev->in_flight.fetch_sub(ctx->pages, std::memory_order_relaxed);
+    IoCallback cb = std::move(ctx->cb);
+    // Completions are bounced back to the submitting thread, so contexts
+    // mostly return to the cache they came from.
+    CtxCache& cache = ctx_cache_;
+    if (cache.count < kMaxCachedCtxs) {
+        ctx->next_free = cache.head;
+        cache.head = ctx;
+        cache.count++;
+    } else {
+        delete ctx;
+    }
+    cb(status);
+}
+
+void StripedPageStore::WritePage(uint64_t pageId, const void* data, IoCallback cb) {
+    if (!Ready() || pageId >= num_pages_) {
+        cb(false);
+        return;
+    }
+    uint64_t local;
+    Device& dev = *devices_[Locate(pageId, &local)];
+    dev.store->WritePage(local, data, Track(dev, 1, std::move(cb)));
+}
+
+void StripedPageStore::ReadPage(uint64_t pageId, void* buffer, IoCallback cb) {
+    if (!Ready() || pageId >= num_pages_) {
+        cb(false);
+        return;
+    }
+    uint64_t local;
+    Device& dev = *devices_[Locate(pageId, &local)];
+    dev.store->ReadPage(local, buffer, Track(dev, 1, std::move(cb)));
+}
+
+void StripedPageStore::Flush(IoCallback cb) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(devices_.size(), std::move(cb));
+    for (auto& dev : devices_) {
+        dev->store->Flush([join](IoStatus status) { join->Done(status); });
+    }
+}
+
+template <typename Page, typename Submit>
+void StripedPageStore::SubmitSplit(std::span<const Page> pages, IoCallback cb, Submit submit) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    std::vector<std::vector<Page>> perDevice(devices_.size());
+    for (Page page : pages) {
+        if (page.pageId >= num_pages_) {
+            cb(false);
+            return;
+        }
+        size_t i = Locate(page.pageId, &page.pageId);
+        perDevice[i].push_back(page);
+    }
+    size_t used = std::count_if(perDevice.begin(), perDevice.end(),
+                                [](const auto& batch) { return !batch.empty(); });
+    if (used == 0) {
+        cb(true);
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(used, std::move(cb));
+    for (size_t i = 0; i < devices_.size(); i++) {
+        if (perDevice[i].empty()) continue;
+        Device& dev = *devices_[i];
+        submit(*dev.store, std::span<const Page>(perDevice[i]),
+               Track(dev, perDevice[i].size(), [join](IoStatus status) { join->Done(status); }));
+    }
+}
+
+void StripedPageStore::WritePages(std::span<const PageWrite> pages, IoCallback cb) {
+    SubmitSplit(pages, std::move(cb),
+                [](SpdkPageStore& store, std::span<const PageWrite> batch, IoCallback done) {
+                    store.WritePages(batch, std::move(done));
+                });
+}
+
+void StripedPageStore::ReadPages(std::span<const PageRead> pages, IoCallback cb) {
+    SubmitSplit(pages, std::move(cb),
+                [](SpdkPageStore& store, std::span<const PageRead> batch, IoCallback done) {
+                    store.ReadPages(batch, std::move(done));
+                });
+}
+
+void StripedPageStore::PutPage(const PageKey& key, const void* data, IoCallback cb) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    Device* first;
+    Device* second;
+    Candidates(key, &first, &second);
+    Device* dev = first;
+    if (second != first && !first->store->HasPage(key)) {
+        if (second->store->HasPage(key)) {
+            dev = second;
+        } else if (opts_.steer_by_queue_depth &&
+                   second->in_flight.load(std::memory_order_relaxed) <
+                       first->in_flight.load(std::memory_order_relaxed)) {
+            dev = second;
+            second->steered.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    dev->store->PutPage(key, data, Track(*dev, 1, std::move(cb)));
+}
+
+void StripedPageStore::GetPage(const PageKey& key, void* buffer, IoCallback cb) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    Device* first;
+    Device* second;
+    Candidates(key, &first, &second);
+    Device* dev = first;
+    if (second != first && !first->store->HasPage(key) && second->store->HasPage(key)) {
+        dev = second;
+    }
+    dev->store->GetPage(key, buffer, Track(*dev, 1, std::move(cb)));
+}
+
+void StripedPageStore::DeletePage(const PageKey& key, IoCallback cb) {
+    if (!Ready()) {
+        cb(false);
+        return;
+    }
+    Device* first;
+    Device* second;
+    Candidates(key, &first, &second);
+    bool onSecond = second != first && second->store->HasPage(key);
+    if (!onSecond) {
+        first->store->DeletePage(key, Track(*first, 1, std::move(cb)));
+        return;
+    }
+    if (!first->store->HasPage(key)) {
+        second->store->DeletePage(key, Track(*second, 1, std::move(cb)));
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(2, std::move(cb));
+    for (Device* dev : {first, second}) {
+        dev->store->DeletePage(key, Track(*dev, 1, [join](IoStatus status) { join->Done(status); }));
+    }
+}
+
+void StripedPageStore::EnableSharding(const std::vector<struct spdk_thread*>& owners) {
+    for (auto& dev : devices_) dev->store->EnableSharding(owners);
+}
+
+void StripedPageStore::Close(IoCallback cb) {
+    ready_.store(false, std::memory_order_release);
+    if (devices_.empty()) {
+        cb(true);
+        return;
+    }
+    auto join = std::make_shared<IoJoin>(devices_.size(), std::move(cb));
+    for (auto& dev : devices_) {
+        dev->store->Close([join](IoStatus status) { join->Done(status); });
+    }
+}
+
+std::vector<StripedDeviceStats> StripedPageStore::GetDeviceStats() const {
+    std::vector<StripedDeviceStats> stats;
+    for (const auto& dev : devices_) {
+        StripedDeviceStats s;
+        s.bdev = dev->bdev;
+        s.num_pages = dev->store->NumPages();
+        s.in_flight = dev->in_flight.load(std::memory_order_relaxed);
+        s.submitted = dev->submitted.load(std::memory_order_relaxed);
+        s.steered = dev->steered.load(std::memory_order_relaxed);
+        stats.push_back(std::move(s));
+    }
+    return stats;
+}
@@ -0,0 +1,144 @@
+// striped_page_store.h
+// PageStore spread over several bdevs (typically one per NVMe drive), with
+// one SpdkPageStore per device.
+//
+// Raw pageIds are striped: stripe_pages consecutive pages live on one device
+// and the next stripe on the next device, so large batches keep every drive
+// busy. Keyed pages are placed by rendezvous hashing: every key ranks the
+// devices by a per-device hash, and a new key goes to whichever of its top two
+// devices has fewer requests in flight. Lookups check both candidates' indexes,
+// so placement needs no table of its own and survives a restart through each
+// device's persisted index. Adding a device only relocates the keys for which
+// it enters the top two; those read as misses.
+
+#pragma once
+
+#include "spdk_pagestore_interface.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct StripedPageStoreOptions {
+    // Applied to every member store.
+    SpdkPageStoreOptions device;
+    // Raw pages per stripe unit; 32 keeps a default 128 KiB batch run on one
+    // device.
+    uint64_t stripe_pages = 32;
+    // Send new keys to the less loaded of their two candidate devices; false
+    // always uses the first.
+    bool steer_by_queue_depth = true;
+};
+
+struct StripedDeviceStats {
+    std::string bdev;
+    uint64_t num_pages = 0;
+    uint64_t in_flight = 0; // pages submitted and not yet completed
+    uint64_t submitted = 0;
+    uint64_t steered = 0;   // new keys placed on their second choice
+};
+
+class StripedPageStore : public PageStore {
+public:
+    explicit StripedPageStore(const StripedPageStoreOptions& opts = {});
+    ~StripedPageStore() override = default;
+
+    // bdevNames is a comma-separated list, e.g. "Nvme0n1,Nvme1n1". Returns
+    // false if any device could not be opened; like SpdkPageStore, prefer
+    // the asynchronous overload, whose done runs once every device has
+    // recovered.
+    bool Init(const std::string& bdevNames) override;
+    void Init(const std::vector<std::string>& bdevNames, IoCallback done);
+
+    // pageIds cover NumPages(); all devices contribute as many stripes as the
+    // smallest one holds.
+    void WritePage(uint64_t pageId, const void* data, IoCallback cb) override;
+    void ReadPage(uint64_t pageId, void* buffer, IoCallback cb) override;
+    void Flush(IoCallback cb) override;
+    // Split per device into one batch each, so every device still coalesces
+    // its runs.
+    void WritePages(std::span<const PageWrite> pages, IoCallback cb) override;
+    void ReadPages(std::span<const PageRead> pages, IoCallback cb) override;
+
+    // Two first PutPages of one key racing on different threads may leave a
+    // copy on each candidate; GetPage and later PutPages then use the first
+    // candidate's copy and DeletePage removes both.
+    void PutPage(const PageKey& key, const void* data, IoCallback cb);
+    void GetPage(const PageKey& key, void* buffer, IoCallback cb);
+    void DeletePage(const PageKey& key, IoCallback cb);
+    IoAwaitable Put(const PageKey& key, const void* data) {
+        return IoAwaitable([this, key, data](IoCallback cb) { PutPage(key, data, std::move(cb)); });
+    }
+    IoAwaitable Get(const PageKey& key, void* buffer) {
+        return IoAwaitable([this, key, buffer](IoCallback cb) { GetPage(key, buffer, std::move(cb)); });
+    }
+    IoAwaitable Delete(const PageKey& key) {
+        return IoAwaitable([this, key](IoCallback cb) { DeletePage(key, std::move(cb)); });
+    }
+
+    // Applied to every device; see SpdkPageStore::EnableSharding.
+    void EnableSharding(const std::vector<struct spdk_thread*>& owners);
+    // Closes every device; same threading rules as SpdkPageStore::Close.
+    void Close(IoCallback cb);
+
+    uint64_t NumPages() const { return num_pages_; }
+    size_t NumDevices() const { return devices_.size(); }
+    std::vector<StripedDeviceStats> GetDeviceStats() const;
+
+private:
+    struct Device {
+        std::string bdev;
+        uint64_t seed = 0; // rendezvous hash seed, derived from the bdev name
+        std::unique_ptr<SpdkPageStore> store;
+        std::atomic<uint64_t> in_flight{0};
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> steered{0};
+    };
+
+    // Accounting wrapper around one device request, recycled per thread.
+    struct IoCtx {
+        Device* dev;
+        uint64_t pages;
+        IoCallback cb;
+        IoCtx* next_free;
+    };
+
+    struct CtxCache {
+        ~CtxCache();
+        IoCtx* head = nullptr;
+        size_t count = 0;
+    };
+
+    static constexpr size_t kMaxCachedCtxs = 1024;
+
+    bool Ready() const { return ready_.load(std::memory_order_acquire); }
+    void OnDevicesReady(bool success);
+    // Index of the device holding a raw pageId, and its pageId there.
+    size_t Locate(uint64_t pageId, uint64_t* local) const;
+    // The key's two highest-ranked devices (the same one twice with a single
+    // device).
+    void Candidates(const PageKey& key, Device** first, Device** second) const;
+    // Splits a batch into one per device, in device-local pageIds, and hands
+    // each to submit(store, batch, done).
+    template <typename Page, typename Submit>
+    void SubmitSplit(std::span<const Page> pages, IoCallback cb, Submit submit);
+    static IoCallback Track(Device& dev, uint64_t pages, IoCallback cb);
+    static void OnDeviceDone(void* arg, IoStatus status);
+
+    static thread_local CtxCache ctx_cache_;
+
+    StripedPageStoreOptions opts_;
+    std::vector<std::unique_ptr<Device>> devices_;
+    uint64_t num_pages_ = 0;
+    std::atomic<bool> ready_{false};
+};
+
+// Usage Example:
+//
+// StripedPageStore store;
+// store.Init({"Nvme0n1", "Nvme1n1", "Nvme2n1", "Nvme3n1"}, [&](bool ready) {
+//   if (!ready) return;
+//   store.WritePage(0, data, [](bool ok) {});     // stripe 0 -> Nvme0n1
+//   store.WritePage(32, data, [](bool ok) {});    // stripe 1 -> Nvme1n1
+//   store.PutPage(PageKey{fileIdHash, 7}, data, [](bool ok) {});
+// });
@@ -0,0 +1,401 @@
+/*   SPDX-License-Identifier: Apache-2.0
+ *
+ *   Replays a call capture (SpdkPageStoreOptions::record_path, page_recorder.h)
+ *   against an SpdkPageStore on any bdev, so that tuning changes can be tried
+ *   offline on a malloc or aio bdev with a production workload. Calls are
+ *   issued from one thread in capture order, either at their recorded times
+ *   (default) or as fast as -q slots allow (-a), and the latency of each op
+ *   class is reported next to the latency recorded in the capture.
+ *
+ *   pageIds are taken modulo the store's pages and keyed calls use their
+ *   recorded key hash as the file id, so a capture replays on a smaller
+ *   bdev than it came from. With -F every page read and key looked up is
+ *   written once first, so reads do not go to pages the store never held.
+ *
+ *   sudo ./buildDir/pagestore_replay -c bdev.json -b Malloc0 -f pagestore.rec -F
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk/thread.h"
+#include "spdk/env.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk_pagestore_interface.h"
+#include "page_recorder.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+static std::string g_bdev_name = "Malloc0";
+static std::string g_capture_path;
+static uint32_t g_queue_depth = 128;
+static bool g_fast = false;
+static bool g_prefill = false;
+static PageRecordFileHeader g_header;
+static std::vector<PageRecord> g_records;
+
+struct Replay;
+
+struct ReplaySlot {
+    Replay* replay = nullptr;
+    char* buf = nullptr;
+    const PageRecord* rec = nullptr;
+    uint64_t start = 0;
+    std::vector<PageRead> reads;
+    std::vector<PageWrite> writes;
+};
+
+struct OpResult {
+    PageLatencyStats replayed;
+    PageLatencyStats recorded;
+    uint64_t errors = 0;
+    uint64_t not_found = 0;
+};
+
+struct Replay {
+    ~Replay() {
+        for (ReplaySlot& slot : slots) {
+            if (slot.buf) spdk_dma_free(slot.buf);
+        }
+    }
+
+    std::unique_ptr<SpdkPageStore> store;
+    uint64_t num_pages = 0;
+    double ns_per_tick = 0;
+    std::vector<ReplaySlot> slots;
+    std::vector<ReplaySlot*> idle;
+    struct spdk_poller* poller = nullptr;
+    // The phase being issued: the prefill writes, then the capture.
+    std::vector<PageRecord> fill;
+    const std::vector<PageRecord>* calls = nullptr;
+    bool measure = false;
+    bool timed = false;
+    size_t next = 0;
+    uint64_t in_flight = 0;
+    uint64_t t0 = 0;      // ticks at which the phase's first call was due
+    uint64_t end = 0;
+    uint64_t fill_errors = 0;
+    uint64_t skipped = 0; // batches longer than the store
+    std::array<OpResult, kNumPageRecordOps> results;
+    PageLatencyStats lag; // issue time behind the recorded time
+    int rc = 0;
+};
+
+static void replay_usage() {
+    printf(" -f <file>                 capture to replay (required)\n");
+    printf(" -b <bdev>                 bdev to replay on (default Malloc0)\n");
+    printf(" -q <depth>                most calls in flight (default 128)\n");
+    printf(" -a                        issue as fast as possible instead of at recorded times\n");
+    printf(" -F                        write every page read and key looked up first\n");
+}
+
+static int replay_parse_arg(int ch, char *arg) {
+    switch (ch) {
+    case 'f':
+        g_capture_path = arg;
+        break;
+    case 'b':
+        g_bdev_name = arg;
+        break;
+    case 'q':
+        g_queue_depth = static_cast<uint32_t>(strtoul(arg, nullptr, 10));
+        if (g_queue_depth == 0) return -EINVAL;
+        break;
+    case 'a':
+        g_fast = true;
+        break;
+    case 'F':
+        g_prefill = true;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void add_ns(PageLatencyStats& h, uint64_t ns) {
+    h.buckets[PageLatencyStats::Bucket(ns)]++;
+    h.count++;
+    h.sum_ns += ns;
+    h.max_ns = std::max(h.max_ns, ns);
+}
+
+static uint64_t pages_of(const PageRecord& rec) {
+    return rec.flags & kPageRecordBatch ? std::max<uint64_t>(rec.size / kPageSize, 1) : 1;
+}
+
+// First pageId of rec on this store; a batch keeps its pages consecutive.
+static uint64_t page_of(Replay* r, const PageRecord& rec) {
+    return rec.page % (r->num_pages - pages_of(rec) + 1);
+}
+
+static PageKey key_of(const PageRecord& rec) {
+    return PageKey{rec.page == kNoFileId ? 0 : rec.page, 0};
+}
+
+static void slot_done(ReplaySlot* slot, IoStatus status) {
+    Replay* r = slot->replay;
+    if (r->measure) {
+        OpResult& res = r->results[static_cast<size_t>(slot->rec->op)];
+        add_ns(res.replayed,
+               static_cast<uint64_t>((spdk_get_ticks() - slot->start) * r->ns_per_tick));
+        if (status.code() == IoStatus::kNotFound) {
+            res.not_found++;
+        } else if (!status) {
+            res.errors++;
+        }
+    } else if (!status) {
+        r->fill_errors++;
+    }
+    r->in_flight--;
+    // The poller issues the next call, so completions that run inline do not
+    // recurse.
+    r->idle.push_back(slot);
+}
+
+static void slot_issue(ReplaySlot* slot, const PageRecord& rec) {
+    Replay* r = slot->replay;
+    SpdkPageStore* store = r->store.get();
+    slot->rec = &rec;
+    slot->start = spdk_get_ticks();
+    r->in_flight++;
+    IoCallback cb = [slot](IoStatus status) { slot_done(slot, status); };
+    uint64_t page = page_of(r, rec);
+    uint64_t pages = pages_of(rec);
+    switch (rec.op) {
+    case PageRecordOp::kRead:
+        if (rec.flags & kPageRecordBatch) {
+            slot->reads.resize(pages);
+            for (uint64_t i = 0; i < pages; i++) {
+                slot->reads[i] = PageRead{page + i, slot->buf + i * kPageSize};
+            }
+            store->ReadPages(slot->reads, std::move(cb));
+        } else {
+            store->ReadPage(page, slot->buf, std::move(cb));
+        }
+        break;
+    case PageRecordOp::kWrite:
+        if (rec.flags & kPageRecordBatch) {
+            slot->writes.resize(pages);
+            for (uint64_t i = 0; i < pages; i++) {
+                slot->writes[i] = PageWrite{page + i, slot->buf + i * kPageSize};
+            }
+            store->WritePages(slot->writes, std::move(cb));
+        } else {
+            store->WritePage(page, slot->buf, std::move(cb));
+        }
+        break;
+    case PageRecordOp::kGet:
+        store->GetPage(key_of(rec), slot->buf, std::move(cb));
+        break;
+    case PageRecordOp::kPut:
+        store->PutPage(key_of(rec), slot->buf, std::move(cb));
+        break;
+    case PageRecordOp::kDelete:
+        store->DeletePage(key_of(rec), std::move(cb));
+        break;
+    case PageRecordOp::kFlush:
+        store->Flush(std::move(cb));
+        break;
+    }
+}
+
+static void replay_stop(Replay* r) {
+    r->store->Close([r](bool) { spdk_app_stop(r->rc); });
+}
+
+static double us(const PageLatencyStats& l, double q) {
+    return l.Percentile(q) / 1e3;
+}
+
+static void report(Replay* r) {
+    double span_s = (g_records.back().time_ns - g_records.front().time_ns) / 1e9;
+    double run_s = (r->end - r->t0) * r->ns_per_tick / 1e9;
+    printf("Replayed %zu calls on %s (%" PRIu64 " pages) in %.3f s; captured over %.3f s",
+           g_records.size(), g_bdev_name.c_str(), r->num_pages, run_s, span_s);
+    if (g_header.dropped) printf(", %" PRIu64 " dropped by the recorder", g_header.dropped);
+    printf("\n");
+    if (r->skipped) printf("Skipped %" PRIu64 " batches larger than the store\n", r->skipped);
+    if (r->timed && r->lag.count) {
+        printf("Issue lag behind the recorded times (us): p50 %.1f p99 %.1f max %.1f\n",
+               us(r->lag, 0.5), us(r->lag, 0.99), r->lag.max_ns / 1e3);
+    }
+    printf("\n%-6s %10s %8s %8s %9s %9s %9s %9s %9s | %9s %9s\n", "op", "calls", "errors",
+           "notfound", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)", "rec p50",
+           "rec p99");
+    for (size_t op = 0; op < kNumPageRecordOps; op++) {
+        const OpResult& res = r->results[op];
+        if (res.recorded.count == 0) continue;
+        const PageLatencyStats& l = res.replayed;
+        printf("%-6s %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %9.1f %9.1f %9.1f %9.1f %9.1f | "
+               "%9.1f %9.1f\n",
+               PageRecordOpName(static_cast<PageRecordOp>(op)), l.count, res.errors,
+               res.not_found, us(l, 0.5), us(l, 0.9), us(l, 0.99), us(l, 0.999), l.max_ns / 1e3,
+               us(res.recorded, 0.5), us(res.recorded, 0.99));
+    }
+}
+
+static void start_phase(Replay* r, const std::vector<PageRecord>* calls, bool measure);
+
+static int replay_poll(void* arg) {
+    auto r = static_cast<Replay*>(arg);
+    const std::vector<PageRecord>& calls = *r->calls;
+    uint64_t now = spdk_get_ticks();
+    size_t issued = 0;
+    while (r->next < calls.size() && !r->idle.empty()) {
+        const PageRecord& rec = calls[r->next];
+        if (pages_of(rec) > r->num_pages) {
+            r->skipped++;
+            r->next++;
+            continue;
+        }
+        if (r->timed) {
+            uint64_t due = r->t0 + static_cast<uint64_t>((rec.time_ns - calls.front().time_ns) /
+                                                         r->ns_per_tick);
+            if (due > now) break;
+            add_ns(r->lag, static_cast<uint64_t>((now - due) * r->ns_per_tick));
+        }
+        r->next++;
+        ReplaySlot* slot = r->idle.back();
+        r->idle.pop_back();
+        slot_issue(slot, rec);
+        issued++;
+    }
+    if (r->next < calls.size() || r->in_flight != 0) {
+        return issued ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+    }
+
+    spdk_poller_unregister(&r->poller);
+    if (!r->measure) {
+        if (r->fill_errors) {
+            SPDK_ERRLOG("%" PRIu64 " prefill writes failed\n", r->fill_errors);
+        }
+        start_phase(r, &g_records, true);
+        return SPDK_POLLER_BUSY;
+    }
+    r->end = spdk_get_ticks();
+    report(r);
+    replay_stop(r);
+    return SPDK_POLLER_BUSY;
+}
+
+static void start_phase(Replay* r, const std::vector<PageRecord>* calls, bool measure) {
+    r->calls = calls;
+    r->measure = measure;
+    r->timed = measure && !g_fast;
+    r->next = 0;
+    r->t0 = spdk_get_ticks();
+    r->poller = SPDK_POLLER_REGISTER(replay_poll, r, 0);
+    if (!r->poller) {
+        SPDK_ERRLOG("Failed to register the replay poller\n");
+        r->rc = -1;
+        replay_stop(r);
+    }
+}
+
+// Writes each page the capture reads and puts each key it gets, once.
+static void build_fill(Replay* r) {
+    std::vector<uint64_t> pages;
+    std::vector<uint64_t> keys;
+    for (const PageRecord& rec : g_records) {
+        if (rec.op == PageRecordOp::kRead && pages_of(rec) <= r->num_pages) {
+            uint64_t first = page_of(r, rec);
+            for (uint64_t i = 0; i < pages_of(rec); i++) pages.push_back(first + i);
+        } else if (rec.op == PageRecordOp::kGet) {
+            keys.push_back(rec.page);
+        }
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    r->fill.reserve(pages.size() + keys.size());
+    for (uint64_t page : pages) {
+        r->fill.push_back(PageRecord{0, page, 0, kPageSize, PageRecordOp::kWrite, 0, 0, 0});
+    }
+    for (uint64_t key : keys) {
+        r->fill.push_back(PageRecord{0, key, 0, kPageSize, PageRecordOp::kPut, 0, 0, 0});
+    }
+}
+
+static bool replay_setup(Replay* r) {
+    r->num_pages = r->store->NumPages();
+    r->ns_per_tick = 1e9 / static_cast<double>(spdk_get_ticks_hz());
+    uint64_t max_bytes = kPageSize;
+    for (const PageRecord& rec : g_records) {
+        add_ns(r->results[static_cast<size_t>(rec.op)].recorded, rec.latency_ns);
+        max_bytes = std::max(max_bytes, pages_of(rec) * kPageSize);
+    }
+    r->slots.resize(g_queue_depth);
+    for (ReplaySlot& slot : r->slots) {
+        slot.replay = r;
+        slot.buf = static_cast<char*>(spdk_dma_zmalloc(max_bytes, kPageSize, nullptr));
+        if (!slot.buf) {
+            SPDK_ERRLOG("Failed to allocate I/O buffers\n");
+            return false;
+        }
+        memset(slot.buf, 0x5a, max_bytes);
+        r->idle.push_back(&slot);
+    }
+    if (g_prefill) build_fill(r);
+    return true;
+}
+
+static void replay_start(void* arg) {
+    auto r = static_cast<Replay*>(arg);
+    r->store = std::make_unique<SpdkPageStore>();
+    r->store->Init(g_bdev_name, [r](bool ok) {
+        if (!ok || !replay_setup(r)) {
+            if (!ok) SPDK_ERRLOG("Failed to open PageStore on %s\n", g_bdev_name.c_str());
+            r->rc = -1;
+            replay_stop(r);
+            return;
+        }
+        if (g_prefill) {
+            start_phase(r, &r->fill, false);
+        } else {
+            start_phase(r, &g_records, true);
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    struct spdk_app_opts opts = {};
+    int rc = 0;
+
+    spdk_app_opts_init(&opts, sizeof(opts));
+    opts.name = "pagestore_replay";
+    opts.rpc_addr = nullptr;
+
+    if ((rc = spdk_app_parse_args(argc, argv, &opts, "ab:f:Fq:", nullptr, replay_parse_arg,
+                                  replay_usage)) != SPDK_APP_PARSE_ARGS_SUCCESS) {
+        exit(rc);
+    }
+    if (g_capture_path.empty()) {
+        fprintf(stderr, "-f <capture file> is required\n");
+        return 1;
+    }
+    std::string error;
+    if (!ReadPageRecordFile(g_capture_path, &g_header, &g_records, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (g_records.empty()) {
+        fprintf(stderr, "%s: the capture holds no calls\n", g_capture_path.c_str());
+        return 1;
+    }
+
+    auto replay = std::make_unique<Replay>();
+    rc = spdk_app_start(&opts, replay_start, replay.get());
+    if (rc) {
+        SPDK_ERRLOG("ERROR starting application\n");
+    } else {
+        rc = replay->rc;
+    }
+
+    replay.reset();
+    spdk_app_fini();
+    return rc;
+}
@@ -0,0 +1,196 @@
+/*   SPDX-License-Identifier: Apache-2.0
+ *
+ *   Turns a trace recorded with the PageStore tracepoints (page_trace.h) into
+ *   latency histograms per operation and stage:
+ *
+ *     queue     submit -> bdev submit      (admission control, token buckets)
+ *     device    bdev submit -> bdev done
+ *     complete  bdev done -> callback done (journal, CRC, codec, callback)
+ *     total     submit -> callback done
+ *
+ *   Record with the group enabled, e.g. `-e pagestore`, then either read the
+ *   live shared memory file or a copy made with spdk_trace_record:
+ *
+ *   ./buildDir/pagestore_trace_hist -s pagestore_alloc_bench -p <pid>
+ *   ./buildDir/pagestore_trace_hist -s pagestore_alloc_bench -i <shm id>
+ *   ./buildDir/pagestore_trace_hist -f /tmp/pagestore.trace
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk/trace_parser.h"
+#include "page_stats.h"
+#include "page_trace.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum Stage { kQueue, kDevice, kComplete, kTotal, kNumStages };
+
+static const char* const g_op_names[kNumPageTraceOps] = {"read", "write", "flush"};
+static const char* const g_stage_names[kNumStages] = {"queue", "device", "complete", "total"};
+
+// Timestamps of one traced I/O, or of one flush round, in ticks.
+struct Stamps {
+    PageTraceOp op = PageTraceOp::kRead;
+    uint64_t submit = 0;
+    uint64_t bdev_submit = 0; // first, for rounds of several ranges
+    uint64_t bdev_done = 0;   // last
+};
+
+static std::array<std::array<PageLatencyStats, kNumStages>, kNumPageTraceOps> g_hist;
+static std::unordered_map<uint64_t, Stamps> g_pending;
+static std::unordered_map<uint64_t, Stamps> g_rounds;
+static uint64_t g_failed = 0;
+
+static void add(PageTraceOp op, Stage stage, uint64_t from, uint64_t to, double ticksPerNs) {
+    if (from == 0 || to < from) return;
+    auto ns = static_cast<uint64_t>((to - from) / ticksPerNs);
+    PageLatencyStats& h = g_hist[static_cast<size_t>(op)][stage];
+    h.buckets[PageLatencyStats::Bucket(ns)]++;
+    h.count++;
+    h.sum_ns += ns;
+    h.max_ns = std::max(h.max_ns, ns);
+}
+
+static void finish_io(const Stamps& io, uint64_t done, double ticksPerNs) {
+    add(io.op, kQueue, io.submit, io.bdev_submit, ticksPerNs);
+    add(io.op, kDevice, io.bdev_submit, io.bdev_done, ticksPerNs);
+    add(io.op, kComplete, io.bdev_done, done, ticksPerNs);
+    add(io.op, kTotal, io.submit, done, ticksPerNs);
+}
+
+static void on_entry(const struct spdk_trace_parser_entry& e, double ticksPerNs) {
+    const struct spdk_trace_entry* entry = e.entry;
+    uint16_t first = PageTracepoint(PageTraceOp::kRead, PageTraceStage::kSubmit);
+    if (entry->tpoint_id < first ||
+        entry->tpoint_id >= first + kNumPageTraceOps * kNumPageTraceStages) {
+        return;
+    }
+    auto op = static_cast<PageTraceOp>((entry->tpoint_id - first) / kNumPageTraceStages);
+    auto stage = static_cast<PageTraceStage>((entry->tpoint_id - first) % kNumPageTraceStages);
+    uint64_t id = entry->object_id;
+    uint64_t tsc = entry->tsc;
+
+    if (stage == PageTraceStage::kSubmit) {
+        g_pending[id] = Stamps{op, tsc, 0, 0};
+        return;
+    }
+    if (stage != PageTraceStage::kCallbackDone) {
+        // Flush rounds have no submit stage of their own.
+        auto it = g_pending.find(id);
+        Stamps* io = nullptr;
+        if (it != g_pending.end()) {
+            io = &it->second;
+        } else if (op == PageTraceOp::kFlush) {
+            io = &g_rounds[id];
+            io->op = op;
+        } else {
+            return;
+        }
+        if (stage == PageTraceStage::kBdevSubmit && io->bdev_submit == 0) io->bdev_submit = tsc;
+        if (stage == PageTraceStage::kBdevDone) io->bdev_done = tsc;
+        return;
+    }
+
+    auto it = g_pending.find(id);
+    if (it == g_pending.end()) return; // submitted before the trace started
+    Stamps io = it->second;
+    g_pending.erase(it);
+    if (e.args[0].integer != 0) g_failed++;
+    if (op == PageTraceOp::kFlush) {
+        auto round = g_rounds.find(e.args[1].integer);
+        if (round != g_rounds.end()) {
+            io.bdev_submit = round->second.bdev_submit;
+            io.bdev_done = round->second.bdev_done;
+        }
+    }
+    finish_io(io, tsc, ticksPerNs);
+}
+
+static void print_histograms() {
+    printf("%-6s %-9s %10s %10s %10s %10s %10s %10s\n", "op", "stage", "count", "p50(us)",
+           "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (size_t op = 0; op < kNumPageTraceOps; op++) {
+        for (int stage = 0; stage < kNumStages; stage++) {
+            const PageLatencyStats& h = g_hist[op][stage];
+            if (h.count == 0) continue;
+            printf("%-6s %-9s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                   g_op_names[op], g_stage_names[stage], h.count, h.Percentile(0.5) / 1000.0,
+                   h.Percentile(0.9) / 1000.0, h.Percentile(0.99) / 1000.0,
+                   h.Percentile(0.999) / 1000.0, h.max_ns / 1000.0);
+        }
+    }
+    printf("failed: %" PRIu64 ", unfinished: %zu\n", g_failed, g_pending.size());
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s -f <trace file> | -s <app name> (-p <pid> | -i <shm id>)\n",
+            name);
+    fprintf(stderr, " -f <file>   trace file, e.g. written by spdk_trace_record\n");
+    fprintf(stderr, " -s <name>   name of a running app, to read its trace shm\n");
+    fprintf(stderr, " -p <pid>    pid of that app, if it runs without a shm id\n");
+    fprintf(stderr, " -i <id>     shm id of that app\n");
+}
+
+int main(int argc, char** argv) {
+    std::string file;
+    std::string shm_name;
+    int pid = -1;
+    int shm_id = -1;
+    int op;
+    while ((op = getopt(argc, argv, "f:s:p:i:h")) != -1) {
+        switch (op) {
+        case 'f':
+            file = optarg;
+            break;
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'i':
+            shm_id = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return op == 'h' ? 0 : 1;
+        }
+    }
+    if (file.empty() == shm_name.empty() || (!shm_name.empty() && (pid < 0) == (shm_id < 0))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct spdk_trace_parser_opts opts = {};
+    opts.lcore = SPDK_TRACE_MAX_LCORE;
+    if (!file.empty()) {
+        opts.filename = file.c_str();
+        opts.mode = SPDK_TRACE_PARSER_MODE_FILE;
+    } else {
+        // Named like spdk_trace does: /<app>_trace.pid<pid> or /<app>_trace.<shm id>.
+        file = "/" + shm_name + "_trace." +
+               (pid >= 0 ? "pid" + std::to_string(pid) : std::to_string(shm_id));
+        opts.filename = file.c_str();
+        opts.mode = SPDK_TRACE_PARSER_MODE_SHM;
+    }
+    struct spdk_trace_parser* parser = spdk_trace_parser_init(&opts);
+    if (!parser) {
+        fprintf(stderr, "Failed to open trace %s\n", opts.filename);
+        return 1;
+    }
+    const struct spdk_trace_file* trace = spdk_trace_parser_get_file(parser);
+    if (trace->tpoint_mask[TRACE_GROUP_PAGESTORE] == 0) {
+        fprintf(stderr, "Warning: the pagestore tracepoint group was not enabled\n");
+    }
+    double ticksPerNs = static_cast<double>(trace->tsc_rate) / 1e9;
+
+    struct spdk_trace_parser_entry entry;
+    while (spdk_trace_parser_next_entry(parser, &entry)) on_entry(entry, ticksPerNs);
+    spdk_trace_parser_cleanup(parser);
+
+    print_histograms();
+    return 0;
+}
@@ -0,0 +1,732 @@
+// zoned_page_store.cpp
+#include "zoned_page_store.h"
+
+#include <algorithm>
+
+ZonedPageStore::~ZonedPageStore() {
+    struct spdk_thread* self = spdk_get_thread();
+    for (auto& slot : channels_) {
+        ZoneChannel* ch = slot.exchange(nullptr, std::memory_order_acq_rel);
+        if (!ch) continue;
+        if (ch->thread == self) {
+            PutChannelMsg(ch);
+        } else if (spdk_thread_send_msg(ch->thread, PutChannelMsg, ch) != 0) {
+            std::cerr << "SPDK: Leaking I/O channel of exited thread" << std::endl;
+        }
+    }
+    if (desc_) spdk_bdev_close(desc_);
+}
+
+void ZonedPageStore::PutChannelMsg(void* arg) {
+    auto* ch = static_cast<ZoneChannel*>(arg);
+    spdk_put_io_channel(ch->bdev_ch);
+    while (ch->free_ios) {
+        ZoneIo* io = ch->free_ios;
+        ch->free_ios = io->next_free;
+        delete io;
+    }
+    delete ch;
+}
+
+bool ZonedPageStore::Init(const std::string& bdevName) {
+    Init(bdevName, [](bool ok) {
+        if (!ok) std::cerr << "SPDK: ZonedPageStore zone reset failed" << std::endl;
+    });
+    return desc_ != nullptr;
+}
+
+void ZonedPageStore::Init(const std::string& bdevName, IoCallback done) {
+    if (spdk_bdev_open_ext(bdevName.c_str(), true, nullptr, nullptr, &desc_) != 0) {
+        std::cerr << "SPDK: Failed to open bdev " << bdevName << std::endl;
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    bdev_ = spdk_bdev_desc_get_bdev(desc_);
+    uint32_t blockSize = spdk_bdev_get_block_size(bdev_);
+    uint64_t numZones = spdk_bdev_is_zoned(bdev_) ? spdk_bdev_get_num_zones(bdev_) : 0;
+    if (numZones <= opts_.gc_free_zones + 1 || kPageSize % blockSize != 0 ||
+        !spdk_bdev_io_type_supported(bdev_, SPDK_BDEV_IO_TYPE_ZONE_APPEND)) {
+        std::cerr << "SPDK: bdev " << bdevName << " needs zone append, " << kPageSize
+                  << "-byte-divisible blocks and more than " << opts_.gc_free_zones + 1
+                  << " zones" << std::endl;
+        spdk_bdev_close(desc_);
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    blocks_per_page_ = kPageSize / blockSize;
+    zone_size_ = spdk_bdev_get_zone_size(bdev_);
+    zones_.resize(numZones);
+    for (uint64_t i = 0; i < numZones; i++) zones_[i].start_lba = i * zone_size_;
+    // 0 means no limit; leave at least one active zone for the collector.
+    max_open_ = std::max<uint32_t>(1, opts_.open_zones);
+    if (uint32_t limit = spdk_bdev_get_max_open_zones(bdev_)) max_open_ = std::min(max_open_, limit);
+    if (uint32_t limit = spdk_bdev_get_max_active_zones(bdev_)) {
+        max_open_ = std::min(max_open_, std::max<uint32_t>(1, limit - 1));
+    }
+
+    ZoneChannel* ch = GetLocalChannel();
+    if (!ch) {
+        spdk_bdev_close(desc_);
+        desc_ = nullptr;
+        done(false);
+        return;
+    }
+    init_cb_ = std::move(done);
+    // Zone capacity can be smaller than the zone size; zones of one device
+    // share it.
+    if (spdk_bdev_get_zone_info(desc_, ch->bdev_ch, 0, 1, &zone_info_, OnZoneInfo, this) != 0) {
+        FinishInit(false);
+    }
+}
+
+void ZonedPageStore::OnZoneInfo(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* self = static_cast<ZonedPageStore*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    uint64_t zonePages = success ? self->zone_info_.capacity / self->blocks_per_page_ : 0;
+    if (zonePages == 0 || zonePages >= kNoZone) {
+        std::cerr << "SPDK: Unusable zone capacity " << self->zone_info_.capacity << std::endl;
+        self->FinishInit(false);
+        return;
+    }
+    self->zone_pages_ = static_cast<uint32_t>(zonePages);
+    uint64_t physical = self->zones_.size() * zonePages;
+    uint64_t writable = (self->zones_.size() - self->opts_.gc_free_zones) * zonePages;
+    uint32_t op = std::clamp<uint32_t>(self->opts_.overprovision_percent, 1, 90);
+    self->num_pages_ = writable * (100 - op) / 100;
+    self->l2p_.assign(self->num_pages_, kUnmapped);
+    self->p2l_.assign(physical, kUnmapped);
+    self->ResetNextZone();
+}
+
+void ZonedPageStore::ResetNextZone() {
+    ZoneChannel* ch = GetLocalChannel();
+    while (!reset_failed_ && reset_in_flight_ < kResetDepth && reset_next_ < zones_.size()) {
+        uint64_t lba = zones_[reset_next_].start_lba;
+        if (!ch || spdk_bdev_zone_management(desc_, ch->bdev_ch, lba, SPDK_BDEV_ZONE_RESET,
+                                             OnInitResetDone, this) != 0) {
+            reset_failed_ = true;
+            break;
+        }
+        reset_next_++;
+        reset_in_flight_++;
+    }
+    if (reset_in_flight_ == 0) FinishInit(!reset_failed_);
+}
+
+void ZonedPageStore::OnInitResetDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* self = static_cast<ZonedPageStore*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    if (!success) self->reset_failed_ = true;
+    self->reset_in_flight_--;
+    self->ResetNextZone();
+}
+
+void ZonedPageStore::FinishInit(bool success) {
+    if (success) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        empty_.clear();
+        // Popped from the back, so zones fill from the start of the device.
+        for (size_t i = zones_.size(); i-- > 0;) empty_.push_back(static_cast<uint32_t>(i));
+    }
+    ready_.store(success, std::memory_order_release);
+    IoCallback cb = std::move(init_cb_);
+    cb(success);
+}
+
+ZonedPageStore::ZoneChannel* ZonedPageStore::GetLocalChannel() {
+    struct spdk_thread* thread = spdk_get_thread();
+    if (!thread) {
+        std::cerr << "SPDK: PageStore I/O submitted from a non-SPDK thread" << std::endl;
+        return nullptr;
+    }
+    uint64_t id = spdk_thread_get_id(thread);
+    if (id >= kMaxThreads) {
+        std::cerr << "SPDK: Thread id " << id << " exceeds kMaxThreads" << std::endl;
+        return nullptr;
+    }
+
+    ZoneChannel* ch = channels_[id].load(std::memory_order_acquire);
+    if (ch) return ch;
+
+    struct spdk_io_channel* bdev_ch = spdk_bdev_get_io_channel(desc_);
+    if (!bdev_ch) return nullptr;
+    ch = new ZoneChannel();
+    ch->thread = thread;
+    ch->bdev_ch = bdev_ch;
+    ch->buf_pool = std::make_unique<PageBufferPool>(kPageSize, opts_.buffer_pool_size, true);
+    if (!ch->buf_pool->Init()) {
+        PutChannelMsg(ch);
+        return nullptr;
+    }
+    channels_[id].store(ch, std::memory_order_release);
+    return ch;
+}
+
+ZonedPageStore::ZoneIo* ZonedPageStore::AllocIo(ZoneChannel* ch) {
+    ZoneIo* io = ch->free_ios;
+    if (io) {
+        ch->free_ios = io->next_free;
+    } else {
+        io = new ZoneIo();
+    }
+    io->store = this;
+    io->ch = ch;
+    io->gc = false;
+    io->buf = nullptr;
+    io->user_buf = nullptr;
+    io->next_free = nullptr;
+    return io;
+}
+
+void ZonedPageStore::FreeIo(ZoneIo* io) {
+    io->cb.Reset();
+    io->next_free = io->ch->free_ios;
+    io->ch->free_ios = io;
+}
+
+uint64_t ZonedPageStore::LbaOf(uint64_t ppn) const {
+    return zones_[ppn / zone_pages_].start_lba + (ppn % zone_pages_) * blocks_per_page_;
+}
+
+uint32_t ZonedPageStore::ReserveAppendLocked(bool gc) {
+    if (active_ < max_open_ && empty_.size() > (gc ? 0u : 1u)) {
+        uint32_t zone = empty_.back();
+        empty_.pop_back();
+        zones_[zone].state = ZoneState::kOpen;
+        open_.push_back(zone);
+        active_++;
+    }
+    if (open_.empty()) return active_ > 0 ? kWaitZone : kNoZone;
+    size_t i = next_open_ % open_.size();
+    uint32_t zone = open_[i];
+    Zone& z = zones_[zone];
+    z.reserved++;
+    z.in_flight++;
+    if (z.reserved == zone_pages_) {
+        open_.erase(open_.begin() + i);
+    } else {
+        i++;
+    }
+    next_open_ = i;
+    return zone;
+}
+
+void ZonedPageStore::InvalidateLocked(uint64_t ppn) {
+    p2l_[ppn] = kUnmapped;
+    zones_[ppn / zone_pages_].valid--;
+    gc_idle_ = false;
+}
+
+void ZonedPageStore::WritePage(uint64_t pageId, const void* data, IoCallback cb) {
+    ZoneChannel* ch = Ready() && pageId < num_pages_ ? GetLocalChannel() : nullptr;
+    void* buf = ch ? ch->buf_pool->Get() : nullptr;
+    if (!buf) {
+        cb(false);
+        return;
+    }
+    memcpy(buf, data, kPageSize);
+    ZoneIo* io = AllocIo(ch);
+    io->pageId = pageId;
+    io->buf = buf;
+    io->cb = std::move(cb);
+    SubmitAppend(io);
+}
+
+void ZonedPageStore::SubmitAppend(ZoneIo* io) {
+    uint32_t zone;
+    bool startGc = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        zone = ReserveAppendLocked(io->gc);
+        if (!gc_running_ && !gc_idle_ && empty_.size() < opts_.gc_free_zones) {
+            gc_running_ = true;
+            startGc = true;
+        }
+        // Only the collector's empty zone is left: wait for the zone the
+        // running pass frees. GcStop wakes the write if it frees none.
+        if (zone == kNoZone && !io->gc && gc_running_) zone = kWaitZone;
+        if (zone == kWaitZone) {
+            io->next_free = append_waiters_;
+            append_waiters_ = io;
+        }
+    }
+    if (startGc) {
+        gc_ch_ = io->ch;
+        GcPickVictim();
+    }
+    if (zone == kWaitZone) return;
+    if (zone == kNoZone) {
+        FinishAppend(io, IoStatus::kNoSpace);
+        return;
+    }
+    io->zone = zone;
+    if (spdk_bdev_zone_append(desc_, io->ch->bdev_ch, io->buf, zones_[zone].start_lba,
+                              blocks_per_page_, OnAppendDone, io) == 0) {
+        return;
+    }
+    {
+        // The append never reached the device, and the device picks append
+        // positions, so the reservation can simply be handed back.
+        std::lock_guard<std::mutex> lock(mutex_);
+        Zone& z = zones_[zone];
+        if (z.reserved-- == zone_pages_) open_.push_back(zone);
+        z.in_flight--;
+    }
+    if (io->gc) {
+        // Never drop a live page over a transient failure; retry the move.
+        io->next_free = gc_retry_;
+        gc_retry_ = io;
+        GcRetryLater();
+        return;
+    }
+    FinishAppend(io, false);
+}
+
+bool ZonedPageStore::EndAppendLocked(uint32_t zone) {
+    Zone& z = zones_[zone];
+    z.in_flight--;
+    if (z.reserved < zone_pages_ || z.in_flight > 0) return false;
+    z.state = ZoneState::kFull;
+    active_--;
+    return true;
+}
+
+void ZonedPageStore::OnAppendDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* io = static_cast<ZoneIo*>(cb_arg);
+    uint64_t lba = success ? spdk_bdev_io_get_append_location(bdev_io) : 0;
+    spdk_bdev_free_io(bdev_io);
+    io->store->CompleteAppend(io, success, lba);
+}
+
+void ZonedPageStore::CompleteAppend(ZoneIo* io, bool success, uint64_t lba) {
+    bool filled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Zone& z = zones_[io->zone];
+        if (success) {
+            uint64_t ppn = io->zone * uint64_t{zone_pages_} + (lba - z.start_lba) / blocks_per_page_;
+            uint64_t& mapped = l2p_[io->pageId];
+            // A move only lands if nobody rewrote the page meanwhile;
+            // otherwise the new copy is garbage from the start.
+            if (!io->gc || mapped == io->ppn) {
+                if (mapped != kUnmapped) InvalidateLocked(mapped);
+                mapped = ppn;
+                p2l_[ppn] = io->pageId;
+                z.valid++;
+            }
+        }
+        filled = EndAppendLocked(io->zone);
+    }
+    if (success) dirty_.store(true, std::memory_order_relaxed);
+    if (filled) WakeAppendWaiters();
+    FinishAppend(io, success);
+}
+
+void ZonedPageStore::WakeAppendWaiters() {
+    ZoneIo* io;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        io = append_waiters_;
+        append_waiters_ = nullptr;
+    }
+    // Each waiter retries on its own thread, where its channel lives.
+    while (io) {
+        ZoneIo* next = io->next_free;
+        io->next_free = nullptr;
+        if (io->ch->thread == spdk_get_thread() ||
+            spdk_thread_send_msg(io->ch->thread, ResubmitAppendMsg, io) != 0) {
+            SubmitAppend(io);
+        }
+        io = next;
+    }
+}
+
+void ZonedPageStore::ResubmitAppendMsg(void* arg) {
+    auto* io = static_cast<ZoneIo*>(arg);
+    io->store->SubmitAppend(io);
+}
+
+void ZonedPageStore::FinishAppend(ZoneIo* io, IoStatus status) {
+    io->ch->buf_pool->Put(io->buf);
+    if (!io->gc) {
+        if (status) appends_.fetch_add(1, std::memory_order_relaxed);
+        IoCallback cb = std::move(io->cb);
+        FreeIo(io);
+        cb(status);
+        return;
+    }
+    if (status) {
+        gc_relocations_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // The victim is about to be reset; a page that could not be moved is
+        // dropped rather than left pointing at it.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (l2p_[io->pageId] == io->ppn) {
+            l2p_[io->pageId] = kUnmapped;
+            InvalidateLocked(io->ppn);
+        }
+    }
+    FreeIo(io);
+    gc_in_flight_--;
+    GcPump();
+}
+
+void ZonedPageStore::ReadPage(uint64_t pageId, void* buffer, IoCallback cb) {
+    ZoneChannel* ch = Ready() && pageId < num_pages_ ? GetLocalChannel() : nullptr;
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    uint64_t ppn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ppn = l2p_[pageId];
+        if (ppn != kUnmapped) zones_[ppn / zone_pages_].readers++;
+    }
+    if (ppn == kUnmapped) {
+        cb(IoStatus::kNotFound);
+        return;
+    }
+    ZoneIo* io = AllocIo(ch);
+    io->pageId = pageId;
+    io->ppn = ppn;
+    io->zone = static_cast<uint32_t>(ppn / zone_pages_);
+    io->buf = buffer;
+    io->cb = std::move(cb);
+    if (!SpdkPageStore::IsDmaSafe(buffer)) {
+        io->user_buf = buffer;
+        io->buf = ch->buf_pool->Get();
+        if (!io->buf) {
+            FinishRead(io, false);
+            return;
+        }
+    }
+    if (spdk_bdev_read_blocks(desc_, ch->bdev_ch, io->buf, LbaOf(ppn), blocks_per_page_,
+                              OnReadDone, io) != 0) {
+        FinishRead(io, false);
+    }
+}
+
+void ZonedPageStore::OnReadDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* io = static_cast<ZoneIo*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    io->store->FinishRead(io, success);
+}
+
+void ZonedPageStore::FinishRead(ZoneIo* io, IoStatus status) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        zones_[io->zone].readers--;
+    }
+    if (io->user_buf && io->buf) {
+        if (status) memcpy(io->user_buf, io->buf, kPageSize);
+        io->ch->buf_pool->Put(io->buf);
+    }
+    IoCallback cb = std::move(io->cb);
+    FreeIo(io);
+    cb(status);
+}
+
+void ZonedPageStore::GcPickVictim() {
+    uint32_t victim = kNoZone;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (Ready() && empty_.size() < 2 * uint64_t{opts_.gc_free_zones}) {
+            // Greedy: the full zone with the least live data frees the most
+            // space per page copied.
+            for (uint32_t i = 0; i < zones_.size(); i++) {
+                if (zones_[i].state != ZoneState::kFull) continue;
+                if (victim == kNoZone || zones_[i].valid < zones_[victim].valid) victim = i;
+            }
+            if (victim != kNoZone && zones_[victim].valid == zone_pages_) victim = kNoZone;
+            if (victim != kNoZone) zones_[victim].state = ZoneState::kCollecting;
+            // Nothing to reclaim until a page is overwritten or dropped.
+            gc_idle_ = victim == kNoZone;
+        }
+    }
+    if (victim == kNoZone) {
+        GcStop();
+        return;
+    }
+    gc_victim_ = victim;
+    gc_cursor_ = victim * uint64_t{zone_pages_};
+    GcPump();
+}
+
+void ZonedPageStore::GcPump() {
+    // Moves that fail inline come back here; the outer loop carries on.
+    if (gc_pumping_) return;
+    gc_pumping_ = true;
+    uint64_t end = (gc_victim_ + 1) * uint64_t{zone_pages_};
+    bool stalled = false;
+    while (gc_in_flight_ < kGcDepth && gc_cursor_ < end) {
+        uint64_t ppn = gc_cursor_;
+        uint64_t pageId;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pageId = p2l_[ppn];
+        }
+        if (pageId == kUnmapped) {
+            gc_cursor_++;
+            continue;
+        }
+        void* buf = gc_ch_->buf_pool->Get();
+        if (!buf) {
+            stalled = true;
+            break;
+        }
+        ZoneIo* io = AllocIo(gc_ch_);
+        io->gc = true;
+        io->pageId = pageId;
+        io->ppn = ppn;
+        io->buf = buf;
+        if (spdk_bdev_read_blocks(desc_, gc_ch_->bdev_ch, buf, LbaOf(ppn), blocks_per_page_,
+                                  OnGcReadDone, io) != 0) {
+            gc_ch_->buf_pool->Put(buf);
+            FreeIo(io);
+            stalled = true;
+            break;
+        }
+        gc_cursor_++;
+        gc_in_flight_++;
+    }
+    gc_pumping_ = false;
+    if (stalled && gc_in_flight_ == 0) {
+        GcRetryLater();
+    } else if (gc_cursor_ >= end && gc_in_flight_ == 0) {
+        GcResetVictim();
+    }
+}
+
+void ZonedPageStore::OnGcReadDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* io = static_cast<ZoneIo*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    if (!success) {
+        io->store->FinishAppend(io, false);
+        return;
+    }
+    io->store->SubmitAppend(io);
+}
+
+void ZonedPageStore::GcResetVictim() {
+    bool busy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // No page maps into the victim any more, so readers only drain.
+        busy = zones_[gc_victim_].readers > 0;
+    }
+    // GcRetryLater may end up in GcStop, which takes mutex_ itself.
+    if (busy) {
+        GcRetryLater();
+        return;
+    }
+    if (spdk_bdev_zone_management(desc_, gc_ch_->bdev_ch, zones_[gc_victim_].start_lba,
+                                  SPDK_BDEV_ZONE_RESET, OnGcResetDone, this) != 0) {
+        GcRetryLater();
+    }
+}
+
+void ZonedPageStore::OnGcResetDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* self = static_cast<ZonedPageStore*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        Zone& z = self->zones_[self->gc_victim_];
+        if (success) {
+            z.reserved = 0;
+            z.valid = 0;
+            z.state = ZoneState::kEmpty;
+            self->empty_.push_back(self->gc_victim_);
+        } else {
+            // Left full and empty of live pages; the next pass retries it.
+            z.state = ZoneState::kFull;
+        }
+    }
+    if (!success) {
+        std::cerr << "SPDK: Failed to reset zone at " << self->zones_[self->gc_victim_].start_lba
+                  << std::endl;
+        self->GcStop();
+        return;
+    }
+    self->zone_resets_.fetch_add(1, std::memory_order_relaxed);
+    self->WakeAppendWaiters();
+    self->GcPickVictim();
+}
+
+void ZonedPageStore::GcRetryLater() {
+    // Out of buffers or bdev_ios; try again shortly on this thread.
+    if (gc_poller_) return;
+    gc_poller_ = spdk_poller_register(GcRetryPoll, this, 100);
+    if (!gc_poller_) {
+        std::cerr << "SPDK: Zone collection stalled" << std::endl;
+        GcStop();
+    }
+}
+
+int ZonedPageStore::GcRetryPoll(void* arg) {
+    auto* self = static_cast<ZonedPageStore*>(arg);
+    spdk_poller_unregister(&self->gc_poller_);
+    ZoneIo* io = self->gc_retry_;
+    self->gc_retry_ = nullptr;
+    while (io) {
+        ZoneIo* next = io->next_free;
+        io->next_free = nullptr;
+        self->SubmitAppend(io);
+        io = next;
+    }
+    self->GcPump();
+    return SPDK_POLLER_BUSY;
+}
+
+void ZonedPageStore::GcStop() {
+    bool closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        gc_running_ = false;
+        closing = close_pending_;
+        close_pending_ = false;
+    }
+    // Writes parked for this pass retry; with the collector idle and no
+    // empty zone freed they now fail with kNoSpace.
+    WakeAppendWaiters();
+    if (closing) StartRelease();
+}
+
+void ZonedPageStore::Flush(IoCallback cb) {
+    ZoneChannel* ch = Ready() ? GetLocalChannel() : nullptr;
+    if (!ch) {
+        cb(false);
+        return;
+    }
+    ZoneIo* io = AllocIo(ch);
+    io->cb = std::move(cb);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        io->next_free = flush_waiters_;
+        flush_waiters_ = io;
+        // The flush in flight may have started before this caller's appends
+        // completed; it starts the next one when it ends.
+        if (flush_active_) return;
+        flush_active_ = true;
+    }
+    StartFlush(ch);
+}
+
+void ZonedPageStore::StartFlush(ZoneChannel* ch) {
+    ZoneIo* waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        waiters = flush_waiters_;
+        flush_waiters_ = nullptr;
+    }
+    if (!ch) {
+        FinishFlush(waiters, false);
+        return;
+    }
+    // Appends that completed after the last flush began set dirty_ again.
+    if (!dirty_.exchange(false, std::memory_order_relaxed)) {
+        FinishFlush(waiters, true);
+        return;
+    }
+    uint64_t bytes = spdk_bdev_get_num_blocks(bdev_) * spdk_bdev_get_block_size(bdev_);
+    if (spdk_bdev_flush(desc_, ch->bdev_ch, 0, bytes, OnFlushDone, waiters) != 0) {
+        dirty_.store(true, std::memory_order_relaxed);
+        FinishFlush(waiters, false);
+    }
+}
+
+void ZonedPageStore::OnFlushDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
+    auto* waiters = static_cast<ZoneIo*>(cb_arg);
+    spdk_bdev_free_io(bdev_io);
+    ZonedPageStore* self = waiters->store;
+    if (!success) self->dirty_.store(true, std::memory_order_relaxed);
+    self->FinishFlush(waiters, success);
+}
+
+void ZonedPageStore::FinishFlush(ZoneIo* waiters, bool success) {
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        more = flush_waiters_ != nullptr;
+        if (!more) flush_active_ = false;
+    }
+    // Each caller completes on its own thread, where its channel lives.
+    while (waiters) {
+        ZoneIo* next = waiters->next_free;
+        waiters->next_free = nullptr;
+        waiters->flushed = success;
+        if (waiters->ch->thread == spdk_get_thread() ||
+            spdk_thread_send_msg(waiters->ch->thread, RunFlushWaiter, waiters) != 0) {
+            RunFlushWaiter(waiters);
+        }
+        waiters = next;
+    }
+    if (more) StartFlush(GetLocalChannel());
+}
+
+void ZonedPageStore::RunFlushWaiter(void* arg) {
+    auto* io = static_cast<ZoneIo*>(arg);
+    IoCallback cb = std::move(io->cb);
+    bool success = io->flushed;
+    FreeIo(io);
+    cb(success);
+}
+
+void ZonedPageStore::Close(IoCallback cb) {
+    close_cb_ = std::move(cb);
+    close_thread_ = spdk_get_thread();
+    ready_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A collection pass in flight finishes its victim first.
+        if (gc_running_) {
+            close_pending_ = true;
+            return;
+        }
+    }
+    StartRelease();
+}
+
+void ZonedPageStore::StartRelease() {
+    if (spdk_get_thread() != close_thread_ &&
+        spdk_thread_send_msg(close_thread_, StartReleaseMsg, this) == 0) {
+        return;
+    }
+    StartReleaseMsg(this);
+}
+
+void ZonedPageStore::StartReleaseMsg(void* arg) {
+    spdk_for_each_thread(ReleaseLocalChannel, arg, OnChannelsReleased);
+}
+
+void ZonedPageStore::ReleaseLocalChannel(void* arg) {
+    auto* self = static_cast<ZonedPageStore*>(arg);
+    uint64_t id = spdk_thread_get_id(spdk_get_thread());
+    if (id >= kMaxThreads) return;
+    ZoneChannel* ch = self->channels_[id].exchange(nullptr, std::memory_order_acq_rel);
+    if (ch) PutChannelMsg(ch);
+}
+
+void ZonedPageStore::OnChannelsReleased(void* arg) {
+    auto* self = static_cast<ZonedPageStore*>(arg);
+    if (self->desc_) {
+        spdk_bdev_close(self->desc_);
+        self->desc_ = nullptr;
+    }
+    IoCallback cb = std::move(self->close_cb_);
+    if (cb) cb(true);
+}
+
+ZonedPageStoreStats ZonedPageStore::GetStats() const {
+    ZonedPageStoreStats stats;
+    stats.appends = appends_.load(std::memory_order_relaxed);
+    stats.gc_relocations = gc_relocations_.load(std::memory_order_relaxed);
+    stats.zone_resets = zone_resets_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
+        stats.empty_zones = empty_.size();
+    }
+    return stats;
+}
@@ -0,0 +1,212 @@
+// zoned_page_store.h
+// Log-structured PageStore for zoned bdevs (ZNS drives, or zone_block over
+// any bdev for testing).
+//
+// Zoned devices only accept sequential writes, so pages are never written in
+// place. Every write is a zone append into one of a few open zones; when the
+// append completes, the device reports where the page landed and the
+// in-memory page map is pointed at it, which makes the previous copy garbage.
+// A background collector picks the full zone with the fewest valid pages,
+// appends its live pages elsewhere and resets it.
+//
+// The page map lives in memory only: Init resets every zone, so the store
+// starts empty after a restart, which suits a cache.
+
+#pragma once
+
+#include <spdk/bdev_zone.h>
+#include "spdk_pagestore_interface.h"
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct ZonedPageStoreOptions {
+    // Zones written concurrently; appends rotate across them. Capped by the
+    // device's open and active zone limits.
+    uint32_t open_zones = 4;
+    // Garbage collection starts when fewer zones than this are empty and
+    // keeps going until twice as many are. Writes never take the last empty
+    // zone, so collection always has somewhere to move pages to.
+    uint32_t gc_free_zones = 2;
+    // Share of the writable capacity held back from the page range, so a
+    // collected zone is never completely live. Higher means less copying.
+    uint32_t overprovision_percent = 10;
+    // Pinned page buffers pre-allocated per SPDK thread for writes and bounces.
+    size_t buffer_pool_size = 256;
+};
+
+struct ZonedPageStoreStats {
+    uint64_t appends = 0;         // page appends on behalf of callers
+    uint64_t gc_relocations = 0;  // live pages the collector moved
+    uint64_t zone_resets = 0;     // zones reclaimed by the collector
+    uint64_t empty_zones = 0;
+};
+
+class ZonedPageStore : public PageStore {
+public:
+    static constexpr size_t kMaxThreads = SpdkPageStore::kMaxThreads;
+
+    explicit ZonedPageStore(const ZonedPageStoreOptions& opts = {}) : opts_(opts) {}
+    ~ZonedPageStore() override;
+
+    // Opens a zoned bdev and resets all of its zones; returns false if that
+    // could not be started. The overload's done runs once every zone is
+    // empty; I/O is rejected until then.
+    bool Init(const std::string& bdevName) override;
+    void Init(const std::string& bdevName, IoCallback done);
+
+    // Reads of a page that was never written complete with kNotFound.
+    void WritePage(uint64_t pageId, const void* data, IoCallback cb) override;
+    void ReadPage(uint64_t pageId, void* buffer, IoCallback cb) override;
+    // Flushes the device if anything was appended since the last flush.
+    // Calls made while a flush is in flight wait for it, then share the next
+    // one, which is skipped if nothing was appended meanwhile.
+    void Flush(IoCallback cb) override;
+
+    // Same rules as SpdkPageStore::Close.
+    void Close(IoCallback cb);
+
+    uint64_t NumPages() const { return num_pages_; }
+    ZonedPageStoreStats GetStats() const;
+
+private:
+    struct ZoneChannel;
+
+    enum class ZoneState : uint8_t { kEmpty, kOpen, kFull, kCollecting };
+
+    struct Zone {
+        uint64_t start_lba = 0;
+        uint32_t reserved = 0;  // appends issued, including in flight
+        uint32_t in_flight = 0; // appends not yet completed
+        uint32_t valid = 0;     // pages the map still points at
+        uint32_t readers = 0;   // reads in flight; the zone is not reset under them
+        ZoneState state = ZoneState::kEmpty;
+    };
+
+    // One page append, read or collector move, recycled per channel.
+    struct ZoneIo {
+        ZonedPageStore* store;
+        ZoneChannel* ch;
+        uint64_t pageId;
+        uint64_t ppn;       // physical page read from, or moved away from
+        uint32_t zone;
+        bool gc;
+        void* buf;          // DMA buffer handed to the bdev
+        void* user_buf;     // caller buffer when buf is a bounce page
+        bool flushed;       // outcome handed to a Flush caller
+        IoCallback cb;
+        ZoneIo* next_free;
+    };
+
+    struct ZoneChannel {
+        struct spdk_thread* thread = nullptr;
+        struct spdk_io_channel* bdev_ch = nullptr;
+        std::unique_ptr<PageBufferPool> buf_pool;
+        ZoneIo* free_ios = nullptr;
+    };
+
+    static constexpr uint64_t kUnmapped = UINT64_MAX;
+    static constexpr uint32_t kNoZone = UINT32_MAX;
+    static constexpr uint32_t kWaitZone = UINT32_MAX - 1;
+    static constexpr size_t kGcDepth = 16;   // collector moves in flight
+    static constexpr size_t kResetDepth = 8; // zone resets in flight during Init
+
+    bool Ready() const { return ready_.load(std::memory_order_acquire); }
+    ZoneChannel* GetLocalChannel();
+    ZoneIo* AllocIo(ZoneChannel* ch);
+    static void FreeIo(ZoneIo* io);
+    uint64_t LbaOf(uint64_t ppn) const;
+    // Picks an open zone with room, opening an empty one if needed; the last
+    // empty zone is left to the collector. kNoZone if the device is out of
+    // space, kWaitZone if the open zone limit is taken up by zones whose
+    // last appends are still in flight.
+    uint32_t ReserveAppendLocked(bool gc);
+    // Resubmits parked appends once a zone has been filled or reset, or the
+    // collector has stopped.
+    void WakeAppendWaiters();
+    void InvalidateLocked(uint64_t ppn);
+    void SubmitAppend(ZoneIo* io);
+    void CompleteAppend(ZoneIo* io, bool success, uint64_t lba);
+    // Ends an append's claim on its zone; true if that filled the zone.
+    bool EndAppendLocked(uint32_t zone);
+    // Completes a caller's write or ends a collector move.
+    void FinishAppend(ZoneIo* io, IoStatus status);
+    void FinishRead(ZoneIo* io, IoStatus status);
+    void GcPickVictim();
+    void GcPump();
+    void GcResetVictim();
+    void GcRetryLater();
+    void GcStop();
+    void ResetNextZone();
+    void FinishInit(bool success);
+    // Runs one device flush for every queued Flush caller.
+    void StartFlush(ZoneChannel* ch);
+    void FinishFlush(ZoneIo* waiters, bool success);
+    void StartRelease();
+
+    static void OnAppendDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnReadDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnGcReadDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnGcResetDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnZoneInfo(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnInitResetDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static void OnFlushDone(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg);
+    static int GcRetryPoll(void* arg);
+    static void ResubmitAppendMsg(void* arg);
+    static void RunFlushWaiter(void* arg);
+    static void PutChannelMsg(void* arg);
+    static void StartReleaseMsg(void* arg);
+    static void ReleaseLocalChannel(void* arg);
+    static void OnChannelsReleased(void* arg);
+
+    ZonedPageStoreOptions opts_;
+    struct spdk_bdev* bdev_ = nullptr;
+    struct spdk_bdev_desc* desc_ = nullptr;
+    std::array<std::atomic<ZoneChannel*>, kMaxThreads> channels_{};
+    uint64_t blocks_per_page_ = 0;
+    uint64_t zone_size_ = 0;      // blocks
+    uint32_t zone_pages_ = 0;     // writable pages per zone
+    uint64_t num_pages_ = 0;
+    std::atomic<bool> ready_{false};
+    std::atomic<bool> dirty_{false};
+
+    // Guards the page map and zone state below.
+    std::mutex mutex_;
+    std::vector<uint64_t> l2p_; // pageId -> physical page, or kUnmapped
+    std::vector<uint64_t> p2l_; // physical page -> pageId, or kUnmapped
+    std::vector<Zone> zones_;
+    std::vector<uint32_t> open_;  // zones taking appends, each with room left
+    std::vector<uint32_t> empty_;
+    size_t next_open_ = 0;
+    uint32_t max_open_ = 0;
+    uint32_t active_ = 0;  // zones in kOpen, including ones with no room left
+    ZoneIo* append_waiters_ = nullptr;
+    ZoneIo* flush_waiters_ = nullptr; // Flush callers of the next device flush
+    bool flush_active_ = false;       // a device flush is in flight
+    bool gc_running_ = false;
+    bool gc_idle_ = false;        // the last pass found no zone worth collecting
+    bool close_pending_ = false;  // Close is waiting for the collector
+    std::atomic<uint64_t> appends_{0};
+    std::atomic<uint64_t> gc_relocations_{0};
+    std::atomic<uint64_t> zone_resets_{0};
+
+    // Collector state, only touched on the thread running the collection.
+    ZoneChannel* gc_ch_ = nullptr;
+    uint32_t gc_victim_ = kNoZone;
+    uint64_t gc_cursor_ = 0;   // next physical page of the victim to examine
+    size_t gc_in_flight_ = 0;
+    bool gc_pumping_ = false;
+    ZoneIo* gc_retry_ = nullptr; // moves whose append could not be submitted
+    struct spdk_poller* gc_poller_ = nullptr;
+
+    // Init state.
+    IoCallback init_cb_;
+    struct spdk_bdev_zone_info zone_info_{};
+    uint64_t reset_next_ = 0;
+    size_t reset_in_flight_ = 0;
+    bool reset_failed_ = false;
+
+    IoCallback close_cb_;
+    struct spdk_thread* close_thread_ = nullptr;
+};
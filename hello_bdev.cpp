@@ -269,7 +269,6 @@ int main(int argc, char **argv) {
     // Set default values in opts structure.
     spdk_app_opts_init(&opts, sizeof(opts));
     opts.name = "hello_bdev";
-    opts.rpc_addr = nullptr;
 
     /*
      * Parse built-in SPDK command line parameters as well